@@ -0,0 +1,192 @@
+/*
+ * alloc-count.c: counts heap allocations of a benchmark
+ *
+ * Copyright (C) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "alloc-count.h"
+
+/*
+ * The allocator entry points are interposed in the benchmark binary, so
+ * every allocation made by GLib and json-c on its behalf is counted.
+ * glibc still exports its own implementation under the __libc_ names.
+ *
+ * Built as alloc-count.so it can be preloaded into the session manager
+ * instead; with $BENCH_ALLOC_STATS set, the live heap size is tracked as
+ * well and the counters go to that file (see alloc_count_export()).
+ */
+
+extern void *__libc_malloc   (size_t size);
+extern void *__libc_calloc   (size_t nmemb, size_t size);
+extern void *__libc_realloc  (void *ptr, size_t size);
+extern void *__libc_memalign (size_t alignment, size_t size);
+extern void  __libc_free     (void *ptr);
+
+static AllocCountStats  local_stats;
+static AllocCountStats *stats = &local_stats;
+static gboolean         track_bytes = FALSE;
+
+
+
+guint64
+alloc_count_get (void)
+{
+	return __atomic_load_n (&stats->allocs, __ATOMIC_RELAXED);
+}
+
+static void
+alloc_count_inc (void)
+{
+	__atomic_add_fetch (&stats->allocs, 1, __ATOMIC_RELAXED);
+}
+
+static void
+alloc_count_bytes (gint64 delta)
+{
+	gint64 live, peak;
+
+	live = __atomic_add_fetch (&stats->live_bytes, delta, __ATOMIC_RELAXED);
+	peak = __atomic_load_n (&stats->peak_bytes, __ATOMIC_RELAXED);
+	while (live > peak &&
+           !__atomic_compare_exchange_n (&stats->peak_bytes, &peak, live, TRUE,
+                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+static void *
+alloc_count_allocated (void *ptr)
+{
+	if (track_bytes && ptr)
+		alloc_count_bytes (malloc_usable_size (ptr));
+
+	return ptr;
+}
+
+/* Blocks allocated before the export started are subtracted too, so
+ * the live size is off by a constant; soak runs only look at its slope. */
+__attribute__ ((constructor)) static void
+alloc_count_export (void)
+{
+	int fd;
+	void *map;
+	const char *path = getenv ("BENCH_ALLOC_STATS");
+
+	if (!path)
+		return;
+
+	fd = open (path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd < 0)
+		return;
+
+	if (ftruncate (fd, sizeof (AllocCountStats)) == 0) {
+		map = mmap (NULL, sizeof (AllocCountStats), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (map != MAP_FAILED) {
+			memcpy (map, &local_stats, sizeof (AllocCountStats));
+			stats = map;
+			track_bytes = TRUE;
+		}
+	}
+	close (fd);
+
+	/* children inherit the preload, but must not write to our counters */
+	unsetenv ("BENCH_ALLOC_STATS");
+}
+
+void *
+malloc (size_t size)
+{
+	alloc_count_inc ();
+	return alloc_count_allocated (__libc_malloc (size));
+}
+
+void *
+calloc (size_t nmemb, size_t size)
+{
+	alloc_count_inc ();
+	return alloc_count_allocated (__libc_calloc (nmemb, size));
+}
+
+void *
+realloc (void *ptr, size_t size)
+{
+	void *new_ptr;
+	gint64 old_size = 0;
+
+	alloc_count_inc ();
+
+	if (track_bytes && ptr)
+		old_size = malloc_usable_size (ptr);
+
+	new_ptr = __libc_realloc (ptr, size);
+
+	if (track_bytes) {
+		if (new_ptr)
+			alloc_count_bytes ((gint64) malloc_usable_size (new_ptr) - old_size);
+		else if (size == 0)
+			alloc_count_bytes (-old_size);
+	}
+
+	return new_ptr;
+}
+
+void *
+memalign (size_t alignment, size_t size)
+{
+	alloc_count_inc ();
+	return alloc_count_allocated (__libc_memalign (alignment, size));
+}
+
+void *
+aligned_alloc (size_t alignment, size_t size)
+{
+	alloc_count_inc ();
+	return alloc_count_allocated (__libc_memalign (alignment, size));
+}
+
+int
+posix_memalign (void **memptr, size_t alignment, size_t size)
+{
+	void *ptr;
+
+	alloc_count_inc ();
+
+	ptr = alloc_count_allocated (__libc_memalign (alignment, size));
+	if (!ptr)
+		return ENOMEM;
+
+	*memptr = ptr;
+
+	return 0;
+}
+
+void
+free (void *ptr)
+{
+	if (track_bytes && ptr) {
+		__atomic_add_fetch (&stats->frees, 1, __ATOMIC_RELAXED);
+		alloc_count_bytes (-(gint64) malloc_usable_size (ptr));
+	}
+
+	__libc_free (ptr);
+}
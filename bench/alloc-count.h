@@ -0,0 +1,41 @@
+/*
+ * alloc-count.h: counts heap allocations of a benchmark
+ *
+ * Copyright (C) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef ALLOC_COUNT_H
+#define ALLOC_COUNT_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Preloaded into another process, the counters are kept in the file
+ * named by $BENCH_ALLOC_STATS, mapped shared, for a soak run to sample */
+typedef struct {
+	guint64 allocs;
+	guint64 frees;
+	gint64  live_bytes;
+	gint64  peak_bytes;
+} AllocCountStats;
+
+guint64 alloc_count_get (void);
+
+G_END_DECLS
+
+#endif /* ALLOC_COUNT_H */
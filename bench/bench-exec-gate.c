@@ -0,0 +1,209 @@
+/*
+ * bench-exec-gate.c: cost of the fanotify exec gate
+ *
+ * Copyright (C) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <spawn.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include "exec-gate.h"
+#include "alloc-count.h"
+#include "bench-report.h"
+
+/*
+ * The lookup every guarded exec waits for, against a policy the size of
+ * a busy terminal server. Run as root, the time of a whole exec of a
+ * guarded binary is compared with an unguarded copy as well; execs of
+ * binaries without a mark are not affected at all.
+ */
+
+#define POLICY_BINARIES         200
+#define POLICY_USERS            100
+#define LOOKUPS                 2000000
+#define EXECS                   2000
+
+extern char **environ;
+
+static void
+bench_lookups (ExecGatePolicy *policy, struct stat *files, guint n_files, gboolean hit)
+{
+	guint i;
+	gint64 begin;
+	guint64 allocs;
+	guint denied = 0;
+
+	allocs = alloc_count_get ();
+	begin = g_get_monotonic_time ();
+	for (i = 0; i < LOOKUPS; i++) {
+		const struct stat *st = &files[i % n_files];
+		/* uids 1000.. are in the policy, 5000.. are not */
+		guint32 uid = (hit ? 1000 : 5000) + (i % POLICY_USERS);
+		denied += exec_gate_policy_denies (policy, st->st_dev, st->st_ino, uid);
+	}
+
+	if (hit && denied != LOOKUPS) {
+		g_printerr ("lookup missed a blocked binary\n");
+		exit (1);
+	}
+
+	bench_report ("lookup", hit ? "blocked" : "allowed", LOOKUPS,
+                  (g_get_monotonic_time () - begin) * 1000.0 / LOOKUPS,
+                  (gdouble)(alloc_count_get () - allocs) / LOOKUPS);
+}
+
+static gdouble
+bench_execs (const gchar *path)
+{
+	guint i;
+	gint64 begin;
+	gchar *argv[] = { (gchar *) path, NULL };
+
+	begin = g_get_monotonic_time ();
+	for (i = 0; i < EXECS; i++) {
+		pid_t pid;
+		gint status;
+
+		if (posix_spawn (&pid, path, NULL, NULL, argv, environ) != 0) {
+			g_printerr ("failed to run %s\n", path);
+			exit (1);
+		}
+		waitpid (pid, &status, 0);
+	}
+
+	return (g_get_monotonic_time () - begin) * 1000.0 / EXECS;
+}
+
+static gchar *
+copy_binary (const gchar *dir, const gchar *name)
+{
+	gchar *contents, *path;
+	gsize length;
+
+	if (!g_file_get_contents ("/bin/true", &contents, &length, NULL))
+		return NULL;
+
+	path = g_build_filename (dir, name, NULL);
+	g_file_set_contents (path, contents, length, NULL);
+	g_chmod (path, 0755);
+	g_free (contents);
+
+	return path;
+}
+
+static void
+bench_live (const gchar *dir)
+{
+	gchar *guarded, *plain;
+	ExecGate *gate;
+	ExecGatePolicy *policy;
+	GError *error = NULL;
+	gdouble guarded_ns, plain_ns;
+	guint64 allowed = 0;
+
+	gate = exec_gate_new (&error);
+	if (!gate) {
+		g_print ("exec gate not available: %s\n", error->message);
+		g_error_free (error);
+		return;
+	}
+
+	guarded = copy_binary (dir, "guarded");
+	plain = copy_binary (dir, "plain");
+
+	/* blocked for nobody, so the exec goes through the whole check */
+	policy = exec_gate_policy_new ();
+	exec_gate_policy_add (policy, guarded, 65534);
+	exec_gate_set_policy (gate, policy);
+
+	plain_ns = bench_execs (plain);
+	guarded_ns = bench_execs (guarded);
+
+	exec_gate_get_counters (gate, &allowed, NULL);
+
+	/* the allocations are the child's, they are not counted */
+	bench_report ("exec", "plain", EXECS, plain_ns, -1);
+	bench_report ("exec", "guarded", EXECS, guarded_ns, -1);
+	g_print ("%" G_GUINT64_FORMAT " exec events checked\n", allowed);
+
+	exec_gate_free (gate);
+
+	g_unlink (guarded);
+	g_unlink (plain);
+	g_free (guarded);
+	g_free (plain);
+}
+
+int
+main (int argc, char **argv)
+{
+	guint i, j;
+	gchar *dir;
+	struct stat files[POLICY_BINARIES];
+	ExecGatePolicy *policy;
+
+	dir = g_dir_make_tmp ("bench-exec-gate-XXXXXX", NULL);
+	if (!dir) {
+		g_printerr ("failed to create a temporary directory\n");
+		return 1;
+	}
+
+	policy = exec_gate_policy_new ();
+	for (i = 0; i < POLICY_BINARIES; i++) {
+		gchar *path = g_strdup_printf ("%s/binary-%u", dir, i);
+
+		g_file_set_contents (path, "", 0, NULL);
+		stat (path, &files[i]);
+		for (j = 0; j < POLICY_USERS; j++)
+			exec_gate_policy_add (policy, path, 1000 + j);
+
+		g_free (path);
+	}
+
+	bench_lookups (policy, files, POLICY_BINARIES, TRUE);
+	bench_lookups (policy, files, POLICY_BINARIES, FALSE);
+
+	exec_gate_policy_free (policy);
+
+	/* removed only now so that no two of them share an inode */
+	for (i = 0; i < POLICY_BINARIES; i++) {
+		gchar *path = g_strdup_printf ("%s/binary-%u", dir, i);
+		g_unlink (path);
+		g_free (path);
+	}
+
+	if (geteuid () == 0)
+		bench_live (dir);
+	else
+		g_print ("not root, skipping the exec benchmark\n");
+
+	g_rmdir (dir);
+	g_free (dir);
+
+	return 0;
+}
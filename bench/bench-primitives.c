@@ -0,0 +1,525 @@
+/*
+ * bench-primitives.c: cost of the primitives blacklist handling is made of
+ *
+ * Copyright (C) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+#include <gio/gdesktopappinfo.h>
+
+#include "panel-glib.h"
+#include "agent-json.h"
+#include "blacklist-resolve.h"
+#include "blacklist-snapshot.h"
+#include "bench-report.h"
+
+/*
+ * Every blacklist change goes through the same few primitives: the agent
+ * reply is scanned for the list, each entry is matched against every
+ * installed desktop file (case insensitively, in Korean as often as in
+ * English) and resolved to a binary, and the result is published as a
+ * snapshot. They are measured here one by one on inputs of the sizes seen
+ * in the field: up to 20000 desktop files, blacklists of up to 5000
+ * entries and agent replies of several MB.
+ *
+ * The desktop files are read once per process by GIO, so each tree size
+ * is measured in a child process of its own.
+ */
+
+#define MIN_USEC                (300 * G_USEC_PER_SEC / 1000)
+#define N_NAMES                 1024
+#define N_BINARIES              64
+#define LARGE_REPLY_SIZE        (4 * 1024 * 1024)
+
+static const gchar *words_en[] = {
+	"Web", "Browser", "Terminal", "Document", "Editor", "Photo", "Viewer",
+	"Calculator", "Files", "Manager", "Music", "Player", "Video", "Settings",
+	"Mail", "Client", "Office", "Gooroom", "Text", "Image"
+};
+
+static const gchar *words_ko[] = {
+	"웹", "브라우저", "터미널", "문서", "편집기", "사진", "뷰어",
+	"계산기", "파일", "관리자", "음악", "재생기", "동영상", "설정",
+	"메일", "클라이언트", "오피스", "구름", "텍스트", "이미지"
+};
+
+static GRand *words_rand = NULL;
+
+
+
+static gchar *
+app_name (const gchar **words, guint n_words, guint serial)
+{
+	return g_strdup_printf ("%s %s %s %05u",
+                            words[g_rand_int_range (words_rand, 0, n_words)],
+                            words[g_rand_int_range (words_rand, 0, n_words)],
+                            words[g_rand_int_range (words_rand, 0, n_words)],
+                            serial);
+}
+
+typedef struct {
+	gchar    *haystacks[N_NAMES];
+	gchar    *needles[N_NAMES];
+	gboolean  hit;
+} StrstrcaseInput;
+
+static gboolean
+strstrcase_op (gpointer data, guint64 i)
+{
+	StrstrcaseInput *input = data;
+	const gchar *found;
+
+	found = panel_g_utf8_strstrcase (input->haystacks[i % N_NAMES], input->needles[i % N_NAMES]);
+
+	return ((found != NULL) == input->hit);
+}
+
+static void
+bench_strstrcase (const gchar *variant, const gchar **words, guint n_words,
+                  const gchar *missing, gboolean hit)
+{
+	guint i;
+	StrstrcaseInput input;
+
+	input.hit = hit;
+	for (i = 0; i < N_NAMES; i++) {
+		input.haystacks[i] = app_name (words, n_words, i);
+		/* the last word and the serial, in another case where there is one */
+		if (hit)
+			input.needles[i] = g_utf8_strup (strchr (strchr (input.haystacks[i], ' ') + 1, ' ') + 1, -1);
+		else
+			input.needles[i] = g_strdup (missing);
+	}
+
+	bench_run ("strstrcase", variant, MIN_USEC, strstrcase_op, &input);
+
+	for (i = 0; i < N_NAMES; i++) {
+		g_free (input.haystacks[i]);
+		g_free (input.needles[i]);
+	}
+}
+
+typedef struct {
+	gchar       *reply;
+	gsize        len;
+	const gchar *property;
+	guint        n_entries;
+} AgentReplyInput;
+
+static gboolean
+task_output_op (gpointer data, guint64 i)
+{
+	AgentReplyInput *input = data;
+	AgentJsonValue value;
+	gchar *list, *p;
+	guint n = 1;
+
+	/* what the session manager does with a reply */
+	if (!agent_json_task_output (input->reply, input->len, input->property, &value))
+		return (input->n_entries == 0);
+
+	list = agent_json_value_dup (&value);
+	for (p = list; *p; p++)
+		n += (*p == ',');
+	g_free (list);
+
+	return (n == input->n_entries);
+}
+
+/* A get_app_list reply whose list comes after @padding bytes of other
+ * output, the way a large reply of the agent looks */
+static gchar *
+agent_reply (guint n_entries, gsize padding)
+{
+	guint i;
+	GString *reply;
+
+	reply = g_string_new ("{\"module\": {\"module_name\": \"config\", \"task\": "
+                          "{\"task_name\": \"get_app_list\", \"in\": {\"login_id\": \"user\"}, "
+                          "\"out\": {\"status\": \"200\", \"message\": \"\\\"ok\\\"\", \"installed\": [");
+
+	for (i = 0; reply->len < padding; i++)
+		g_string_append_printf (reply, "%s{\"name\": \"org.example.Package%u\", \"version\": \"%u.%u.%u-gooroom1\", "
+                                "\"summary\": \"\\ud328\\ud0a4\\uc9c0 %u \\uc124\\uba85\"}",
+                                i ? ", " : "", i, i % 7, i % 13, i % 17, i);
+
+	g_string_append (reply, "], \"black_list\": \"");
+	for (i = 0; i < n_entries; i++) {
+		if (i)
+			g_string_append_c (reply, ',');
+		/* the agent escapes everything that is not ASCII */
+		if (i % 10 == 9)
+			g_string_append_printf (reply, "\\ud55c\\uae00-%05u.desktop", i);
+		else
+			g_string_append_printf (reply, "org.example.Application%05u.desktop", i);
+	}
+	g_string_append (reply, "\"}}}}");
+
+	return g_string_free (reply, FALSE);
+}
+
+static void
+bench_task_output (const gchar *variant, const gchar *property,
+                   guint n_entries, gsize padding)
+{
+	AgentReplyInput input;
+
+	input.reply = agent_reply (n_entries, padding);
+	input.len = strlen (input.reply);
+	input.property = property;
+	input.n_entries = g_str_equal (property, "black_list") ? n_entries : 0;
+
+	bench_run ("task_output", variant, MIN_USEC, task_output_op, &input);
+
+	g_free (input.reply);
+}
+
+typedef struct {
+	gchar   **names;
+	guint     n_names;
+	gboolean  hit;
+	BlacklistSnapshot *snapshot;
+} SnapshotInput;
+
+static gboolean
+snapshot_seal_op (gpointer data, guint64 i)
+{
+	SnapshotInput *input = data;
+	BlacklistSnapshotBuilder *builder;
+	BlacklistSnapshot *snapshot;
+	gboolean ret;
+	guint j;
+	gint fd;
+
+	builder = blacklist_snapshot_builder_new ();
+	for (j = 0; j < input->n_names; j++) {
+		blacklist_snapshot_builder_add_name (builder, input->names[j]);
+		blacklist_snapshot_builder_add_inode (builder, 2049, 100000 + j);
+	}
+	fd = blacklist_snapshot_builder_seal (builder, i + 1, NULL);
+	blacklist_snapshot_builder_free (builder);
+	if (fd < 0)
+		return FALSE;
+
+	snapshot = blacklist_snapshot_map (fd, NULL);
+	ret = (snapshot && blacklist_snapshot_get_generation (snapshot) == i + 1);
+	if (snapshot)
+		blacklist_snapshot_unmap (snapshot);
+	close (fd);
+
+	return ret;
+}
+
+static gboolean
+snapshot_lookup_op (gpointer data, guint64 i)
+{
+	SnapshotInput *input = data;
+	const gchar *name = input->names[i % input->n_names];
+
+	/* misses are looked up with the first letter left out */
+	return (blacklist_snapshot_has_name (input->snapshot, input->hit ? name : name + 1) == input->hit);
+}
+
+static void
+bench_snapshot (guint n_names)
+{
+	guint i;
+	gint fd;
+	gchar *variant;
+	SnapshotInput input;
+	BlacklistSnapshotBuilder *builder;
+
+	input.n_names = n_names;
+	input.names = g_new0 (gchar *, n_names + 1);
+	for (i = 0; i < n_names; i++)
+		input.names[i] = g_strdup_printf ("/usr/share/applications/org.example.Application%05u.desktop", i);
+
+	variant = g_strdup_printf ("%u", n_names);
+	bench_run ("snapshot_seal", variant, MIN_USEC, snapshot_seal_op, &input);
+	g_free (variant);
+
+	builder = blacklist_snapshot_builder_new ();
+	for (i = 0; i < n_names; i++)
+		blacklist_snapshot_builder_add_name (builder, input.names[i]);
+	fd = blacklist_snapshot_builder_seal (builder, 1, NULL);
+	blacklist_snapshot_builder_free (builder);
+	input.snapshot = (fd < 0) ? NULL : blacklist_snapshot_map (fd, NULL);
+	if (!input.snapshot) {
+		g_printerr ("failed to seal a snapshot\n");
+		exit (1);
+	}
+
+	input.hit = TRUE;
+	variant = g_strdup_printf ("%u-hit", n_names);
+	bench_run ("snapshot_lookup", variant, MIN_USEC, snapshot_lookup_op, &input);
+	g_free (variant);
+
+	input.hit = FALSE;
+	variant = g_strdup_printf ("%u-miss", n_names);
+	bench_run ("snapshot_lookup", variant, MIN_USEC, snapshot_lookup_op, &input);
+	g_free (variant);
+
+	blacklist_snapshot_unmap (input.snapshot);
+	close (fd);
+	g_strfreev (input.names);
+}
+
+typedef struct {
+	GList  *all_apps;
+	gchar  *items[N_NAMES];
+	gchar  *expected[N_NAMES];
+} ResolveInput;
+
+static gboolean
+resolve_desktop_op (gpointer data, guint64 i)
+{
+	ResolveInput *input = data;
+	gchar *found;
+	gboolean ret;
+
+	found = blacklist_resolve_desktop (input->all_apps, input->items[i % N_NAMES]);
+	ret = (g_strcmp0 (found, input->expected[i % N_NAMES]) == 0);
+	g_free (found);
+
+	return ret;
+}
+
+static gboolean
+resolve_binary_op (gpointer data, guint64 i)
+{
+	ResolveInput *input = data;
+	gchar *binary;
+
+	binary = blacklist_resolve_binary (input->expected[i % N_NAMES]);
+	g_free (binary);
+
+	return (binary != NULL);
+}
+
+static void
+write_file (const gchar *path, const gchar *contents, gint mode)
+{
+	if (!g_file_set_contents (path, contents, -1, NULL) || g_chmod (path, mode) != 0) {
+		g_printerr ("failed to write %s\n", path);
+		exit (1);
+	}
+}
+
+static gchar *
+desktop_path (const gchar *dir, guint serial)
+{
+	return g_strdup_printf ("%s/applications/bench-%05u.desktop", dir, serial);
+}
+
+/* How the items of a blacklist are matched, see blacklist_resolve_desktop() */
+enum {
+	MATCH_ID,
+	MATCH_NAME,
+	MATCH_LOCALE_NAME,
+	MATCH_NONE
+};
+
+static void
+bench_resolve (guint n_entries)
+{
+	static const gchar *matches[] = { "id", "name", "name-ko", "miss" };
+	guint i, m;
+	gchar *dir, *path, *variant;
+	gchar **names, **names_ko;
+	ResolveInput input;
+
+	dir = g_dir_make_tmp ("bench-primitives-XXXXXX", NULL);
+	if (!dir) {
+		g_printerr ("failed to create a temporary directory\n");
+		exit (1);
+	}
+
+	path = g_build_filename (dir, "applications", NULL);
+	g_mkdir (path, 0755);
+	g_free (path);
+	path = g_build_filename (dir, "bin", NULL);
+	g_mkdir (path, 0755);
+	g_free (path);
+
+	for (i = 0; i < N_BINARIES; i++) {
+		path = g_strdup_printf ("%s/bin/app%02u", dir, i);
+		write_file (path, "#!/bin/sh\n", 0755);
+		g_free (path);
+	}
+
+	names = g_new0 (gchar *, n_entries + 1);
+	names_ko = g_new0 (gchar *, n_entries + 1);
+	for (i = 0; i < n_entries; i++) {
+		gchar *contents;
+
+		names[i] = app_name (words_en, G_N_ELEMENTS (words_en), i);
+		names_ko[i] = app_name (words_ko, G_N_ELEMENTS (words_ko), i);
+		contents = g_strdup_printf ("[Desktop Entry]\nType=Application\n"
+                                    "Name=%s\nName[ko]=%s\nExec=app%02u %%U\n"
+                                    "Icon=application-x-executable\nCategories=Utility;\n",
+                                    names[i], names_ko[i], i % N_BINARIES);
+		path = desktop_path (dir, i);
+		write_file (path, contents, 0644);
+		g_free (path);
+		g_free (contents);
+	}
+
+	/* nothing but the generated tree, with the Korean names in use */
+	g_setenv ("XDG_DATA_DIRS", dir, TRUE);
+	path = g_build_filename (dir, "home", NULL);
+	g_setenv ("XDG_DATA_HOME", path, TRUE);
+	g_free (path);
+	path = g_strdup_printf ("%s/bin:%s", dir, g_getenv ("PATH"));
+	g_setenv ("PATH", path, TRUE);
+	g_free (path);
+	g_setenv ("LANGUAGE", "ko", TRUE);
+
+	input.all_apps = g_app_info_get_all ();
+	if (g_list_length (input.all_apps) != n_entries) {
+		g_printerr ("found %u of %u desktop files\n", g_list_length (input.all_apps), n_entries);
+		exit (1);
+	}
+
+	for (m = MATCH_ID; m <= MATCH_NONE; m++) {
+		for (i = 0; i < N_NAMES; i++) {
+			/* spread over the whole list */
+			guint serial = (i * 7919 + 13) % n_entries;
+
+			switch (m) {
+			case MATCH_ID:
+				input.items[i] = g_strdup_printf ("bench-%05u.desktop", serial);
+				break;
+			case MATCH_NAME:
+				input.items[i] = g_strdup (names[serial]);
+				break;
+			case MATCH_LOCALE_NAME:
+				input.items[i] = g_strdup (names_ko[serial]);
+				break;
+			default:
+				input.items[i] = g_strdup_printf ("존재하지 않는 프로그램 %u", i);
+				break;
+			}
+			input.expected[i] = (m == MATCH_NONE) ? NULL : desktop_path (dir, serial);
+		}
+
+		variant = g_strdup_printf ("%u-%s", n_entries, matches[m]);
+		bench_run ("resolve_desktop", variant, MIN_USEC, resolve_desktop_op, &input);
+		g_free (variant);
+
+		if (m == MATCH_ID) {
+			variant = g_strdup_printf ("%u", n_entries);
+			bench_run ("resolve_binary", variant, MIN_USEC, resolve_binary_op, &input);
+			g_free (variant);
+		}
+
+		for (i = 0; i < N_NAMES; i++) {
+			g_free (input.items[i]);
+			g_free (input.expected[i]);
+		}
+	}
+
+	g_list_free_full (input.all_apps, g_object_unref);
+
+	for (i = 0; i < n_entries; i++) {
+		path = desktop_path (dir, i);
+		g_unlink (path);
+		g_free (path);
+	}
+	for (i = 0; i < N_BINARIES; i++) {
+		path = g_strdup_printf ("%s/bin/app%02u", dir, i);
+		g_unlink (path);
+		g_free (path);
+	}
+	path = g_build_filename (dir, "applications", NULL);
+	g_rmdir (path);
+	g_free (path);
+	path = g_build_filename (dir, "bin", NULL);
+	g_rmdir (path);
+	g_free (path);
+	g_rmdir (dir);
+
+	g_strfreev (names);
+	g_strfreev (names_ko);
+	g_free (dir);
+}
+
+static void
+spawn_resolve (const gchar *self, guint n_entries)
+{
+	gint status;
+	gchar *arg;
+	GError *error = NULL;
+
+	arg = g_strdup_printf ("%u", n_entries);
+	gchar *argv[] = { (gchar *) self, "--desktop-entries", arg, NULL };
+
+	/* the child writes to the same stdout */
+	fflush (stdout);
+	if (!g_spawn_sync (NULL, argv, NULL, G_SPAWN_DEFAULT, NULL, NULL, NULL, NULL, &status, &error) ||
+        !g_spawn_check_exit_status (status, &error)) {
+		g_printerr ("%s: %s\n", self, error->message);
+		exit (1);
+	}
+
+	g_free (arg);
+}
+
+int
+main (int argc, char **argv)
+{
+	static const guint sizes[] = { 10, 500, 5000 };
+	guint i;
+
+	if (argc == 3 && g_str_equal (argv[1], "--desktop-entries")) {
+		words_rand = g_rand_new_with_seed (2019);
+		bench_resolve (atoi (argv[2]));
+		g_rand_free (words_rand);
+		return 0;
+	}
+
+	words_rand = g_rand_new_with_seed (2019);
+
+	bench_strstrcase ("en-hit", words_en, G_N_ELEMENTS (words_en), NULL, TRUE);
+	bench_strstrcase ("en-miss", words_en, G_N_ELEMENTS (words_en), "Spreadsheet", FALSE);
+	bench_strstrcase ("ko-hit", words_ko, G_N_ELEMENTS (words_ko), NULL, TRUE);
+	bench_strstrcase ("ko-miss", words_ko, G_N_ELEMENTS (words_ko), "스프레드시트", FALSE);
+
+	for (i = 0; i < G_N_ELEMENTS (sizes); i++) {
+		gchar *variant = g_strdup_printf ("list-%u", sizes[i]);
+		bench_task_output (variant, "black_list", sizes[i], 0);
+		g_free (variant);
+	}
+	bench_task_output ("list-4mb", "black_list", 500, LARGE_REPLY_SIZE);
+	bench_task_output ("missing-4mb", "screen_time", 500, LARGE_REPLY_SIZE);
+
+	for (i = 0; i < G_N_ELEMENTS (sizes); i++)
+		bench_snapshot (sizes[i]);
+
+	g_rand_free (words_rand);
+
+	spawn_resolve (argv[0], 2000);
+	spawn_resolve (argv[0], 20000);
+
+	return 0;
+}
@@ -0,0 +1,95 @@
+/*
+ * bench-report.c: runs benchmarks and reports their results
+ *
+ * Copyright (C) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <glib.h>
+
+#include "alloc-count.h"
+#include "bench-report.h"
+
+
+void
+bench_report (const gchar *name, const gchar *variant, guint64 ops,
+              gdouble ns_per_op, gdouble allocs_per_op)
+{
+	FILE *fp;
+	const gchar *results;
+	gchar ns[G_ASCII_DTOSTR_BUF_SIZE], allocs[G_ASCII_DTOSTR_BUF_SIZE];
+
+	if (allocs_per_op < 0)
+		g_print ("%-20s %-12s %12.1f ns/op\n", name, variant, ns_per_op);
+	else
+		g_print ("%-20s %-12s %12.1f ns/op %8.2f allocs/op\n", name, variant, ns_per_op, allocs_per_op);
+
+	results = g_getenv ("BENCH_RESULTS");
+	if (!results || !*results)
+		return;
+
+	fp = fopen (results, "a");
+	if (!fp) {
+		g_printerr ("failed to open %s\n", results);
+		exit (1);
+	}
+
+	/* names and variants are plain words, they need no escaping; the
+	 * numbers are written the same whatever the locale is */
+	g_ascii_formatd (ns, sizeof (ns), "%.1f", ns_per_op);
+	g_ascii_formatd (allocs, sizeof (allocs), "%.2f", allocs_per_op);
+	fprintf (fp, "{\"name\": \"%s\", \"variant\": \"%s\", \"ops\": %" G_GUINT64_FORMAT ", "
+                 "\"ns_per_op\": %s, \"allocs_per_op\": %s}\n",
+             name, variant, ops, ns, (allocs_per_op < 0) ? "null" : allocs);
+	fclose (fp);
+}
+
+void
+bench_run (const gchar *name, const gchar *variant, gint64 min_usec,
+           BenchOpFunc func, gpointer data)
+{
+	gint64 begin, elapsed;
+	guint64 i, allocs, ops = 0, batch = 1;
+
+	/* the first call fills caches and checks the result */
+	if (!func (data, 0)) {
+		g_printerr ("%s/%s: wrong result\n", name, variant);
+		exit (1);
+	}
+
+	allocs = alloc_count_get ();
+	begin = g_get_monotonic_time ();
+
+	/* batches grow so that reading the clock does not add up */
+	do {
+		for (i = 0; i < batch; i++) {
+			if (!func (data, ops + i)) {
+				g_printerr ("%s/%s: wrong result\n", name, variant);
+				exit (1);
+			}
+		}
+		ops += batch;
+		batch *= 2;
+		elapsed = g_get_monotonic_time () - begin;
+	} while (elapsed < min_usec);
+
+	allocs = alloc_count_get () - allocs;
+
+	bench_report (name, variant, ops, elapsed * 1000.0 / ops, (gdouble)allocs / ops);
+}
@@ -0,0 +1,50 @@
+/*
+ * bench-report.h: runs benchmarks and reports their results
+ *
+ * Copyright (C) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef BENCH_REPORT_H
+#define BENCH_REPORT_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* One operation on the @i-th input; FALSE if its result was wrong */
+typedef gboolean (*BenchOpFunc) (gpointer data, guint64 i);
+
+/* Results go to stdout and, when $BENCH_RESULTS names a file, are
+ * appended to it as one JSON object per line. A negative @allocs_per_op
+ * means the allocations were not counted. */
+void bench_report (const gchar *name,
+                   const gchar *variant,
+                   guint64      ops,
+                   gdouble      ns_per_op,
+                   gdouble      allocs_per_op);
+
+/* Repeats @func for at least @min_usec and reports the time and heap
+ * allocations per call; exits if a call fails */
+void bench_run    (const gchar *name,
+                   const gchar *variant,
+                   gint64       min_usec,
+                   BenchOpFunc  func,
+                   gpointer     data);
+
+G_END_DECLS
+
+#endif /* BENCH_REPORT_H */
@@ -0,0 +1,356 @@
+/*
+ * bench-signal-path.c: cost of handling agent and GRAC messages
+ *
+ * Copyright (C) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+#include <json-c/json.h>
+
+#include "agent-json.h"
+#include "scratch-arena.h"
+#include "alloc-count.h"
+#include "bench-report.h"
+
+/*
+ * Runs the message handling of gooroom-session-manager the way it was
+ * done before (a copied string, a json-c tree and g_strsplit() per
+ * message) and the way it is done now (borrowed strings, an in place
+ * scan and a scratch arena), and prints the time and the number of heap
+ * allocations per message. The D-Bus and GSettings calls around them are
+ * the same for both and are left out.
+ */
+
+#define ITERATIONS              200000
+
+typedef gboolean (*BenchFunc) (GVariant *parameters);
+
+static ScratchArena *scratch = NULL;
+static guint64       sink = 0;
+
+
+
+static GVariant *
+signal_parameters (const gchar *data)
+{
+	GVariant *v, *ret;
+
+	/* a received message is serialized, like this one */
+	v = g_variant_ref_sink (g_variant_new ("(v)", g_variant_new_string (data)));
+	ret = g_variant_get_normal_form (v);
+	g_variant_unref (v);
+
+	return ret;
+}
+
+static json_object *
+json_get (json_object *root_obj, const char *key)
+{
+	json_object *ret_obj = NULL;
+
+	if (root_obj)
+		json_object_object_get_ex (root_obj, key, &ret_obj);
+
+	return ret_obj;
+}
+
+static const gchar *
+borrow_string (GVariant *parameters, GVariant **holder, gsize *len)
+{
+	GVariant *v;
+
+	g_variant_get_child (parameters, 0, "v", &v);
+	*holder = v;
+
+	return g_variant_get_string (v, len);
+}
+
+static gboolean
+grac_letter_legacy (GVariant *parameters)
+{
+	gboolean ret = FALSE;
+	gchar *data = NULL;
+	GVariant *v = NULL;
+	json_object *root_obj;
+	enum json_tokener_error jerr = json_tokener_success;
+
+	g_variant_get (parameters, "(v)", &v);
+	data = g_variant_dup_string (v, NULL);
+	g_variant_unref (v);
+
+	root_obj = json_tokener_parse_verbose (data, &jerr);
+	if (jerr == json_tokener_success) {
+		const char *title = json_object_get_string (json_get (root_obj, "title"));
+		if (g_strcmp0 (title, "media-control") == 0) {
+			json_object *obj_body = json_get (root_obj, "body");
+			const char *media = json_object_get_string (json_get (obj_body, "media"));
+			const char *control = json_object_get_string (json_get (obj_body, "control"));
+			if (media && control) {
+				sink += strlen (media) + strlen (control);
+				ret = TRUE;
+			}
+		}
+		json_object_put (root_obj);
+	}
+	g_free (data);
+
+	return ret;
+}
+
+static gboolean
+grac_letter_scan (GVariant *parameters)
+{
+	gsize len;
+	gboolean ret = FALSE;
+	GVariant *v;
+	const gchar *data;
+	AgentJsonValue title, media, control;
+
+	data = borrow_string (parameters, &v, &len);
+
+	if (agent_json_lookup (data, len, &title, "title", NULL) &&
+        agent_json_value_equal (&title, "media-control") &&
+        agent_json_lookup (data, len, &media, "body", "media", NULL) &&
+        agent_json_lookup (data, len, &control, "body", "control", NULL)) {
+		sink += strlen (agent_json_value_scratch (&media, scratch));
+		sink += strlen (agent_json_value_scratch (&control, scratch));
+		ret = TRUE;
+	}
+
+	g_variant_unref (v);
+	scratch_arena_reset (scratch);
+
+	return ret;
+}
+
+static gboolean
+blacklist_legacy (GVariant *parameters)
+{
+	gchar **filters;
+	gchar *data = NULL;
+	GVariant *v = NULL;
+
+	g_variant_get (parameters, "(v)", &v);
+	data = g_variant_dup_string (v, NULL);
+	g_variant_unref (v);
+
+	filters = g_strsplit (data, ",", -1);
+	sink += g_strv_length (filters);
+	g_strfreev (filters);
+	g_free (data);
+
+	return TRUE;
+}
+
+static gboolean
+blacklist_scan (GVariant *parameters)
+{
+	gsize len;
+	gchar **filters;
+	GVariant *v;
+	const gchar *data;
+
+	data = borrow_string (parameters, &v, &len);
+
+	filters = scratch_arena_split (scratch, data, len, ',');
+	sink += g_strv_length (filters);
+
+	g_variant_unref (v);
+	scratch_arena_reset (scratch);
+
+	return TRUE;
+}
+
+static gboolean
+agent_reply_legacy (GVariant *parameters)
+{
+	gchar *ret = NULL;
+	gchar *data = NULL;
+	GVariant *v = NULL;
+	json_object *root_obj;
+	enum json_tokener_error jerr = json_tokener_success;
+
+	g_variant_get (parameters, "(v)", &v);
+	data = g_variant_dup_string (v, NULL);
+	g_variant_unref (v);
+
+	root_obj = json_tokener_parse_verbose (data, &jerr);
+	if (jerr == json_tokener_success) {
+		json_object *obj3 = json_get (json_get (json_get (root_obj, "module"), "task"), "out");
+		const char *val = json_object_get_string (json_get (obj3, "status"));
+		if (g_strcmp0 (val, "200") == 0)
+			ret = g_strdup (json_object_get_string (json_get (obj3, "black_list")));
+		json_object_put (root_obj);
+	}
+	g_free (data);
+
+	if (ret)
+		sink += strlen (ret);
+	g_free (ret);
+
+	return (ret != NULL);
+}
+
+static gboolean
+agent_reply_scan (GVariant *parameters)
+{
+	gsize len;
+	gchar *ret = NULL;
+	GVariant *v;
+	const gchar *data;
+	AgentJsonValue value;
+
+	data = borrow_string (parameters, &v, &len);
+
+	if (agent_json_task_output (data, len, "black_list", &value))
+		ret = agent_json_value_dup (&value);
+	g_variant_unref (v);
+
+	if (ret)
+		sink += strlen (ret);
+	g_free (ret);
+
+	return (ret != NULL);
+}
+
+static void
+bench_message (const gchar *name, const gchar *variant, BenchFunc func, GVariant *parameters)
+{
+	guint i;
+	gint64 begin, end;
+	guint64 allocs;
+
+	if (!func (parameters)) {
+		g_printerr ("%s/%s: message not understood\n", name, variant);
+		exit (1);
+	}
+
+	allocs = alloc_count_get ();
+	begin = g_get_monotonic_time ();
+
+	for (i = 0; i < ITERATIONS; i++)
+		func (parameters);
+
+	end = g_get_monotonic_time ();
+	allocs = alloc_count_get () - allocs;
+
+	bench_report (name, variant, ITERATIONS,
+                  (end - begin) * 1000.0 / ITERATIONS, (gdouble)allocs / ITERATIONS);
+}
+
+/* Both ways have to agree on what the messages say */
+static void
+check_values (const gchar *reply)
+{
+	gchar *legacy = NULL;
+	gchar *scanned = NULL;
+	AgentJsonValue value;
+	json_object *root_obj;
+
+	root_obj = json_tokener_parse (reply);
+	legacy = g_strdup (json_object_get_string (json_get (json_get (json_get (json_get (root_obj, "module"), "task"), "out"), "black_list")));
+	json_object_put (root_obj);
+
+	if (agent_json_task_output (reply, -1, "black_list", &value))
+		scanned = agent_json_value_dup (&value);
+
+	if (g_strcmp0 (legacy, scanned) != 0) {
+		g_printerr ("values differ: '%s' != '%s'\n", legacy, scanned);
+		exit (1);
+	}
+
+	g_free (legacy);
+	g_free (scanned);
+}
+
+/* The arena split has to give what g_strsplit() gave, edge cases too */
+static void
+check_split (void)
+{
+	guint i, j;
+	const gchar *cases[] = { "", ",", "a", "a,b", "a,b,", ",a", "a,,b" };
+
+	for (i = 0; i < G_N_ELEMENTS (cases); i++) {
+		gchar **legacy, **scanned;
+
+		legacy = g_strsplit (cases[i], ",", -1);
+		scanned = scratch_arena_split (scratch, cases[i], strlen (cases[i]), ',');
+
+		for (j = 0; legacy[j] && scanned[j]; j++) {
+			if (!g_str_equal (legacy[j], scanned[j]))
+				break;
+		}
+
+		if (legacy[j] || scanned[j]) {
+			g_printerr ("split of '%s' differs at %u\n", cases[i], j);
+			exit (1);
+		}
+
+		g_strfreev (legacy);
+		scratch_arena_reset (scratch);
+	}
+}
+
+int
+main (int argc, char **argv)
+{
+	guint i;
+	GString *list;
+	gchar *reply;
+	GVariant *letter, *blacklist, *agent_reply;
+
+	list = g_string_new (NULL);
+	for (i = 0; i < 40; i++)
+		g_string_append_printf (list, "%sorg.example.Application%u.desktop", i ? "," : "", i);
+	/* the agent escapes everything that is not ASCII */
+	g_string_append (list, ",\\ud55c\\uae00.desktop,\\ud83d\\ude00.desktop");
+
+	reply = g_strdup_printf ("{\"module\": {\"module_name\": \"config\", \"task\": "
+                             "{\"task_name\": \"get_app_list\", \"in\": {\"login_id\": \"user\"}, "
+                             "\"out\": {\"status\": \"200\", \"message\": \"\\\"ok\\\"\", "
+                             "\"black_list\": \"%s\"}}}}", list->str);
+	check_values (reply);
+
+	letter = signal_parameters ("{\"title\": \"media-control\", \"body\": "
+                                "{\"media\": \"microphone\", \"control\": \"disallow\"}}");
+	g_string_truncate (list, list->len - strlen (",\\ud55c\\uae00.desktop,\\ud83d\\ude00.desktop"));
+	blacklist = signal_parameters (list->str);
+	agent_reply = signal_parameters (reply);
+
+	scratch = scratch_arena_new (4096);
+	check_split ();
+
+	bench_message ("grac_letter", "legacy", grac_letter_legacy, letter);
+	bench_message ("grac_letter", "scan", grac_letter_scan, letter);
+	bench_message ("app_black_list", "legacy", blacklist_legacy, blacklist);
+	bench_message ("app_black_list", "scan", blacklist_scan, blacklist);
+	bench_message ("get_app_list", "legacy", agent_reply_legacy, agent_reply);
+	bench_message ("get_app_list", "scan", agent_reply_scan, agent_reply);
+
+	scratch_arena_free (scratch);
+	g_variant_unref (letter);
+	g_variant_unref (blacklist);
+	g_variant_unref (agent_reply);
+	g_string_free (list, TRUE);
+	g_free (reply);
+
+	return (sink == 0);
+}
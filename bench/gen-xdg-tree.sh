@@ -0,0 +1,119 @@
+#!/bin/sh
+#
+# Builds a synthetic XDG data tree for benchmarking the blacklist helper:
+#
+#   bench/gen-xdg-tree.sh [options] DIR
+#
+#   -n N    desktop files (default 2000)
+#   -s PCT  desktop files starting a binary another one starts too (20)
+#   -l PCT  binaries that are symlinks to another binary (10)
+#   -u PCT  desktop files with an unusual Exec line (10)
+#   -k PCT  desktop files with a Korean name (50)
+#   -r SEED seed of the random choices (2019)
+#
+# DIR/share/applications holds the desktop files and DIR/bin the dummy
+# binaries they start, so XDG_DATA_DIRS=DIR/share and PATH=DIR/bin make
+# up the whole world of a helper run. DIR/items lists blacklist entries,
+# desktop ids and names, in random order; a blacklist of B entries is
+# its first B lines.
+#
+# The unusual Exec lines are the ones seen in the field: a program
+# started through env or sh -c, a quoted absolute path and quoted
+# arguments. env and sh are dummies in DIR/bin as well.
+
+N=2000
+SHARED=20
+SYMLINKED=10
+UNUSUAL=10
+KOREAN=50
+SEED=2019
+
+while getopts n:s:l:u:k:r: opt; do
+	case $opt in
+	n) N=$OPTARG ;;
+	s) SHARED=$OPTARG ;;
+	l) SYMLINKED=$OPTARG ;;
+	u) UNUSUAL=$OPTARG ;;
+	k) KOREAN=$OPTARG ;;
+	r) SEED=$OPTARG ;;
+	*) exit 1 ;;
+	esac
+done
+shift $((OPTIND - 1))
+
+if [ $# -ne 1 ]; then
+	echo "usage: $0 [-n N] [-s PCT] [-l PCT] [-u PCT] [-k PCT] [-r SEED] DIR" >&2
+	exit 1
+fi
+
+mkdir -p "$1/share/applications" "$1/bin" "$1/home" || exit 1
+dir=$(cd "$1" && pwd)
+binaries=$(( N * (100 - SHARED) / 100 ))
+[ "$binaries" -gt 0 ] || binaries=1
+symlinks=$(( binaries * SYMLINKED / 100 ))
+
+# the last binaries are symlinks to the first ones
+awk -v binaries="$binaries" -v symlinks="$symlinks" -v dir="$dir" '
+BEGIN {
+	for (i = 0; i < binaries; i++) {
+		if (i < binaries - symlinks) {
+			file = sprintf("%s/bin/app%05d", dir, i)
+			print "#!/bin/sh\nexit 0" > file
+			close(file)
+		} else {
+			printf "app%05d app%05d\n", i % (binaries - symlinks), i
+		}
+	}
+	print "#!/bin/sh\nexit 0" > (dir "/bin/env")
+	print "#!/bin/sh\nexit 0" > (dir "/bin/sh")
+}' | while read -r target link; do
+	ln -sf "$target" "$dir/bin/$link"
+done
+find "$dir/bin" -type f -exec chmod 755 {} +
+
+awk -v n="$N" -v binaries="$binaries" -v unusual="$UNUSUAL" -v korean="$KOREAN" \
+    -v seed="$SEED" -v dir="$dir" '
+BEGIN {
+	split("Web Browser Terminal Document Editor Photo Viewer Calculator Files Manager " \
+	      "Music Player Video Settings Mail Client Office Gooroom Text Image", en, " ")
+	split("웹 브라우저 터미널 문서 편집기 사진 뷰어 계산기 파일 관리자 " \
+	      "음악 재생기 동영상 설정 메일 클라이언트 오피스 구름 텍스트 이미지", ko, " ")
+	srand(seed)
+
+	for (i = 0; i < n; i++) {
+		id = sprintf("bench-%05d.desktop", i)
+		file = dir "/share/applications/" id
+		bin = sprintf("app%05d", (i < binaries) ? i : int(rand() * binaries))
+		name = sprintf("%s %s %05d", en[int(rand() * 20) + 1], en[int(rand() * 20) + 1], i)
+
+		if (rand() * 100 < unusual) {
+			form = i % 4
+			if (form == 0)
+				exec = "env LANG=ko_KR.UTF-8 " bin " %U"
+			else if (form == 1)
+				exec = "\"" dir "/bin/" bin "\" --new-window %u"
+			else if (form == 2)
+				exec = bin " --name \"" name "\" %F"
+			else
+				exec = "sh -c \"" bin " --private\""
+		} else {
+			exec = bin " %U"
+		}
+
+		print "[Desktop Entry]" > file
+		print "Type=Application" > file
+		print "Name=" name > file
+		if (rand() * 100 < korean) {
+			name_ko = sprintf("%s %s %05d", ko[int(rand() * 20) + 1], ko[int(rand() * 20) + 1], i)
+			print "Name[ko]=" name_ko > file
+		}
+		print "Comment=Synthetic application " i > file
+		print "Exec=" exec > file
+		print "Icon=application-x-executable" > file
+		print "Categories=Utility;" > file
+		close(file)
+
+		# one in five blacklist entries is a name rather than an id
+		printf "%.6f\t%s\n", rand(), (i % 5 == 4) ? name : id
+	}
+}' | sort -n | cut -f2 > "$dir/items"
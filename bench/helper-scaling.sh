@@ -0,0 +1,195 @@
+#!/bin/sh
+#
+# Runs gooroom-update-blacklist-helper against synthetic XDG trees of
+# growing size (see gen-xdg-tree.sh) with blacklists of growing length,
+# unprivileged, and records for every run its wall time, the stat, chmod
+# and open calls it made and the desktop files it rewrote:
+#
+#   bench/helper-scaling.sh [-n "2000 5000 20000"] [-b "10 100 1000 5000"]
+#                           [-r RUNS] [-o results.csv] [-p plot.png]
+#                           [-g "generator options"]
+#
+# Three runs are measured for every size: "cold", the first run with no
+# state, "change", a run with half of the blacklist replaced, and
+# "current", the same blacklist again. Wall times are the median of RUNS;
+# the calls are counted in a separate run under strace, when strace is
+# there, and the plot is drawn when gnuplot is. At the end, the growth of
+# every kind of run with the number of desktop files is given as an
+# exponent: below 1 is sub-linear.
+#
+# HELPER is the helper to run.
+
+srcdir=$(dirname "$0")
+HELPER=${HELPER:-$srcdir/../src/gooroom-update-blacklist-helper}
+SIZES="2000 5000 20000"
+BLACKLISTS="10 100 1000 5000"
+RUNS=3
+OUT=helper-scaling.csv
+PLOT=
+GEN_ARGS=
+
+while getopts n:b:r:o:p:g: opt; do
+	case $opt in
+	n) SIZES=$OPTARG ;;
+	b) BLACKLISTS=$OPTARG ;;
+	r) RUNS=$OPTARG ;;
+	o) OUT=$OPTARG ;;
+	p) PLOT=$OPTARG ;;
+	g) GEN_ARGS=$OPTARG ;;
+	*) exit 1 ;;
+	esac
+done
+
+if [ ! -x "$HELPER" ]; then
+	echo "$HELPER is not there, build it first" >&2
+	exit 1
+fi
+HELPER=$(cd "$(dirname "$HELPER")" && pwd)/$(basename "$HELPER")
+STRACE=$(command -v strace)
+
+scratch=$(mktemp -d "${TMPDIR:-/tmp}/helper-scaling.XXXXXX") || exit 1
+trap 'rm -rf "$scratch"' EXIT
+trap 'exit 1' INT TERM
+
+set -f
+
+# the helper sees nothing but the tree
+run_helper () {
+	env -i PATH="$tree/bin" HOME="$tree/home" XDG_DATA_HOME="$tree/home" \
+		XDG_DATA_DIRS="$tree/share" LANGUAGE=ko LANG=C.UTF-8 PKEXEC_UID=1000 \
+		GOOROOM_SESSION_MANAGER_ROOT="$tree/root" $trace "$HELPER" "$@" 2>/dev/null
+}
+
+# lines $1 to $2 of the items, as arguments
+run_items () {
+	old_ifs=$IFS
+	IFS='
+'
+	set -- $(sed -n "$1,$2p" "$tree/items")
+	IFS=$old_ifs
+	run_helper "$@"
+}
+
+# no state and every binary executable again
+reset_tree () {
+	rm -rf "$tree/root"
+	find "$tree/bin" -type f -exec chmod 755 {} +
+}
+
+now_ns () {
+	date +%s%N
+}
+
+# the three kinds of run for a blacklist of $1 entries, under strace if
+# $2 is "count"; prints "kind wall_ms rewritten" lines
+run_sequence () {
+	reset_tree
+	for kind in cold change current; do
+		case $kind in
+		cold) first=1 last=$1 ;;
+		change) first=$(( $1 / 2 + 1 )) last=$(( $1 + $1 / 2 )) ;;
+		esac
+
+		trace=
+		[ "$2" = count ] && trace="$STRACE -f -c -o $scratch/strace-$kind"
+		touch "$scratch/marker"
+		begin=$(now_ns)
+		run_items "$first" "$last"
+		end=$(now_ns)
+
+		rewritten=$(find "$tree/share/applications" -type f -newer "$scratch/marker" | wc -l)
+		echo "$kind $(( (end - begin) / 1000000 )) $rewritten"
+	done
+}
+
+# stat, chmod and open calls of a run, from strace -c
+count_calls () {
+	if [ ! -f "$scratch/strace-$1" ]; then
+		echo "- - -"
+		return
+	fi
+	awk '
+	$NF ~ /^(stat|lstat|fstat|newfstatat|statx|stat64|lstat64|fstat64|fstatat64)$/ { stat += $4 }
+	$NF ~ /^(chmod|fchmod|fchmodat|fchmodat2)$/ { chmod += $4 }
+	$NF ~ /^(open|openat|openat2)$/ { open += $4 }
+	END { printf "%d %d %d\n", stat, chmod, open }' "$scratch/strace-$1"
+}
+
+median () {
+	tr ' ' '\n' | sed '/^$/d' | sort -n | awk '{ v[NR] = $1 } END { print v[int((NR + 1) / 2)] }'
+}
+
+[ -z "$STRACE" ] && echo "strace is not there, calls are not counted" >&2
+
+echo "desktop_files,blacklist,kind,wall_ms,stat,chmod,open,rewritten" > "$OUT"
+printf '%8s %9s %-8s %9s %8s %7s %8s %9s\n' files blacklist kind wall_ms stat chmod open rewritten
+
+for n in $SIZES; do
+	tree=$scratch/tree-$n
+	sh "$srcdir/gen-xdg-tree.sh" -n "$n" $GEN_ARGS "$tree" || exit 1
+
+	for b in $BLACKLISTS; do
+		[ "$b" -gt "$n" ] && continue
+
+		: > "$scratch/walls"
+		i=0
+		while [ "$i" -lt "$RUNS" ]; do
+			run_sequence "$b" >> "$scratch/walls"
+			i=$((i + 1))
+		done
+
+		rm -f "$scratch"/strace-*
+		[ -n "$STRACE" ] && run_sequence "$b" count > /dev/null
+
+		for kind in cold change current; do
+			wall=$(awk -v k="$kind" '$1 == k { printf "%s ", $2 }' "$scratch/walls" | median)
+			rewritten=$(awk -v k="$kind" '$1 == k { print $3; exit }' "$scratch/walls")
+			set -- $(count_calls "$kind")
+
+			printf '%8s %9s %-8s %9s %8s %7s %8s %9s\n' "$n" "$b" "$kind" "$wall" "$1" "$2" "$3" "$rewritten"
+			echo "$n,$b,$kind,$wall,$1,$2,$3,$rewritten" >> "$OUT"
+		done
+	done
+
+	rm -rf "$tree"
+done
+
+echo
+echo "growth with the number of desktop files (wall time ~ files^k):"
+awk -F, '
+NR > 1 {
+	key = $3 " blacklist " $2
+	if (!(key in small) || $1 < small_n[key]) { small[key] = $4; small_n[key] = $1 }
+	if (!(key in large) || $1 > large_n[key]) { large[key] = $4; large_n[key] = $1 }
+}
+END {
+	for (key in small) {
+		if (large_n[key] == small_n[key] || small[key] <= 0 || large[key] <= 0)
+			continue
+		printf "  %-24s k = %.2f\n", key, log(large[key] / small[key]) / log(large_n[key] / small_n[key])
+	}
+}' "$OUT" | sort
+
+if [ -n "$PLOT" ]; then
+	if ! command -v gnuplot > /dev/null; then
+		echo "gnuplot is not there, no plot" >&2
+	else
+		plots=
+		for b in $BLACKLISTS; do
+			awk -F, -v b="$b" '$2 == b && $3 == "cold" { print $1, $4 }' "$OUT" > "$scratch/plot-$b"
+			[ -s "$scratch/plot-$b" ] || continue
+			plots="$plots${plots:+, }'$scratch/plot-$b' with linespoints title 'blacklist $b'"
+		done
+		gnuplot <<PLOT
+set terminal png size 800,600
+set output '$PLOT'
+set logscale xy
+set xlabel 'desktop files'
+set ylabel 'cold run wall time (ms)'
+plot $plots
+PLOT
+		echo "plot written to $PLOT"
+	fi
+fi
+
+echo "results written to $OUT"
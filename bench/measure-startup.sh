@@ -0,0 +1,61 @@
+#!/bin/sh
+#
+# Measures how long gooroom-session-manager takes to own its bus name and
+# how much memory it holds at that point. Run it inside a user session
+# (the manager needs the session bus) with no other instance running:
+#
+#   bench/measure-startup.sh [path/to/gooroom-session-manager] [runs]
+#
+# Prints one line per run and the median startup time.
+
+PROG=${1:-/usr/lib/gooroom-session-manager/gooroom-session-manager}
+RUNS=${2:-10}
+NAME=kr.gooroom.SessionManager
+
+name_owned () {
+	gdbus call --session --dest org.freedesktop.DBus \
+		--object-path /org/freedesktop/DBus \
+		--method org.freedesktop.DBus.NameHasOwner "$NAME" 2>/dev/null | grep -q true
+}
+
+if name_owned; then
+	echo "$NAME is already owned, stop the running session manager first" >&2
+	exit 1
+fi
+
+times=""
+i=0
+while [ "$i" -lt "$RUNS" ]; do
+	begin=$(date +%s%N)
+	"$PROG" &
+	pid=$!
+
+	while ! name_owned; do
+		if ! kill -0 "$pid" 2>/dev/null; then
+			echo "$PROG exited before owning $NAME" >&2
+			exit 1
+		fi
+		sleep 0.005
+	done
+	end=$(date +%s%N)
+
+	ms=$(( (end - begin) / 1000000 ))
+	rss=$(awk '/^VmRSS/ { print $2 }' "/proc/$pid/status")
+	hwm=$(awk '/^VmHWM/ { print $2 }' "/proc/$pid/status")
+	libs=$(awk '$6 ~ /\.so/ { print $6 }' "/proc/$pid/maps" | sort -u | wc -l)
+
+	echo "run $i: ${ms} ms, VmRSS ${rss} kB, VmHWM ${hwm} kB, ${libs} shared objects"
+	times="$times $ms"
+
+	kill -TERM "$pid"
+	wait "$pid" 2>/dev/null
+
+	while name_owned; do
+		sleep 0.01
+	done
+
+	i=$((i + 1))
+done
+
+echo "$times" | tr ' ' '\n' | sed '/^$/d' | sort -n | \
+	awk '{ v[NR] = $1 } END { print "median: " v[int((NR + 1) / 2)] " ms" }'
@@ -0,0 +1,1337 @@
+/*
+ * mock-services.c: the services around the session manager, replaying signals
+ *
+ * Copyright (C) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <glib.h>
+#include <glib-unix.h>
+#include <gio/gio.h>
+#include <gio/gunixfdlist.h>
+
+#include "blacklist-snapshot.h"
+#include "alloc-count.h"
+
+/*
+ * Stands in for the Gooroom agent, the GRAC daemon, systemd, the dockbarx
+ * applet and the notification daemon on a private bus (replay-bench.sh
+ * sets it up), and replays signal streams at the session manager.
+ *
+ * A signal counts as handled when its effect is seen: the item is in a
+ * published blacklist snapshot, a notification carries the message, or
+ * grac-pactl reports the control through the effects FIFO. Every replayed
+ * signal carries its sequence number for that; an effect also accounts
+ * for the earlier signals of the same kind it superseded, and a folded
+ * notification ("N messages") for everything sent before it.
+ *
+ * With --soak, millions of mixed signals and agent restarts are sent
+ * instead, and the memory of the session manager is sampled as it goes:
+ * RSS and its high-water mark from /proc, and the live heap, its peak and
+ * the allocation count from alloc-count.so when that is preloaded into
+ * it. Sending pauses before each sample, so that queues and notification
+ * bursts have drained and only memory that stays is seen. The run fails
+ * if the heap (or, without the counters, RSS) keeps growing after the
+ * warm-up.
+ */
+
+#define AGENT_NAME              "kr.gooroom.agent"
+#define AGENT_PATH              "/kr/gooroom/agent"
+#define GRAC_NAME               "kr.gooroom.GRACDEVD"
+#define GRAC_PATH               "/kr/gooroom/GRACDEVD"
+#define SYSTEMD_NAME            "org.freedesktop.systemd1"
+#define SYSTEMD_PATH            "/org/freedesktop/systemd1"
+#define SYSTEMD_UNIT_PATH       "/org/freedesktop/systemd1/unit/bench"
+#define DOCKBARX_NAME           "kr.gooroom.dockbarx.applet"
+#define DOCKBARX_PATH           "/kr/gooroom/dockbarx/applet"
+#define NOTIFY_NAME             "org.freedesktop.Notifications"
+#define NOTIFY_PATH             "/org/freedesktop/Notifications"
+#define SNAPSHOT_PATH           "/kr/gooroom/SessionManager"
+#define SNAPSHOT_INTERFACE      "kr.gooroom.SessionManager.Blacklist"
+
+#define READY_PROBE_MS          250
+#define PACE_INTERVAL_MS        1
+#define DRAIN_POLL_MS           10
+
+static const gchar introspection_xml[] =
+	"<node>"
+	"  <interface name='" AGENT_NAME "'>"
+	"    <method name='do_task'>"
+	"      <arg type='s' direction='in'/>"
+	"      <arg type='s' direction='out'/>"
+	"    </method>"
+	"  </interface>"
+	"  <interface name='org.freedesktop.systemd1.Manager'>"
+	"    <method name='GetUnit'>"
+	"      <arg type='s' direction='in'/>"
+	"      <arg type='o' direction='out'/>"
+	"    </method>"
+	"  </interface>"
+	"  <interface name='org.freedesktop.systemd1.Unit'>"
+	"    <property name='ActiveState' type='s' access='read'/>"
+	"  </interface>"
+	"  <interface name='" DOCKBARX_NAME "'>"
+	"    <method name='Restart'/>"
+	"  </interface>"
+	"  <interface name='" NOTIFY_NAME "'>"
+	"    <method name='Notify'>"
+	"      <arg type='s' direction='in'/>"
+	"      <arg type='u' direction='in'/>"
+	"      <arg type='s' direction='in'/>"
+	"      <arg type='s' direction='in'/>"
+	"      <arg type='s' direction='in'/>"
+	"      <arg type='as' direction='in'/>"
+	"      <arg type='a{sv}' direction='in'/>"
+	"      <arg type='i' direction='in'/>"
+	"      <arg type='u' direction='out'/>"
+	"    </method>"
+	"    <method name='CloseNotification'>"
+	"      <arg type='u' direction='in'/>"
+	"    </method>"
+	"    <method name='GetCapabilities'>"
+	"      <arg type='as' direction='out'/>"
+	"    </method>"
+	"    <method name='GetServerInformation'>"
+	"      <arg type='s' direction='out'/>"
+	"      <arg type='s' direction='out'/>"
+	"      <arg type='s' direction='out'/>"
+	"      <arg type='s' direction='out'/>"
+	"    </method>"
+	"  </interface>"
+	"</node>";
+
+typedef enum {
+	EFFECT_NONE,
+	EFFECT_SNAPSHOT,
+	EFFECT_NOTIFY,
+	EFFECT_PACTL
+} EffectKind;
+
+typedef struct {
+	const gchar *name;
+	gboolean     grac;
+	EffectKind   effect;
+} SignalKind;
+
+static const SignalKind signal_kinds[] = {
+	{ "app_black_list",      FALSE, EFFECT_SNAPSHOT },
+	{ "controlcenter_items", FALSE, EFFECT_NONE },
+	{ "agent_msg",           FALSE, EFFECT_NOTIFY },
+	{ "dpms_on_x_off",       FALSE, EFFECT_NONE },
+	{ "sleep_time",          FALSE, EFFECT_NONE },
+	{ "grac_letter",         TRUE,  EFFECT_PACTL },
+	{ "grac_noti",           TRUE,  EFFECT_NOTIFY }
+};
+
+#define N_SIGNAL_KINDS G_N_ELEMENTS (signal_kinds)
+
+typedef struct {
+	gint64  offset_us;  /* from the start of the replay */
+	guint   order;      /* position in the input, ties keep it */
+	guint   kind;
+	gchar  *payload;    /* recorded; NULL for a synthetic one */
+	gint64  sent_us;
+	gint64  effect_us;  /* 0 until its effect is seen */
+} ReplayEvent;
+
+static GDBusConnection *g_bus = NULL;
+static GDBusNodeInfo   *g_introspection = NULL;
+static GMainLoop       *g_loop = NULL;
+static gint             g_exit_status = 0;
+
+/* the replay being run; sequence numbers keep growing across the steps
+ * of a throughput run, so that late effects of a step are ignored */
+static GArray  *g_events = NULL;
+static guint    g_seq_base = 0;
+static guint    g_next = 0;
+static gint64   g_start_us = 0;
+static guint    g_credited_to[N_SIGNAL_KINDS];
+
+static struct {
+	guint do_task;
+	guint notify;
+	guint restart;
+	guint snapshot;
+	guint pactl;
+} g_counts;
+
+static gboolean g_ready_agent = FALSE;
+static gboolean g_ready_grac = FALSE;
+static gboolean g_ready_snapshot = FALSE;
+static gboolean g_need_snapshot = FALSE;
+
+static gchar  **g_streams = NULL;
+static gchar   *g_replay_file = NULL;
+static gchar   *g_throughput = NULL;
+static gchar   *g_effects_fifo = NULL;
+static gint     g_ready_timeout_s = 30;
+static gint     g_settle_ms = 1500;
+static gint     g_drain_ms = -1;
+static gint     g_step_ms = 2000;
+static gint     g_rate_start = 50;
+static gint     g_rate_max = 12800;
+
+static GString *g_fifo_buffer = NULL;
+
+/* soak runs */
+typedef struct {
+	guint64          signals;
+	guint64          rss_kb;
+	guint64          hwm_kb;
+	gboolean         has_heap;
+	AllocCountStats  heap;
+} SoakSample;
+
+static gint64   g_soak = 0;
+static gint     g_soak_rate = 2000;
+static gint     g_soak_samples = 40;
+static gint     g_soak_quiet_ms = 1500;
+static gint     g_agent_every = 20000;
+static gint     g_session_manager_pid = 0;
+static gchar   *g_alloc_stats_path = NULL;
+static gint     g_max_heap_growth = 64;
+static gint     g_max_rss_growth = 1024;
+
+static GArray                *g_soak_samples_taken = NULL;
+static const AllocCountStats *g_alloc_stats = NULL;
+static guint64                g_soak_sent = 0;
+static guint64                g_soak_sample_at = 0;
+static guint64                g_soak_origin = 0;
+static gint64                 g_soak_origin_us = 0;
+
+static void replay_next (void);
+
+
+
+static gint
+signal_kind_lookup (const gchar *name)
+{
+	guint i;
+
+	for (i = 0; i < N_SIGNAL_KINDS; i++) {
+		if (g_str_equal (signal_kinds[i].name, name))
+			return i;
+	}
+
+	return -1;
+}
+
+static ReplayEvent *
+event_for_seq (guint64 seq)
+{
+	if (!g_events || seq < g_seq_base || seq - g_seq_base >= g_next)
+		return NULL;
+
+	return &g_array_index (g_events, ReplayEvent, seq - g_seq_base);
+}
+
+/* @seq and the earlier signals of its kind it superseded are handled */
+static void
+credit_through (guint kind, guint64 seq, gint64 now)
+{
+	guint i, last;
+
+	if (!event_for_seq (seq))
+		return;
+
+	last = seq - g_seq_base;
+	for (i = g_credited_to[kind]; i <= last; i++) {
+		ReplayEvent *event = &g_array_index (g_events, ReplayEvent, i);
+		if (event->kind == kind && event->effect_us == 0)
+			event->effect_us = now;
+	}
+
+	if (g_credited_to[kind] <= last)
+		g_credited_to[kind] = last + 1;
+}
+
+static void
+credit_effect (EffectKind effect, guint64 seq, gint64 now)
+{
+	ReplayEvent *event = event_for_seq (seq);
+
+	if (event && signal_kinds[event->kind].effect == effect)
+		credit_through (event->kind, seq, now);
+}
+
+/* an effect that does not say which signal it is for */
+static void
+credit_all (EffectKind effect, gint64 now)
+{
+	guint kind;
+
+	if (g_next == 0)
+		return;
+
+	for (kind = 0; kind < N_SIGNAL_KINDS; kind++) {
+		if (signal_kinds[kind].effect == effect)
+			credit_through (kind, g_seq_base + g_next - 1, now);
+	}
+}
+
+/* "bench-<seq>" somewhere in @text */
+static gboolean
+parse_seq (const gchar *text, const gchar *prefix, guint64 *seq)
+{
+	gchar *end;
+	const gchar *p = strstr (text, prefix);
+
+	if (!p)
+		return FALSE;
+
+	p += strlen (prefix);
+	if (!g_ascii_isdigit (*p))
+		return FALSE;
+
+	*seq = g_ascii_strtoull (p, &end, 10);
+
+	return TRUE;
+}
+
+static gchar *
+event_string (ReplayEvent *event, guint64 seq)
+{
+	gchar *str, **parts;
+	const gchar *name = signal_kinds[event->kind].name;
+
+	if (event->payload) {
+		gchar *seq_str = g_strdup_printf ("%" G_GUINT64_FORMAT, seq);
+
+		parts = g_strsplit (event->payload, "@seq@", -1);
+		str = g_strjoinv (seq_str, parts);
+		g_strfreev (parts);
+		g_free (seq_str);
+
+		return str;
+	}
+
+	if (g_str_equal (name, "app_black_list"))
+		return g_strdup_printf ("bench-app-%" G_GUINT64_FORMAT, seq);
+	if (g_str_equal (name, "controlcenter_items"))
+		return g_strdup_printf ("bench-panel-%" G_GUINT64_FORMAT, seq);
+	if (g_str_equal (name, "grac_letter"))
+		return g_strdup_printf ("{\"title\":\"media-control\",\"body\":"
+                                "{\"media\":\"microphone\",\"control\":\"bench-%" G_GUINT64_FORMAT "\"}}", seq);
+	if (g_str_equal (name, "grac_noti"))
+		return g_strdup_printf ("grac:bench-%" G_GUINT64_FORMAT ":bench", seq);
+
+	return g_strdup_printf ("bench-%" G_GUINT64_FORMAT, seq);
+}
+
+static void
+emit (guint kind, GVariant *parameters)
+{
+	const SignalKind *sk = &signal_kinds[kind];
+
+	g_dbus_connection_emit_signal (g_bus, NULL,
+                                   sk->grac ? GRAC_PATH : AGENT_PATH,
+                                   sk->grac ? GRAC_NAME : AGENT_NAME,
+                                   sk->name, parameters, NULL);
+}
+
+static void
+emit_string (guint kind, const gchar *str)
+{
+	emit (kind, g_variant_new ("(v)", g_variant_new_string (str)));
+}
+
+static void
+event_emit (ReplayEvent *event, guint64 seq)
+{
+	const gchar *name = signal_kinds[event->kind].name;
+
+	if (g_str_equal (name, "dpms_on_x_off") || g_str_equal (name, "sleep_time")) {
+		gint32 value = event->payload ? atoi (event->payload) : 1 + seq % 60;
+		emit (event->kind, g_variant_new ("(i)", value));
+	} else {
+		gchar *str = event_string (event, seq);
+		emit (event->kind, g_variant_new ("(v)", g_variant_new_take_string (str)));
+	}
+}
+
+/* agent, systemd, dockbarx and notification daemon */
+static void
+handle_method_call (GDBusConnection       *connection,
+                    const gchar           *sender,
+                    const gchar           *object_path,
+                    const gchar           *interface_name,
+                    const gchar           *method_name,
+                    GVariant              *parameters,
+                    GDBusMethodInvocation *invocation,
+                    gpointer               user_data)
+{
+	if (g_str_equal (method_name, "do_task")) {
+		const gchar *request, *out;
+		gchar *reply;
+
+		g_counts.do_task++;
+		g_variant_get (parameters, "(&s)", &request);
+
+		if (strstr (request, "\"get_app_list\""))
+			out = ",\"black_list\":\"\"";
+		else if (strstr (request, "\"get_controlcenter_items\""))
+			out = ",\"controlcenter_items\":\"\"";
+		else if (strstr (request, "\"dpms_off_time\""))
+			out = ",\"screen_time\":\"10\"";
+		else if (strstr (request, "\"sleep_inactive_time\""))
+			out = ",\"sleep_inactive_time\":\"10\"";
+		else
+			out = "";
+
+		reply = g_strdup_printf ("{\"module\":{\"task\":{\"out\":{\"status\":\"200\"%s}}}}", out);
+		g_dbus_method_invocation_return_value (invocation, g_variant_new ("(s)", reply));
+		g_free (reply);
+	} else if (g_str_equal (method_name, "GetUnit")) {
+		g_dbus_method_invocation_return_value (invocation, g_variant_new ("(o)", SYSTEMD_UNIT_PATH));
+	} else if (g_str_equal (method_name, "Restart")) {
+		g_counts.restart++;
+		g_dbus_method_invocation_return_value (invocation, NULL);
+	} else if (g_str_equal (method_name, "Notify")) {
+		guint64 seq;
+		const gchar *body;
+		gint64 now = g_get_monotonic_time ();
+
+		g_counts.notify++;
+		g_variant_get_child (parameters, 4, "&s", &body);
+
+		if (strstr (body, "bench-ready-agent"))
+			g_ready_agent = TRUE;
+		else if (strstr (body, "bench-ready-grac"))
+			g_ready_grac = TRUE;
+		else if (parse_seq (body, "bench-", &seq))
+			credit_effect (EFFECT_NOTIFY, seq, now);
+		else
+			credit_all (EFFECT_NOTIFY, now);
+
+		g_dbus_method_invocation_return_value (invocation, g_variant_new ("(u)", g_counts.notify));
+	} else if (g_str_equal (method_name, "CloseNotification")) {
+		g_dbus_method_invocation_return_value (invocation, NULL);
+	} else if (g_str_equal (method_name, "GetCapabilities")) {
+		const gchar *caps[] = { "body", NULL };
+		g_dbus_method_invocation_return_value (invocation, g_variant_new ("(^as)", caps));
+	} else if (g_str_equal (method_name, "GetServerInformation")) {
+		g_dbus_method_invocation_return_value (invocation,
+                                               g_variant_new ("(ssss)", "mock-services", "Gooroom", "1.0", "1.2"));
+	}
+}
+
+static GVariant *
+handle_get_property (GDBusConnection  *connection,
+                     const gchar      *sender,
+                     const gchar      *object_path,
+                     const gchar      *interface_name,
+                     const gchar      *property_name,
+                     GError          **error,
+                     gpointer          user_data)
+{
+	return g_variant_new_string ("active");
+}
+
+static const GDBusInterfaceVTable interface_vtable = {
+	handle_method_call,
+	handle_get_property,
+	NULL
+};
+
+static void
+release_name (const gchar *name)
+{
+	GVariant *ret;
+
+	ret = g_dbus_connection_call_sync (g_bus, "org.freedesktop.DBus", "/org/freedesktop/DBus",
+                                       "org.freedesktop.DBus", "ReleaseName",
+                                       g_variant_new ("(s)", name),
+                                       G_VARIANT_TYPE ("(u)"), G_DBUS_CALL_FLAGS_NONE,
+                                       -1, NULL, NULL);
+	if (ret)
+		g_variant_unref (ret);
+}
+
+static void
+register_object (const gchar *path, const gchar *interface_name)
+{
+	GError *error = NULL;
+	GDBusInterfaceInfo *info;
+
+	info = g_dbus_node_info_lookup_interface (g_introspection, interface_name);
+	if (!g_dbus_connection_register_object (g_bus, path, info, &interface_vtable,
+                                            NULL, NULL, &error)) {
+		g_printerr ("Failed to register %s: %s\n", path, error->message);
+		exit (1);
+	}
+}
+
+static void
+own_name (const gchar *name)
+{
+	GVariant *ret;
+	GError *error = NULL;
+
+	ret = g_dbus_connection_call_sync (g_bus, "org.freedesktop.DBus", "/org/freedesktop/DBus",
+                                       "org.freedesktop.DBus", "RequestName",
+                                       g_variant_new ("(su)", name, 0x4 /* DO_NOT_QUEUE */),
+                                       G_VARIANT_TYPE ("(u)"), G_DBUS_CALL_FLAGS_NONE,
+                                       -1, NULL, &error);
+	if (!ret) {
+		g_printerr ("Failed to own %s: %s\n", name, error->message);
+		exit (1);
+	}
+	g_variant_unref (ret);
+}
+
+/* Which of the blacklist signals sent so far made it into the snapshot;
+ * the newest one wins, it supersedes the others. */
+static void
+snapshot_reply_cb (GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	gint i, fd;
+	guint kind;
+	gint64 changed_us = *(gint64 *)user_data;
+	GVariant *ret;
+	GUnixFDList *fd_list = NULL;
+	BlacklistSnapshot *snapshot;
+	GError *error = NULL;
+
+	g_free (user_data);
+
+	ret = g_dbus_connection_call_with_unix_fd_list_finish (G_DBUS_CONNECTION (source),
+                                                           &fd_list, result, &error);
+	if (!ret) {
+		g_printerr ("GetSnapshot failed: %s\n", error->message);
+		g_error_free (error);
+		return;
+	}
+
+	fd = g_unix_fd_list_get (fd_list, 0, NULL);
+	snapshot = blacklist_snapshot_map (fd, &error);
+	close (fd);
+	g_object_unref (fd_list);
+	g_variant_unref (ret);
+
+	if (!snapshot) {
+		g_printerr ("Bad blacklist snapshot: %s\n", error->message);
+		g_error_free (error);
+		return;
+	}
+
+	if (blacklist_snapshot_has_name (snapshot, "bench-app-ready"))
+		g_ready_snapshot = TRUE;
+
+	kind = signal_kind_lookup ("app_black_list");
+	for (i = (gint) g_next - 1; i >= (gint) g_credited_to[kind]; i--) {
+		ReplayEvent *event = &g_array_index (g_events, ReplayEvent, i);
+		gchar *name;
+		gboolean found;
+
+		if (event->kind != kind)
+			continue;
+
+		name = event_string (event, g_seq_base + i);
+		found = blacklist_snapshot_has_name (snapshot, name);
+		g_free (name);
+
+		if (found) {
+			credit_through (kind, g_seq_base + i, changed_us);
+			break;
+		}
+	}
+
+	blacklist_snapshot_unmap (snapshot);
+}
+
+static void
+snapshot_changed_cb (GDBusConnection *connection,
+                     const gchar     *sender_name,
+                     const gchar     *object_path,
+                     const gchar     *interface_name,
+                     const gchar     *signal_name,
+                     GVariant        *parameters,
+                     gpointer         user_data)
+{
+	gint64 *changed_us = g_new (gint64, 1);
+
+	*changed_us = g_get_monotonic_time ();
+	g_counts.snapshot++;
+
+	g_dbus_connection_call_with_unix_fd_list (connection, sender_name, SNAPSHOT_PATH,
+                                              SNAPSHOT_INTERFACE, "GetSnapshot", NULL,
+                                              G_VARIANT_TYPE ("(ht)"), G_DBUS_CALL_FLAGS_NONE,
+                                              -1, NULL, NULL, snapshot_reply_cb, changed_us);
+}
+
+/* grac-pactl of replay-bench.sh writes the control it was run with */
+static gboolean
+fifo_readable_cb (gint fd, GIOCondition condition, gpointer data)
+{
+	gchar buf[4096];
+	gssize n;
+	gchar *line;
+	gint64 now = g_get_monotonic_time ();
+
+	while ((n = read (fd, buf, sizeof (buf))) > 0)
+		g_string_append_len (g_fifo_buffer, buf, n);
+
+	while ((line = memchr (g_fifo_buffer->str, '\n', g_fifo_buffer->len))) {
+		guint64 seq;
+
+		*line = '\0';
+		g_counts.pactl++;
+		if (parse_seq (g_fifo_buffer->str, "bench-", &seq))
+			credit_effect (EFFECT_PACTL, seq, now);
+		g_string_erase (g_fifo_buffer, 0, line - g_fifo_buffer->str + 1);
+	}
+
+	return G_SOURCE_CONTINUE;
+}
+
+static void
+fifo_open (void)
+{
+	gint fd;
+
+	if (!g_effects_fifo)
+		return;
+
+	fd = open (g_effects_fifo, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0) {
+		g_printerr ("Failed to open %s: %s\n", g_effects_fifo, g_strerror (errno));
+		exit (1);
+	}
+
+	/* a writer of our own, so that the FIFO never reports end of file */
+	if (open (g_effects_fifo, O_WRONLY | O_CLOEXEC) < 0) {
+		g_printerr ("Failed to open %s: %s\n", g_effects_fifo, g_strerror (errno));
+		exit (1);
+	}
+
+	g_fifo_buffer = g_string_new (NULL);
+	g_unix_fd_add (fd, G_IO_IN, fifo_readable_cb, NULL);
+}
+
+static gint
+event_compare (gconstpointer a, gconstpointer b)
+{
+	const ReplayEvent *ea = a, *eb = b;
+
+	if (ea->offset_us != eb->offset_us)
+		return ea->offset_us < eb->offset_us ? -1 : 1;
+
+	return ea->order < eb->order ? -1 : ea->order > eb->order;
+}
+
+static void
+events_free (void)
+{
+	guint i;
+
+	if (!g_events)
+		return;
+
+	for (i = 0; i < g_events->len; i++)
+		g_free (g_array_index (g_events, ReplayEvent, i).payload);
+	g_array_free (g_events, TRUE);
+	g_events = NULL;
+}
+
+/* NAME:RATE:COUNT, RATE per second */
+static gboolean
+events_add_stream (const gchar *spec)
+{
+	guint i;
+	gint kind;
+	gdouble rate;
+	guint64 count;
+	gchar **parts = g_strsplit (spec, ":", -1);
+
+	if (g_strv_length (parts) != 3 || (kind = signal_kind_lookup (parts[0])) < 0 ||
+        (rate = g_ascii_strtod (parts[1], NULL)) <= 0 ||
+        (count = g_ascii_strtoull (parts[2], NULL, 10)) == 0) {
+		g_printerr ("Bad stream '%s', expected NAME:RATE:COUNT\n", spec);
+		g_strfreev (parts);
+		return FALSE;
+	}
+
+	if (signal_kinds[kind].effect == EFFECT_SNAPSHOT)
+		g_need_snapshot = TRUE;
+
+	for (i = 0; i < count; i++) {
+		ReplayEvent event = { 0, };
+
+		event.offset_us = (gint64) (i * (gdouble) G_USEC_PER_SEC / rate);
+		event.order = g_events->len;
+		event.kind = kind;
+		g_array_append_val (g_events, event);
+	}
+
+	g_strfreev (parts);
+
+	return TRUE;
+}
+
+/* Lines of "<ms> <signal> [payload]"; "@seq@" in a payload becomes the
+ * sequence number, so that its effect can be told apart. */
+static gboolean
+events_add_file (const gchar *path)
+{
+	guint i;
+	gchar *contents, **lines;
+	GError *error = NULL;
+
+	if (!g_file_get_contents (path, &contents, NULL, &error)) {
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		return FALSE;
+	}
+
+	lines = g_strsplit (contents, "\n", -1);
+	g_free (contents);
+
+	for (i = 0; lines[i]; i++) {
+		gint kind;
+		gchar **fields;
+		ReplayEvent event = { 0, };
+
+		g_strstrip (lines[i]);
+		if (lines[i][0] == '\0' || lines[i][0] == '#')
+			continue;
+
+		fields = g_strsplit_set (lines[i], " \t", 3);
+		if (!fields[0] || !fields[1] || (kind = signal_kind_lookup (fields[1])) < 0) {
+			g_printerr ("%s:%u: not understood\n", path, i + 1);
+			g_strfreev (fields);
+			g_strfreev (lines);
+			return FALSE;
+		}
+
+		if (signal_kinds[kind].effect == EFFECT_SNAPSHOT)
+			g_need_snapshot = TRUE;
+
+		event.offset_us = g_ascii_strtoll (fields[0], NULL, 10) * 1000;
+		event.order = g_events->len;
+		event.kind = kind;
+		event.payload = fields[2] ? g_strdup (fields[2]) : NULL;
+		g_array_append_val (g_events, event);
+
+		g_strfreev (fields);
+	}
+
+	g_strfreev (lines);
+
+	return TRUE;
+}
+
+static void
+events_reset (void)
+{
+	if (g_events)
+		g_seq_base += g_events->len;
+
+	events_free ();
+	g_events = g_array_new (FALSE, FALSE, sizeof (ReplayEvent));
+	memset (g_credited_to, 0, sizeof (g_credited_to));
+	g_next = 0;
+}
+
+static gint
+double_compare (gconstpointer a, gconstpointer b)
+{
+	gdouble da = *(const gdouble *)a, db = *(const gdouble *)b;
+
+	return da < db ? -1 : da > db;
+}
+
+static gdouble
+percentile (GArray *sorted, gdouble p)
+{
+	guint rank;
+
+	if (sorted->len == 0)
+		return 0;
+
+	rank = (guint) (p * sorted->len + 0.999999);
+	rank = CLAMP (rank, 1, sorted->len);
+
+	return g_array_index (sorted, gdouble, rank - 1);
+}
+
+/* Returns whether every signal with a visible effect was handled */
+static gboolean
+report (gboolean quiet, gdouble *p99_ms)
+{
+	guint kind, i;
+	gboolean complete = TRUE;
+
+	if (p99_ms)
+		*p99_ms = 0;
+
+	for (kind = 0; kind < N_SIGNAL_KINDS; kind++) {
+		guint sent = 0, missed = 0;
+		GArray *latencies = g_array_new (FALSE, FALSE, sizeof (gdouble));
+
+		for (i = 0; i < g_next; i++) {
+			ReplayEvent *event = &g_array_index (g_events, ReplayEvent, i);
+
+			if (event->kind != kind)
+				continue;
+
+			sent++;
+			if (event->effect_us) {
+				gdouble ms = (event->effect_us - event->sent_us) / 1000.0;
+				g_array_append_val (latencies, ms);
+			} else {
+				missed++;
+			}
+		}
+
+		if (sent > 0 && signal_kinds[kind].effect != EFFECT_NONE) {
+			g_array_sort (latencies, double_compare);
+			if (missed > 0)
+				complete = FALSE;
+			if (p99_ms)
+				*p99_ms = MAX (*p99_ms, percentile (latencies, 0.99));
+			if (!quiet)
+				g_print ("%-20s %6u sent %6u missed  p50 %8.2f  p90 %8.2f  p99 %8.2f  max %8.2f ms\n",
+                         signal_kinds[kind].name, sent, missed,
+                         percentile (latencies, 0.50), percentile (latencies, 0.90),
+                         percentile (latencies, 0.99), percentile (latencies, 1.0));
+		} else if (sent > 0 && !quiet) {
+			g_print ("%-20s %6u sent  (no visible effect, load only)\n", signal_kinds[kind].name, sent);
+		}
+
+		g_array_free (latencies, TRUE);
+	}
+
+	return complete;
+}
+
+static gboolean
+replay_complete (void)
+{
+	guint i;
+
+	for (i = 0; i < g_next; i++) {
+		ReplayEvent *event = &g_array_index (g_events, ReplayEvent, i);
+		if (event->effect_us == 0 && signal_kinds[event->kind].effect != EFFECT_NONE)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* throughput runs: the rate of the current step */
+static gint     g_rate = 0;
+static gint     g_sustained_rate = 0;
+static gint64   g_drain_deadline_us = 0;
+
+static gboolean
+drain_cb (gpointer data)
+{
+	gboolean complete = replay_complete ();
+
+	if (!complete && g_get_monotonic_time () < g_drain_deadline_us)
+		return G_SOURCE_CONTINUE;
+
+	if (g_throughput) {
+		gdouble p99;
+		gdouble elapsed_s = (g_array_index (g_events, ReplayEvent, g_next - 1).sent_us - g_start_us) / (gdouble) G_USEC_PER_SEC;
+
+		complete = report (TRUE, &p99);
+		g_print ("%-20s %6d/s offered %8.0f/s sent  p99 %8.2f ms  %s\n", g_throughput, g_rate,
+                 elapsed_s > 0 ? g_next / elapsed_s : 0, p99, complete ? "kept up" : "fell behind");
+
+		if (complete) {
+			g_sustained_rate = g_rate;
+			if (g_rate * 2 <= g_rate_max) {
+				g_rate *= 2;
+				replay_next ();
+				return G_SOURCE_REMOVE;
+			}
+		}
+
+		g_print ("%-20s sustained %d signals/s\n", g_throughput, g_sustained_rate);
+	} else {
+		gdouble elapsed_s = (g_get_monotonic_time () - g_start_us) / (gdouble) G_USEC_PER_SEC;
+
+		report (FALSE, NULL);
+		g_print ("%u signals in %.2f s, %u agent calls, %u notifications, %u snapshots, "
+                 "%u grac-pactl runs, %u dockbarx restarts\n",
+                 g_next, elapsed_s, g_counts.do_task, g_counts.notify, g_counts.snapshot,
+                 g_counts.pactl, g_counts.restart);
+		if (!complete)
+			g_exit_status = 1;
+	}
+
+	g_main_loop_quit (g_loop);
+
+	return G_SOURCE_REMOVE;
+}
+
+static gboolean
+pace_cb (gpointer data)
+{
+	gint64 now = g_get_monotonic_time ();
+
+	while (g_next < g_events->len) {
+		ReplayEvent *event = &g_array_index (g_events, ReplayEvent, g_next);
+
+		if (g_start_us + event->offset_us > now)
+			return G_SOURCE_CONTINUE;
+
+		event->sent_us = g_get_monotonic_time ();
+		g_next++;
+		event_emit (event, g_seq_base + g_next - 1);
+	}
+
+	g_drain_deadline_us = g_get_monotonic_time () + (gint64) g_drain_ms * 1000;
+	g_timeout_add (DRAIN_POLL_MS, drain_cb, NULL);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+replay_next (void)
+{
+	events_reset ();
+
+	if (g_throughput) {
+		gchar *spec = g_strdup_printf ("%s:%d:%d", g_throughput, g_rate,
+                                       MAX (1, g_rate * g_step_ms / 1000));
+		events_add_stream (spec);
+		g_free (spec);
+	} else {
+		guint i;
+		gboolean ok = TRUE;
+
+		for (i = 0; ok && g_streams && g_streams[i]; i++)
+			ok = events_add_stream (g_streams[i]);
+		if (ok && g_replay_file)
+			ok = events_add_file (g_replay_file);
+
+		if (!ok) {
+			g_exit_status = 1;
+			g_main_loop_quit (g_loop);
+			return;
+		}
+	}
+
+	g_array_sort (g_events, event_compare);
+
+	g_start_us = g_get_monotonic_time ();
+	g_timeout_add (PACE_INTERVAL_MS, pace_cb, NULL);
+}
+
+static void soak_start (void);
+
+static gboolean
+settled_cb (gpointer data)
+{
+	if (g_soak > 0)
+		soak_start ();
+	else
+		replay_next ();
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Until the session manager shows that it handles both senders' signals
+ * (and applies blacklists, if those are replayed) */
+static gboolean
+ready_probe_cb (gpointer data)
+{
+	static gint64 deadline_us = 0;
+
+	if (deadline_us == 0)
+		deadline_us = g_get_monotonic_time () + (gint64) g_ready_timeout_s * G_USEC_PER_SEC;
+
+	if (g_ready_agent && g_ready_grac && (g_ready_snapshot || !g_need_snapshot)) {
+		/* folded probe notifications must not count for the replay */
+		g_timeout_add (g_settle_ms, settled_cb, NULL);
+		return G_SOURCE_REMOVE;
+	}
+
+	if (g_get_monotonic_time () > deadline_us) {
+		g_printerr ("The session manager did not get ready within %d s\n", g_ready_timeout_s);
+		g_exit_status = 1;
+		g_main_loop_quit (g_loop);
+		return G_SOURCE_REMOVE;
+	}
+
+	if (!g_ready_agent)
+		emit_string (signal_kind_lookup ("agent_msg"), "bench-ready-agent");
+	if (!g_ready_grac)
+		emit_string (signal_kind_lookup ("grac_noti"), "grac:bench-ready-grac:bench");
+	if (g_need_snapshot && !g_ready_snapshot)
+		emit_string (signal_kind_lookup ("app_black_list"), "bench-app-ready");
+
+	return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+soak_read_status (SoakSample *sample)
+{
+	gchar *path, *contents, **lines;
+	guint i;
+
+	path = g_strdup_printf ("/proc/%d/status", g_session_manager_pid);
+	if (!g_file_get_contents (path, &contents, NULL, NULL)) {
+		g_free (path);
+		return FALSE;
+	}
+	g_free (path);
+
+	lines = g_strsplit (contents, "\n", -1);
+	for (i = 0; lines[i]; i++) {
+		if (g_str_has_prefix (lines[i], "VmRSS:"))
+			sample->rss_kb = g_ascii_strtoull (lines[i] + 6, NULL, 10);
+		else if (g_str_has_prefix (lines[i], "VmHWM:"))
+			sample->hwm_kb = g_ascii_strtoull (lines[i] + 6, NULL, 10);
+	}
+	g_strfreev (lines);
+	g_free (contents);
+
+	return TRUE;
+}
+
+static void
+soak_map_alloc_stats (void)
+{
+	gint fd;
+	gpointer map;
+
+	if (g_alloc_stats || !g_alloc_stats_path)
+		return;
+
+	fd = open (g_alloc_stats_path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return;
+
+	map = mmap (NULL, sizeof (AllocCountStats), PROT_READ, MAP_SHARED, fd, 0);
+	if (map != MAP_FAILED)
+		g_alloc_stats = map;
+	close (fd);
+}
+
+static gdouble
+sample_heap (const SoakSample *sample)
+{
+	return sample->heap.live_bytes;
+}
+
+static gdouble
+sample_rss (const SoakSample *sample)
+{
+	return sample->rss_kb;
+}
+
+/* least squares, per signal */
+static gdouble
+soak_slope (guint from, gdouble (*value) (const SoakSample *))
+{
+	guint i, n = 0;
+	gdouble sx = 0, sy = 0, sxx = 0, sxy = 0, d;
+
+	for (i = from; i < g_soak_samples_taken->len; i++) {
+		const SoakSample *sample = &g_array_index (g_soak_samples_taken, SoakSample, i);
+		gdouble x = sample->signals, y = value (sample);
+
+		sx += x;
+		sy += y;
+		sxx += x * x;
+		sxy += x * y;
+		n++;
+	}
+
+	d = n * sxx - sx * sx;
+
+	return (n < 2 || d == 0) ? 0 : (n * sxy - sx * sy) / d;
+}
+
+static void
+soak_verdict (void)
+{
+	guint from;
+	gdouble rss_growth;
+	const SoakSample *first, *last;
+
+	/* the first fifth fills caches, pools and the like */
+	from = MAX (2, g_soak_samples_taken->len / 5);
+	if (from + 2 > g_soak_samples_taken->len) {
+		g_print ("too few samples for a verdict\n");
+		return;
+	}
+
+	first = &g_array_index (g_soak_samples_taken, SoakSample, from);
+	last = &g_array_index (g_soak_samples_taken, SoakSample, g_soak_samples_taken->len - 1);
+
+	rss_growth = soak_slope (from, sample_rss) * 1000000;
+	g_print ("rss grows %.1f kB per million signals (limit %d)\n", rss_growth, g_max_rss_growth);
+
+	if (last->has_heap && first->has_heap) {
+		gdouble heap_growth = soak_slope (from, sample_heap) * 1000;
+
+		g_print ("heap grows %.1f bytes per 1000 signals (limit %d), peak %.1f kB\n",
+                 heap_growth, g_max_heap_growth, last->heap.peak_bytes / 1024.0);
+		if (last->signals > first->signals)
+			g_print ("%.2f allocations per signal\n",
+                     (gdouble) (last->heap.allocs - first->heap.allocs) / (last->signals - first->signals));
+
+		if (heap_growth > g_max_heap_growth) {
+			g_print ("FAIL: the heap grows without bound\n");
+			g_exit_status = 1;
+		}
+	} else if (rss_growth > g_max_rss_growth) {
+		g_print ("FAIL: RSS grows without bound\n");
+		g_exit_status = 1;
+	}
+}
+
+static gboolean soak_send_cb (gpointer data);
+
+static gboolean
+soak_sample_cb (gpointer data)
+{
+	SoakSample sample = { 0, };
+
+	sample.signals = g_soak_sent;
+	if (!soak_read_status (&sample)) {
+		g_printerr ("The session manager exited after %" G_GUINT64_FORMAT " signals\n", g_soak_sent);
+		g_exit_status = 1;
+		g_main_loop_quit (g_loop);
+		return G_SOURCE_REMOVE;
+	}
+
+	soak_map_alloc_stats ();
+	if (g_alloc_stats) {
+		sample.has_heap = TRUE;
+		sample.heap = *g_alloc_stats;
+	}
+
+	g_array_append_val (g_soak_samples_taken, sample);
+
+	g_print ("%10" G_GUINT64_FORMAT " signals  rss %7" G_GUINT64_FORMAT " kB  hwm %7" G_GUINT64_FORMAT " kB",
+             sample.signals, sample.rss_kb, sample.hwm_kb);
+	if (sample.has_heap)
+		g_print ("  heap %9.1f kB  peak %9.1f kB  %12" G_GUINT64_FORMAT " allocs",
+                 sample.heap.live_bytes / 1024.0, sample.heap.peak_bytes / 1024.0, sample.heap.allocs);
+	g_print ("\n");
+
+	if (g_soak_sent >= (guint64) g_soak) {
+		soak_verdict ();
+		g_main_loop_quit (g_loop);
+		return G_SOURCE_REMOVE;
+	}
+
+	g_soak_sample_at = MIN ((guint64) g_soak, g_soak_sent + MAX (1, g_soak / g_soak_samples));
+	g_soak_origin = g_soak_sent;
+	g_soak_origin_us = g_get_monotonic_time ();
+	g_timeout_add (PACE_INTERVAL_MS, soak_send_cb, NULL);
+
+	return G_SOURCE_REMOVE;
+}
+
+/* every kind the session manager subscribes to, blacklists (which run
+ * the helper) less often */
+static void
+soak_emit (guint64 n)
+{
+	static const gchar *mix[] = {
+		"agent_msg", "grac_noti", "grac_letter", "dpms_on_x_off", "sleep_time", "controlcenter_items"
+	};
+	ReplayEvent event = { 0, };
+
+	if (n % 64 == 63)
+		event.kind = signal_kind_lookup ("app_black_list");
+	else
+		event.kind = signal_kind_lookup (mix[n % G_N_ELEMENTS (mix)]);
+
+	event_emit (&event, n);
+
+	/* the agent restarts, the session manager resyncs */
+	if (g_agent_every > 0 && n % g_agent_every == (guint64) g_agent_every - 1) {
+		release_name (AGENT_NAME);
+		own_name (AGENT_NAME);
+	}
+}
+
+static gboolean
+soak_send_cb (gpointer data)
+{
+	guint64 due;
+	guint batch = 0;
+
+	due = g_soak_origin + (g_get_monotonic_time () - g_soak_origin_us) * g_soak_rate / G_USEC_PER_SEC;
+	due = MIN (due, g_soak_sample_at);
+
+	while (g_soak_sent < due && batch++ < 1000)
+		soak_emit (g_soak_sent++);
+
+	if (g_soak_sent < g_soak_sample_at)
+		return G_SOURCE_CONTINUE;
+
+	g_timeout_add (g_soak_quiet_ms, soak_sample_cb, NULL);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+soak_start (void)
+{
+	if (!g_session_manager_pid) {
+		g_printerr ("--soak needs --session-manager-pid\n");
+		g_exit_status = 2;
+		g_main_loop_quit (g_loop);
+		return;
+	}
+
+	g_soak_samples_taken = g_array_new (FALSE, TRUE, sizeof (SoakSample));
+
+	/* the baseline, before the first signal */
+	g_soak_sent = 0;
+	soak_sample_cb (NULL);
+}
+
+int
+main (int argc, char **argv)
+{
+	GError *error = NULL;
+	GOptionContext *context;
+	const GOptionEntry entries[] = {
+		{ "stream", 's', 0, G_OPTION_ARG_STRING_ARRAY, &g_streams,
+		  "Replay a synthetic stream", "NAME:RATE:COUNT" },
+		{ "replay", 'r', 0, G_OPTION_ARG_FILENAME, &g_replay_file,
+		  "Replay a recorded stream", "FILE" },
+		{ "throughput", 't', 0, G_OPTION_ARG_STRING, &g_throughput,
+		  "Find the highest rate of a signal that is kept up with", "NAME" },
+		{ "effects-fifo", 0, 0, G_OPTION_ARG_FILENAME, &g_effects_fifo,
+		  "FIFO grac-pactl reports to", "PATH" },
+		{ "ready-timeout", 0, 0, G_OPTION_ARG_INT, &g_ready_timeout_s,
+		  "Seconds to wait for the session manager", "S" },
+		{ "drain", 0, 0, G_OPTION_ARG_INT, &g_drain_ms,
+		  "Milliseconds to wait for effects after the last signal", "MS" },
+		{ "step", 0, 0, G_OPTION_ARG_INT, &g_step_ms,
+		  "Milliseconds per rate of a throughput run", "MS" },
+		{ "rate-start", 0, 0, G_OPTION_ARG_INT, &g_rate_start,
+		  "First rate of a throughput run", "N" },
+		{ "rate-max", 0, 0, G_OPTION_ARG_INT, &g_rate_max,
+		  "Last rate of a throughput run", "N" },
+		{ "soak", 0, 0, G_OPTION_ARG_INT64, &g_soak,
+		  "Send this many mixed signals and watch memory", "N" },
+		{ "soak-rate", 0, 0, G_OPTION_ARG_INT, &g_soak_rate,
+		  "Signals per second of a soak run", "N" },
+		{ "samples", 0, 0, G_OPTION_ARG_INT, &g_soak_samples,
+		  "Memory samples of a soak run", "N" },
+		{ "quiet", 0, 0, G_OPTION_ARG_INT, &g_soak_quiet_ms,
+		  "Milliseconds without signals before a sample", "MS" },
+		{ "agent-every", 0, 0, G_OPTION_ARG_INT, &g_agent_every,
+		  "Restart the agent every N signals of a soak run, 0 never", "N" },
+		{ "session-manager-pid", 0, 0, G_OPTION_ARG_INT, &g_session_manager_pid,
+		  "Process to sample", "PID" },
+		{ "alloc-stats", 0, 0, G_OPTION_ARG_FILENAME, &g_alloc_stats_path,
+		  "Counters of alloc-count.so preloaded into it", "PATH" },
+		{ "max-heap-growth", 0, 0, G_OPTION_ARG_INT, &g_max_heap_growth,
+		  "Bytes of heap growth per 1000 signals that fail a soak run", "N" },
+		{ "max-rss-growth", 0, 0, G_OPTION_ARG_INT, &g_max_rss_growth,
+		  "kB of RSS growth per million signals that fail a soak run", "N" },
+		{ NULL }
+	};
+
+	context = g_option_context_new ("- replay signals at gooroom-session-manager");
+	g_option_context_add_main_entries (context, entries, NULL);
+	if (!g_option_context_parse (context, &argc, &argv, &error)) {
+		g_printerr ("%s\n", error->message);
+		return 2;
+	}
+	g_option_context_free (context);
+
+	if (g_soak > 0) {
+		g_need_snapshot = TRUE;
+		g_soak_samples = MAX (g_soak_samples, 1);
+	} else if (g_throughput) {
+		gint kind = signal_kind_lookup (g_throughput);
+
+		if (kind < 0 || signal_kinds[kind].effect == EFFECT_NONE) {
+			g_printerr ("%s has no visible effect to measure throughput with\n", g_throughput);
+			return 2;
+		}
+		if (signal_kinds[kind].effect == EFFECT_SNAPSHOT)
+			g_need_snapshot = TRUE;
+		g_rate = g_rate_start;
+	} else if (!g_streams && !g_replay_file) {
+		static gchar *default_streams[] = {
+			"agent_msg:20:200", "grac_noti:20:200", "grac_letter:200:2000",
+			"app_black_list:10:100", "dpms_on_x_off:20:200", NULL
+		};
+		g_streams = g_strdupv (default_streams);
+		g_need_snapshot = TRUE;
+	} else {
+		guint i;
+		for (i = 0; g_streams && g_streams[i]; i++) {
+			if (g_str_has_prefix (g_streams[i], "app_black_list:"))
+				g_need_snapshot = TRUE;
+		}
+	}
+
+	/* longer than a notification burst window, shorter than a step */
+	if (g_drain_ms < 0)
+		g_drain_ms = g_throughput ? 2500 : 5000;
+
+	g_bus = g_bus_get_sync (G_BUS_TYPE_SESSION, NULL, &error);
+	if (!g_bus) {
+		g_printerr ("%s\n", error->message);
+		return 1;
+	}
+
+	g_introspection = g_dbus_node_info_new_for_xml (introspection_xml, NULL);
+	register_object (AGENT_PATH, AGENT_NAME);
+	register_object (SYSTEMD_PATH, "org.freedesktop.systemd1.Manager");
+	register_object (SYSTEMD_UNIT_PATH, "org.freedesktop.systemd1.Unit");
+	register_object (DOCKBARX_PATH, DOCKBARX_NAME);
+	register_object (NOTIFY_PATH, NOTIFY_NAME);
+
+	g_dbus_connection_signal_subscribe (g_bus, NULL, SNAPSHOT_INTERFACE, "SnapshotChanged",
+                                        SNAPSHOT_PATH, NULL, G_DBUS_SIGNAL_FLAGS_NONE,
+                                        snapshot_changed_cb, NULL, NULL);
+
+	own_name (AGENT_NAME);
+	own_name (GRAC_NAME);
+	own_name (SYSTEMD_NAME);
+	own_name (DOCKBARX_NAME);
+	own_name (NOTIFY_NAME);
+
+	fifo_open ();
+
+	g_loop = g_main_loop_new (NULL, FALSE);
+	g_timeout_add (READY_PROBE_MS, ready_probe_cb, NULL);
+	g_main_loop_run (g_loop);
+
+	events_free ();
+	if (g_soak_samples_taken)
+		g_array_free (g_soak_samples_taken, TRUE);
+	if (g_alloc_stats)
+		munmap ((gpointer) g_alloc_stats, sizeof (AllocCountStats));
+	g_dbus_node_info_unref (g_introspection);
+	g_object_unref (g_bus);
+	g_main_loop_unref (g_loop);
+
+	return g_exit_status;
+}
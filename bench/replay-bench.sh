@@ -0,0 +1,109 @@
+#!/bin/sh
+#
+# Runs gooroom-session-manager against mock-services on a private bus,
+# with everything it reads or runs below a scratch root, and replays
+# signal streams at it. No agent, GRAC daemon, systemd, dockbarx or root
+# is needed. Arguments go to mock-services, e.g.
+#
+#   bench/replay-bench.sh --stream grac_letter:500:5000 --stream agent_msg:20:200
+#   bench/replay-bench.sh --replay recorded.txt
+#   bench/replay-bench.sh --throughput grac_letter
+#
+#   ALLOC_PRELOAD=bench/.libs/alloc-count.so bench/replay-bench.sh --soak 1000000
+#
+# SESSION_MANAGER and MOCK_SERVICES are the binaries to run; PKGLIBEXECDIR
+# is where the session manager was built to find its helpers. With
+# ALLOC_PRELOAD, the session manager runs with that allocation counter
+# preloaded, for soak runs to sample its heap.
+
+srcdir=$(dirname "$0")
+SESSION_MANAGER=${SESSION_MANAGER:-$srcdir/../src/gooroom-session-manager}
+MOCK_SERVICES=${MOCK_SERVICES:-$srcdir/mock-services}
+PKGLIBEXECDIR=${PKGLIBEXECDIR:-/usr/lib/gooroom-session-manager}
+
+root=$(mktemp -d "${TMPDIR:-/tmp}/replay-bench.XXXXXX") || exit 1
+bus_pid=
+sm_pid=
+
+cleanup () {
+	[ -n "$sm_pid" ] && kill "$sm_pid" 2>/dev/null && wait "$sm_pid" 2>/dev/null
+	[ -n "$bus_pid" ] && kill "$bus_pid" 2>/dev/null
+	rm -rf "$root"
+}
+trap cleanup EXIT
+trap 'exit 1' INT TERM
+
+script () {
+	printf '#!/bin/sh\n%s\n' "$2" > "$1"
+	chmod +x "$1"
+}
+
+mkdir -p "$root/etc/gooroom/gooroom-client-server-register" "$root/usr/bin" \
+         "$root$PKGLIBEXECDIR" "$root/home" "$root/config" "$root/share" \
+         "$root/schemas" "$root/runtime"
+chmod 700 "$root/runtime"
+: > "$root/etc/gooroom/gooroom-client-server-register/gcsr.conf"
+
+# pkexec runs its command as is; the helpers do nothing, grac-pactl
+# reports the control it was run with
+script "$root/usr/bin/pkexec" 'exec "$@"'
+script "$root/usr/bin/grac-pactl.py" 'echo "$2" > "$BENCH_EFFECTS_FIFO"'
+for helper in gooroom-update-blacklist-helper grac-reload-helper gooroom-session-dialog; do
+	script "$root$PKGLIBEXECDIR/$helper" 'exit 0'
+done
+mkfifo "$root/effects"
+
+cp "$srcdir/replay.gschema.xml" "$root/schemas/" &&
+	glib-compile-schemas "$root/schemas" || exit 1
+
+cat > "$root/bus.conf" <<CONF
+<!DOCTYPE busconfig PUBLIC "-//freedesktop//DTD D-Bus Bus Configuration 1.0//EN"
+ "http://www.freedesktop.org/standards/dbus/1.0/busconfig.dtd">
+<busconfig>
+  <type>session</type>
+  <listen>unix:dir=$root</listen>
+  <auth>EXTERNAL</auth>
+  <policy context="default">
+    <allow send_destination="*" eavesdrop="true"/>
+    <allow eavesdrop="true"/>
+    <allow own="*"/>
+  </policy>
+</busconfig>
+CONF
+
+dbus-daemon --config-file="$root/bus.conf" --fork \
+	--print-address=3 --print-pid=4 3>"$root/bus-address" 4>"$root/bus-pid" || exit 1
+bus_pid=$(cat "$root/bus-pid")
+
+# one bus stands in for both the system and the session bus
+export DBUS_SESSION_BUS_ADDRESS=$(cat "$root/bus-address")
+export DBUS_SYSTEM_BUS_ADDRESS=$DBUS_SESSION_BUS_ADDRESS
+export GOOROOM_SESSION_MANAGER_ROOT=$root
+export BENCH_EFFECTS_FIFO=$root/effects
+export HOME=$root/home
+export XDG_CONFIG_HOME=$root/config
+export XDG_DATA_HOME=$root/share
+export XDG_DATA_DIRS=$root/share
+export XDG_RUNTIME_DIR=$root/runtime
+export GSETTINGS_SCHEMA_DIR=$root/schemas
+export GSETTINGS_BACKEND=memory
+export GIO_USE_VFS=local
+
+if [ -n "$ALLOC_PRELOAD" ]; then
+	LD_PRELOAD=$ALLOC_PRELOAD BENCH_ALLOC_STATS=$root/alloc-stats \
+		"$SESSION_MANAGER" > "$root/session-manager.log" 2>&1 &
+else
+	"$SESSION_MANAGER" > "$root/session-manager.log" 2>&1 &
+fi
+sm_pid=$!
+
+"$MOCK_SERVICES" --effects-fifo "$root/effects" \
+	--session-manager-pid "$sm_pid" --alloc-stats "$root/alloc-stats" "$@"
+status=$?
+
+if [ "$status" -ne 0 ]; then
+	echo "--- session manager output" >&2
+	tail -n 40 "$root/session-manager.log" >&2
+fi
+
+exit "$status"
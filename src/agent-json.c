@@ -0,0 +1,336 @@
+/*
+ * agent-json.c: zero-copy lookups in agent and GRAC messages
+ *
+ * Copyright (C) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <string.h>
+#include <stdarg.h>
+
+#include "agent-json.h"
+
+/*
+ * The messages from the agent and GRAC are small and only a couple of
+ * fields are read out of each of them, so instead of building a json-c
+ * tree per message the document is scanned in place and the values are
+ * handed out as spans of the original buffer.
+ */
+
+typedef struct {
+	const gchar *p;
+	const gchar *end;
+} JsonScanner;
+
+
+
+static void
+scanner_skip_space (JsonScanner *s)
+{
+	while (s->p < s->end &&
+           (*s->p == ' ' || *s->p == '\t' || *s->p == '\n' || *s->p == '\r'))
+		s->p++;
+}
+
+static gboolean
+scanner_string (JsonScanner *s, const gchar **str, gsize *len, gboolean *escaped)
+{
+	if (s->p >= s->end || *s->p != '"')
+		return FALSE;
+
+	s->p++;
+	*str = s->p;
+	*escaped = FALSE;
+
+	while (s->p < s->end) {
+		if (*s->p == '"') {
+			*len = s->p - *str;
+			s->p++;
+			return TRUE;
+		}
+		if (*s->p == '\\') {
+			*escaped = TRUE;
+			s->p++;
+		}
+		s->p++;
+	}
+
+	return FALSE;
+}
+
+static gboolean
+scanner_value (JsonScanner *s, AgentJsonValue *value)
+{
+	scanner_skip_space (s);
+
+	if (s->p >= s->end)
+		return FALSE;
+
+	if (*s->p == '"') {
+		value->is_string = TRUE;
+		return scanner_string (s, &value->str, &value->len, &value->escaped);
+	}
+
+	value->str = s->p;
+	value->is_string = FALSE;
+	value->escaped = FALSE;
+
+	if (*s->p == '{' || *s->p == '[') {
+		gint depth = 0;
+
+		while (s->p < s->end) {
+			if (*s->p == '"') {
+				AgentJsonValue skip;
+				if (!scanner_string (s, &skip.str, &skip.len, &skip.escaped))
+					return FALSE;
+				continue;
+			}
+			if (*s->p == '{' || *s->p == '[') {
+				depth++;
+			} else if (*s->p == '}' || *s->p == ']') {
+				if (--depth == 0) {
+					s->p++;
+					value->len = s->p - value->str;
+					return TRUE;
+				}
+			}
+			s->p++;
+		}
+		return FALSE;
+	}
+
+	/* numbers, true, false and null */
+	while (s->p < s->end && !strchr (",}] \t\r\n", *s->p))
+		s->p++;
+
+	value->len = s->p - value->str;
+
+	return (value->len > 0);
+}
+
+static gboolean
+scanner_member (JsonScanner *s, const gchar *key, AgentJsonValue *value)
+{
+	gsize key_len = strlen (key);
+
+	scanner_skip_space (s);
+	if (s->p >= s->end || *s->p != '{')
+		return FALSE;
+	s->p++;
+
+	for (;;) {
+		const gchar *name;
+		gsize name_len;
+		gboolean name_escaped;
+
+		scanner_skip_space (s);
+		if (!scanner_string (s, &name, &name_len, &name_escaped))
+			return FALSE;
+
+		scanner_skip_space (s);
+		if (s->p >= s->end || *s->p != ':')
+			return FALSE;
+		s->p++;
+
+		if (!scanner_value (s, value))
+			return FALSE;
+
+		if (!name_escaped && name_len == key_len && memcmp (name, key, key_len) == 0)
+			return TRUE;
+
+		scanner_skip_space (s);
+		if (s->p >= s->end || *s->p != ',')
+			return FALSE;
+		s->p++;
+	}
+}
+
+/* Follows the NULL terminated list of member names from the top level
+ * object. A null value counts as missing, like it does for json-c. */
+gboolean
+agent_json_lookup (const gchar    *json,
+                   gssize          len,
+                   AgentJsonValue *value,
+                   ...)
+{
+	va_list args;
+	const gchar *key;
+	JsonScanner s;
+	gboolean ret = TRUE;
+
+	g_return_val_if_fail (json != NULL, FALSE);
+	g_return_val_if_fail (value != NULL, FALSE);
+
+	s.p = json;
+	s.end = json + (len < 0 ? strlen (json) : (gsize)len);
+
+	va_start (args, value);
+	while ((key = va_arg (args, const gchar *))) {
+		if (!scanner_member (&s, key, value)) {
+			ret = FALSE;
+			break;
+		}
+		s.p = value->str;
+		s.end = value->str + value->len;
+	}
+	va_end (args);
+
+	if (ret && !value->is_string && value->len == 4 && memcmp (value->str, "null", 4) == 0)
+		ret = FALSE;
+
+	return ret;
+}
+
+static gboolean
+parse_hex4 (const gchar *p, const gchar *end, gunichar *ch)
+{
+	gint i;
+
+	if (end - p < 4)
+		return FALSE;
+
+	*ch = 0;
+	for (i = 0; i < 4; i++) {
+		gint digit = g_ascii_xdigit_value (p[i]);
+		if (digit < 0)
+			return FALSE;
+		*ch = (*ch << 4) | digit;
+	}
+
+	return TRUE;
+}
+
+/* An unescaped string is never longer than the escaped one, so @out
+ * only needs room for @len bytes and the terminator. */
+static gsize
+unescape (const gchar *str, gsize len, gchar *out)
+{
+	const gchar *p = str, *end = str + len;
+	gchar *o = out;
+
+	while (p < end) {
+		gunichar ch, low;
+
+		if (*p != '\\' || p + 1 >= end) {
+			*o++ = *p++;
+			continue;
+		}
+
+		p++;
+		switch (*p) {
+			case 'b': *o++ = '\b'; break;
+			case 'f': *o++ = '\f'; break;
+			case 'n': *o++ = '\n'; break;
+			case 'r': *o++ = '\r'; break;
+			case 't': *o++ = '\t'; break;
+
+			case 'u':
+				if (!parse_hex4 (p + 1, end, &ch)) {
+					*o++ = *p;
+					break;
+				}
+				p += 4;
+				/* surrogate pair */
+				if (ch >= 0xd800 && ch < 0xdc00 && end - p > 6 &&
+                    p[1] == '\\' && p[2] == 'u' && parse_hex4 (p + 3, end, &low) &&
+                    low >= 0xdc00 && low < 0xe000) {
+					ch = 0x10000 + ((ch - 0xd800) << 10) + (low - 0xdc00);
+					p += 6;
+				}
+				/* like json-c: a lone surrogate is not UTF-8, and a
+				 * NUL would cut the string short */
+				if (ch == 0 || (ch >= 0xd800 && ch < 0xe000))
+					ch = 0xfffd;
+				o += g_unichar_to_utf8 (ch, o);
+			break;
+
+			default:
+				*o++ = *p;
+			break;
+		}
+		p++;
+	}
+	*o = '\0';
+
+	return o - out;
+}
+
+gboolean
+agent_json_value_equal (const AgentJsonValue *value, const gchar *str)
+{
+	gsize len = strlen (str);
+
+	/* the values compared against are plain ASCII */
+	return (!value->escaped && value->len == len && memcmp (value->str, str, len) == 0);
+}
+
+gchar *
+agent_json_value_dup (const AgentJsonValue *value)
+{
+	gchar *ret;
+
+	if (!value->escaped)
+		return g_strndup (value->str, value->len);
+
+	ret = g_malloc (value->len + 1);
+	unescape (value->str, value->len, ret);
+
+	return ret;
+}
+
+gchar *
+agent_json_value_scratch (const AgentJsonValue *value, ScratchArena *arena)
+{
+	gchar *ret;
+
+	if (!value->escaped)
+		return scratch_arena_strndup (arena, value->str, value->len);
+
+	ret = scratch_arena_alloc (arena, value->len + 1);
+	unescape (value->str, value->len, ret);
+
+	return ret;
+}
+
+/* Replies of the agent look like
+ * {"module":{"task":{"out":{"status":"200","<property>":...}}}} */
+gboolean
+agent_json_task_output (const gchar    *json,
+                        gssize          len,
+                        const gchar    *property,
+                        AgentJsonValue *value)
+{
+	AgentJsonValue out, status;
+
+	if (!agent_json_lookup (json, len, &out, "module", "task", "out", NULL))
+		return FALSE;
+
+	if (!agent_json_lookup (out.str, out.len, &status, "status", NULL) ||
+        !agent_json_value_equal (&status, "200"))
+		return FALSE;
+
+	return agent_json_lookup (out.str, out.len, value, property, NULL);
+}
+
+gchar *
+agent_json_task_request (const gchar *task_name, const gchar *login_id)
+{
+	const gchar *json;
+
+	json = "{\"module\":{\"module_name\":\"config\",\"task\":{\"task_name\":\"%s\",\"in\":{\"login_id\":\"%s\"}}}}";
+
+	return g_strdup_printf (json, task_name, login_id);
+}
@@ -0,0 +1,61 @@
+/*
+ * agent-json.h: zero-copy lookups in agent and GRAC messages
+ *
+ * Copyright (C) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef AGENT_JSON_H
+#define AGENT_JSON_H
+
+#include <glib.h>
+
+#include "scratch-arena.h"
+
+G_BEGIN_DECLS
+
+/* A value found in a JSON document. @str points into the document and is
+ * not NUL terminated; strings are given without their quotes and with
+ * their escape sequences still in place. */
+typedef struct {
+	const gchar *str;
+	gsize        len;
+	gboolean     is_string;
+	gboolean     escaped;
+} AgentJsonValue;
+
+gboolean  agent_json_lookup         (const gchar          *json,
+                                     gssize                len,
+                                     AgentJsonValue       *value,
+                                     ...) G_GNUC_NULL_TERMINATED;
+
+gboolean  agent_json_value_equal    (const AgentJsonValue *value,
+                                     const gchar          *str);
+gchar    *agent_json_value_dup      (const AgentJsonValue *value);
+gchar    *agent_json_value_scratch  (const AgentJsonValue *value,
+                                     ScratchArena         *arena);
+
+gboolean  agent_json_task_output    (const gchar          *json,
+                                     gssize                len,
+                                     const gchar          *property,
+                                     AgentJsonValue       *value);
+
+gchar    *agent_json_task_request   (const gchar          *task_name,
+                                     const gchar          *login_id);
+
+G_END_DECLS
+
+#endif /* AGENT_JSON_H */
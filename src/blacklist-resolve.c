@@ -0,0 +1,100 @@
+/*
+ * blacklist-resolve.c: map blacklist entries to desktop files and binaries
+ *
+ * Copyright (C) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <gio/gio.h>
+#include <gio/gdesktopappinfo.h>
+
+#include "panel-glib.h"
+#include "blacklist-resolve.h"
+
+
+static gboolean
+desktop_string_matches (const gchar *value, const gchar *item)
+{
+	return (value && ((g_utf8_collate (value, item) == 0) || (panel_g_utf8_strstrcase (value, item) != NULL)));
+}
+
+/* The desktop file a blacklist entry refers to, matched by id, name,
+ * localized name or Exec line. @all_apps is g_app_info_get_all(). */
+gchar *
+blacklist_resolve_desktop (GList *all_apps, const gchar *item)
+{
+	GList *l = NULL;
+
+	if (!item || g_str_equal (item, ""))
+		return NULL;
+
+	for (l = all_apps; l; l = l->next) {
+		GAppInfo *appinfo = G_APP_INFO (l->data);
+		if (!appinfo)
+			continue;
+
+		gboolean found;
+		GDesktopAppInfo *dt_info;
+		gchar *locale_name, *name, *exec;
+
+		dt_info = G_DESKTOP_APP_INFO (appinfo);
+
+		if (g_str_equal (g_app_info_get_id (appinfo), item))
+			return g_strdup (g_desktop_app_info_get_filename (dt_info));
+
+		name = g_desktop_app_info_get_string (dt_info, G_KEY_FILE_DESKTOP_KEY_NAME);
+		locale_name = g_desktop_app_info_get_locale_string (dt_info, G_KEY_FILE_DESKTOP_KEY_NAME);
+		exec = g_desktop_app_info_get_string (dt_info, G_KEY_FILE_DESKTOP_KEY_EXEC);
+
+		found = (desktop_string_matches (name, item) ||
+                 desktop_string_matches (locale_name, item) ||
+                 desktop_string_matches (exec, item));
+
+		g_free (name);
+		g_free (locale_name);
+		g_free (exec);
+
+		if (found)
+			return g_strdup (g_desktop_app_info_get_filename (dt_info));
+	}
+
+	return NULL;
+}
+
+/* The binary the Exec line of a desktop file starts */
+gchar *
+blacklist_resolve_binary (const gchar *full_desktop_id)
+{
+	gchar *exec, *cmd = NULL;
+	gchar **argv = NULL;
+	GDesktopAppInfo *dt_appinfo;
+
+	dt_appinfo = g_desktop_app_info_new_from_filename (full_desktop_id);
+	if (!dt_appinfo)
+		return NULL;
+
+	exec = g_desktop_app_info_get_string (dt_appinfo, G_KEY_FILE_DESKTOP_KEY_EXEC);
+	if (exec && g_shell_parse_argv (exec, NULL, &argv, NULL)) {
+		if (g_strv_length (argv) > 0)
+			cmd = g_find_program_in_path (argv[0]);
+		g_strfreev (argv);
+	}
+
+	g_free (exec);
+	g_object_unref (dt_appinfo);
+
+	return cmd;
+}
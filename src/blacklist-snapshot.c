@@ -0,0 +1,381 @@
+/*
+ * blacklist-snapshot.c: sealed, mmap-able form of the resolved blacklist
+ *
+ * Copyright (C) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE     /* memfd_create, F_ADD_SEALS */
+#endif
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <gio/gio.h>
+
+#include "blacklist-snapshot.h"
+
+#define SNAPSHOT_SEALS  (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE)
+
+struct _BlacklistSnapshotBuilder {
+	GHashTable *names;      /* set */
+	GArray     *inodes;     /* BlacklistSnapshotInodeSlot */
+};
+
+struct _BlacklistSnapshot {
+	const guint8                  *data;
+	gsize                          size;
+	const BlacklistSnapshotHeader *header;
+};
+
+
+
+static guint32
+table_size (guint count)
+{
+	guint32 size = 8;
+
+	/* at most half full, so that a probe always ends on an empty slot */
+	while (size < count * 2)
+		size <<= 1;
+
+	return size;
+}
+
+BlacklistSnapshotBuilder *
+blacklist_snapshot_builder_new (void)
+{
+	BlacklistSnapshotBuilder *builder = g_new0 (BlacklistSnapshotBuilder, 1);
+
+	builder->names = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	builder->inodes = g_array_new (FALSE, FALSE, sizeof (BlacklistSnapshotInodeSlot));
+
+	return builder;
+}
+
+void
+blacklist_snapshot_builder_free (BlacklistSnapshotBuilder *builder)
+{
+	if (!builder)
+		return;
+
+	g_hash_table_destroy (builder->names);
+	g_array_free (builder->inodes, TRUE);
+	g_free (builder);
+}
+
+void
+blacklist_snapshot_builder_add_name (BlacklistSnapshotBuilder *builder, const gchar *name)
+{
+	if (name && name[0] != '\0')
+		g_hash_table_add (builder->names, g_strdup (name));
+}
+
+void
+blacklist_snapshot_builder_add_inode (BlacklistSnapshotBuilder *builder, guint64 dev, guint64 ino)
+{
+	BlacklistSnapshotInodeSlot slot = { dev, ino };
+
+	if (ino != 0)
+		g_array_append_val (builder->inodes, slot);
+}
+
+static gboolean
+write_all (gint fd, const guint8 *data, gsize size)
+{
+	while (size > 0) {
+		gssize n = write (fd, data, size);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return FALSE;
+		}
+		data += n;
+		size -= n;
+	}
+
+	return TRUE;
+}
+
+static guint8 *
+builder_layout (BlacklistSnapshotBuilder *builder, guint64 generation, gsize *size)
+{
+	guint i;
+	gsize strings_size = 1;
+	gpointer key;
+	guint8 *data;
+	guint32 string, mask;
+	guint32 n_name_slots, n_inode_slots, name_slots, inode_slots, strings;
+	GHashTableIter iter;
+	BlacklistSnapshotHeader *header;
+	BlacklistSnapshotNameSlot *names;
+	BlacklistSnapshotInodeSlot *inodes;
+
+	g_hash_table_iter_init (&iter, builder->names);
+	while (g_hash_table_iter_next (&iter, &key, NULL))
+		strings_size += strlen ((const gchar *)key) + 1;
+
+	n_name_slots = table_size (g_hash_table_size (builder->names));
+	n_inode_slots = table_size (builder->inodes->len);
+	name_slots = sizeof (BlacklistSnapshotHeader);
+	inode_slots = name_slots + n_name_slots * sizeof (BlacklistSnapshotNameSlot);
+	strings = inode_slots + n_inode_slots * sizeof (BlacklistSnapshotInodeSlot);
+
+	data = g_malloc0 (strings + strings_size);
+	header = (BlacklistSnapshotHeader *)data;
+	header->magic = BLACKLIST_SNAPSHOT_MAGIC;
+	header->version = BLACKLIST_SNAPSHOT_VERSION;
+	header->generation = generation;
+	header->n_name_slots = n_name_slots;
+	header->n_inode_slots = n_inode_slots;
+	header->name_slots = name_slots;
+	header->inode_slots = inode_slots;
+	header->strings = strings;
+	header->size = strings + strings_size;
+	names = (BlacklistSnapshotNameSlot *)(data + header->name_slots);
+	inodes = (BlacklistSnapshotInodeSlot *)(data + header->inode_slots);
+
+	string = 1;
+	mask = header->n_name_slots - 1;
+	g_hash_table_iter_init (&iter, builder->names);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		const gchar *name = key;
+		guint32 hash = blacklist_snapshot_hash (name);
+		guint32 slot = hash & mask;
+		gsize len = strlen (name) + 1;
+
+		while (names[slot].string != 0)
+			slot = (slot + 1) & mask;
+
+		names[slot].hash = hash;
+		names[slot].string = header->strings + string;
+		memcpy (data + header->strings + string, name, len);
+		string += len;
+		header->n_names++;
+	}
+
+	mask = header->n_inode_slots - 1;
+	for (i = 0; i < builder->inodes->len; i++) {
+		BlacklistSnapshotInodeSlot *inode = &g_array_index (builder->inodes, BlacklistSnapshotInodeSlot, i);
+		guint32 slot = blacklist_snapshot_inode_hash (inode->dev, inode->ino) & mask;
+
+		while (inodes[slot].ino != 0) {
+			if (inodes[slot].dev == inode->dev && inodes[slot].ino == inode->ino)
+				break;
+			slot = (slot + 1) & mask;
+		}
+
+		if (inodes[slot].ino == 0) {
+			inodes[slot] = *inode;
+			header->n_inodes++;
+		}
+	}
+
+	*size = header->size;
+
+	return data;
+}
+
+/* Returns a memfd that can be handed out as is: its contents can no
+ * longer change, and a consumer can map it but not write to it. */
+gint
+blacklist_snapshot_builder_seal (BlacklistSnapshotBuilder *builder, guint64 generation, GError **error)
+{
+#ifdef HAVE_MEMFD_CREATE
+	gint fd;
+	gsize size;
+	guint8 *data;
+
+	fd = memfd_create ("gooroom-blacklist", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd < 0) {
+		gint saved_errno = errno;
+		g_set_error (error, G_IO_ERROR, g_io_error_from_errno (saved_errno),
+                     "memfd_create: %s", g_strerror (saved_errno));
+		return -1;
+	}
+
+	data = builder_layout (builder, generation, &size);
+
+	if (!write_all (fd, data, size) ||
+        fcntl (fd, F_ADD_SEALS, SNAPSHOT_SEALS | F_SEAL_SEAL) < 0) {
+		gint saved_errno = errno;
+		g_set_error (error, G_IO_ERROR, g_io_error_from_errno (saved_errno),
+                     "Failed to write the blacklist snapshot: %s", g_strerror (saved_errno));
+		close (fd);
+		fd = -1;
+	}
+
+	g_free (data);
+
+	return fd;
+#else
+	g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                         "memfd_create is not available");
+	return -1;
+#endif
+}
+
+static gboolean
+header_is_valid (const BlacklistSnapshotHeader *header, gsize size)
+{
+	guint64 end;
+
+	if (header->magic != BLACKLIST_SNAPSHOT_MAGIC ||
+        header->version != BLACKLIST_SNAPSHOT_VERSION ||
+        header->size != size)
+		return FALSE;
+
+	if (header->n_name_slots == 0 || (header->n_name_slots & (header->n_name_slots - 1)) ||
+        header->n_inode_slots == 0 || (header->n_inode_slots & (header->n_inode_slots - 1)))
+		return FALSE;
+
+	if (header->name_slots < sizeof (BlacklistSnapshotHeader) ||
+        header->inode_slots % sizeof (guint64) != 0)
+		return FALSE;
+
+	end = (guint64) header->name_slots + (guint64) header->n_name_slots * sizeof (BlacklistSnapshotNameSlot);
+	if (end > header->inode_slots)
+		return FALSE;
+
+	end = (guint64) header->inode_slots + (guint64) header->n_inode_slots * sizeof (BlacklistSnapshotInodeSlot);
+	if (end > header->strings || header->strings >= size)
+		return FALSE;
+
+	return TRUE;
+}
+
+/* Only sealed snapshots are accepted, anything else could change while
+ * it is being read. */
+BlacklistSnapshot *
+blacklist_snapshot_map (gint fd, GError **error)
+{
+	gint seals;
+	gpointer data;
+	struct stat st;
+	BlacklistSnapshot *snapshot;
+
+	seals = fcntl (fd, F_GET_SEALS);
+	if (seals < 0 || (seals & SNAPSHOT_SEALS) != SNAPSHOT_SEALS) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                             "Blacklist snapshot is not sealed");
+		return NULL;
+	}
+
+	if (fstat (fd, &st) < 0 || st.st_size < (off_t) sizeof (BlacklistSnapshotHeader)) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                             "Blacklist snapshot is truncated");
+		return NULL;
+	}
+
+	data = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (data == MAP_FAILED) {
+		gint saved_errno = errno;
+		g_set_error (error, G_IO_ERROR, g_io_error_from_errno (saved_errno),
+                     "mmap: %s", g_strerror (saved_errno));
+		return NULL;
+	}
+
+	if (!header_is_valid (data, st.st_size) || ((const guint8 *)data)[st.st_size - 1] != '\0') {
+		munmap (data, st.st_size);
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                             "Blacklist snapshot is malformed");
+		return NULL;
+	}
+
+	snapshot = g_new0 (BlacklistSnapshot, 1);
+	snapshot->data = data;
+	snapshot->size = st.st_size;
+	snapshot->header = data;
+
+	return snapshot;
+}
+
+void
+blacklist_snapshot_unmap (BlacklistSnapshot *snapshot)
+{
+	if (!snapshot)
+		return;
+
+	munmap ((gpointer) snapshot->data, snapshot->size);
+	g_free (snapshot);
+}
+
+guint64
+blacklist_snapshot_get_generation (const BlacklistSnapshot *snapshot)
+{
+	return snapshot->header->generation;
+}
+
+gboolean
+blacklist_snapshot_has_name (const BlacklistSnapshot *snapshot, const gchar *name)
+{
+	guint32 i, slot, hash, mask;
+	const BlacklistSnapshotHeader *header = snapshot->header;
+	const BlacklistSnapshotNameSlot *names;
+
+	names = (const BlacklistSnapshotNameSlot *)(snapshot->data + header->name_slots);
+	hash = blacklist_snapshot_hash (name);
+	mask = header->n_name_slots - 1;
+	slot = hash & mask;
+
+	for (i = 0; i < header->n_name_slots; i++) {
+		guint32 string = names[slot].string;
+
+		if (string == 0)
+			break;
+
+		if (names[slot].hash == hash && string >= header->strings && string < snapshot->size &&
+            g_str_equal ((const gchar *)(snapshot->data + string), name))
+			return TRUE;
+
+		slot = (slot + 1) & mask;
+	}
+
+	return FALSE;
+}
+
+gboolean
+blacklist_snapshot_has_inode (const BlacklistSnapshot *snapshot, guint64 dev, guint64 ino)
+{
+	guint32 i, slot, mask;
+	const BlacklistSnapshotHeader *header = snapshot->header;
+	const BlacklistSnapshotInodeSlot *inodes;
+
+	inodes = (const BlacklistSnapshotInodeSlot *)(snapshot->data + header->inode_slots);
+	mask = header->n_inode_slots - 1;
+	slot = blacklist_snapshot_inode_hash (dev, ino) & mask;
+
+	for (i = 0; i < header->n_inode_slots; i++) {
+		if (inodes[slot].ino == 0)
+			break;
+
+		if (inodes[slot].dev == dev && inodes[slot].ino == ino)
+			return TRUE;
+
+		slot = (slot + 1) & mask;
+	}
+
+	return FALSE;
+}
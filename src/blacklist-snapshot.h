@@ -0,0 +1,119 @@
+/*
+ * blacklist-snapshot.h: sealed, mmap-able form of the resolved blacklist
+ *
+ * Copyright (C) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef BLACKLIST_SNAPSHOT_H
+#define BLACKLIST_SNAPSHOT_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * The snapshot is a sealed memfd, mapped read-only by its consumers.
+ * Layout, in host byte order:
+ *
+ *   BlacklistSnapshotHeader
+ *   name slots    n_name_slots x BlacklistSnapshotNameSlot
+ *   inode slots   n_inode_slots x BlacklistSnapshotInodeSlot
+ *   strings       NUL-terminated, after a leading empty one
+ *
+ * Names are blocked desktop ids, both as configured and as resolved, and
+ * the Exec paths behind them. Inodes are those of the Exec paths. Both
+ * tables are open-addressed with linear probing, have a power-of-two
+ * size and are at most half full. An empty name slot has string 0, an
+ * empty inode slot has ino 0. Offsets count from the start of the file.
+ */
+
+#define BLACKLIST_SNAPSHOT_MAGIC    0x4c425247  /* "GRBL" */
+#define BLACKLIST_SNAPSHOT_VERSION  1
+
+typedef struct {
+	guint32 magic;
+	guint32 version;
+	guint64 generation;
+	guint32 n_names;
+	guint32 n_name_slots;
+	guint32 n_inodes;
+	guint32 n_inode_slots;
+	guint32 name_slots;
+	guint32 inode_slots;
+	guint32 strings;
+	guint32 size;
+} BlacklistSnapshotHeader;
+
+typedef struct {
+	guint32 hash;
+	guint32 string;
+} BlacklistSnapshotNameSlot;
+
+typedef struct {
+	guint64 dev;
+	guint64 ino;
+} BlacklistSnapshotInodeSlot;
+
+/* part of the format: 32-bit FNV-1a of names, and the inode hash */
+static inline guint32
+blacklist_snapshot_hash (const gchar *name)
+{
+	guint32 hash = 2166136261u;
+
+	for (; *name; name++) {
+		hash ^= (guchar) *name;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+static inline guint32
+blacklist_snapshot_inode_hash (guint64 dev, guint64 ino)
+{
+	guint64 hash = (ino ^ (dev << 32) ^ (dev >> 32)) * G_GUINT64_CONSTANT (0x9e3779b97f4a7c15);
+
+	return (guint32) (hash >> 32);
+}
+
+typedef struct _BlacklistSnapshotBuilder BlacklistSnapshotBuilder;
+typedef struct _BlacklistSnapshot        BlacklistSnapshot;
+
+BlacklistSnapshotBuilder *blacklist_snapshot_builder_new       (void);
+void                      blacklist_snapshot_builder_free      (BlacklistSnapshotBuilder *builder);
+void                      blacklist_snapshot_builder_add_name  (BlacklistSnapshotBuilder *builder,
+                                                                const gchar              *name);
+void                      blacklist_snapshot_builder_add_inode (BlacklistSnapshotBuilder *builder,
+                                                                guint64                   dev,
+                                                                guint64                   ino);
+gint                      blacklist_snapshot_builder_seal      (BlacklistSnapshotBuilder *builder,
+                                                                guint64                   generation,
+                                                                GError                  **error);
+
+BlacklistSnapshot        *blacklist_snapshot_map               (gint                      fd,
+                                                                GError                  **error);
+void                      blacklist_snapshot_unmap             (BlacklistSnapshot        *snapshot);
+guint64                   blacklist_snapshot_get_generation    (const BlacklistSnapshot  *snapshot);
+gboolean                  blacklist_snapshot_has_name          (const BlacklistSnapshot  *snapshot,
+                                                                const gchar              *name);
+gboolean                  blacklist_snapshot_has_inode         (const BlacklistSnapshot  *snapshot,
+                                                                guint64                   dev,
+                                                                guint64                   ino);
+
+G_END_DECLS
+
+#endif /* BLACKLIST_SNAPSHOT_H */
@@ -0,0 +1,511 @@
+/*
+ * exec-gate.c: per-user exec blocking with fanotify permission events
+ *
+ * Copyright (C) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#ifdef HAVE_SYS_FANOTIFY_H
+#include <sys/fanotify.h>
+#endif
+
+#include <glib-unix.h>
+#include <gio/gio.h>
+
+#include "exec-gate.h"
+
+/*
+ * Instead of taking the execute bit away from a binary for everybody,
+ * the binary gets a fanotify FAN_OPEN_EXEC_PERM mark, and every exec of
+ * it is answered from a set of (device, inode) -> blocked uids. Only
+ * marked inodes generate events, so other execs on the host don't pay
+ * anything, and a policy update is a new set plus a diff of the marks;
+ * no file is written.
+ *
+ * Every mark is made through a descriptor of the marked inode, kept as
+ * long as the mark, and removed through it: a package upgrade that
+ * replaces a binary leaves the mark on the old inode, which the next
+ * policy update removes while marking the new one.
+ *
+ * Permission events are answered on a thread of their own that does
+ * nothing else, since every exec of a marked binary waits for it.
+ */
+
+typedef struct {
+	dev_t  dev;
+	ino_t  ino;
+} InodeKey;
+
+typedef struct {
+	InodeKey  key;
+	gchar    *path;
+	gint      fd;       /* the marked inode, -1 until marked */
+	GArray   *uids;     /* guint32 */
+} InodeEntry;
+
+struct _ExecGatePolicy {
+	GHashTable *inodes;     /* InodeKey -> InodeEntry */
+};
+
+struct _ExecGate {
+	gint            fd;
+	GSource        *source;
+	GMainContext   *context;
+	GMainLoop      *loop;
+	GThread        *thread;
+
+	/* shared with the gate thread */
+	GMutex          lock;
+	ExecGatePolicy *policy;
+	guint64         allowed;
+	guint64         denied;
+};
+
+
+
+static guint
+inode_key_hash (gconstpointer data)
+{
+	const InodeKey *key = data;
+
+	guint64 ino = key->ino;
+
+	return (guint) (ino ^ (ino >> 32) ^ ((guint64) key->dev * 31));
+}
+
+static gboolean
+inode_key_equal (gconstpointer a, gconstpointer b)
+{
+	const InodeKey *ka = a, *kb = b;
+
+	return (ka->ino == kb->ino && ka->dev == kb->dev);
+}
+
+static void
+inode_entry_free (gpointer data)
+{
+	InodeEntry *entry = (InodeEntry *)data;
+
+	if (entry->fd >= 0)
+		close (entry->fd);
+	g_array_unref (entry->uids);
+	g_free (entry->path);
+	g_free (entry);
+}
+
+ExecGatePolicy *
+exec_gate_policy_new (void)
+{
+	ExecGatePolicy *policy = g_new0 (ExecGatePolicy, 1);
+
+	policy->inodes = g_hash_table_new_full (inode_key_hash, inode_key_equal,
+                                            NULL, inode_entry_free);
+
+	return policy;
+}
+
+void
+exec_gate_policy_free (ExecGatePolicy *policy)
+{
+	if (!policy)
+		return;
+
+	g_hash_table_destroy (policy->inodes);
+	g_free (policy);
+}
+
+/* Blocks @path for @uid; the file is identified by its inode, so links
+ * and other names of the same binary are covered too. */
+gboolean
+exec_gate_policy_add (ExecGatePolicy *policy, const gchar *path, guint32 uid)
+{
+	guint i;
+	struct stat st;
+	InodeKey key;
+	InodeEntry *entry;
+
+	if (stat (path, &st) < 0 || !S_ISREG (st.st_mode))
+		return FALSE;
+
+	key.dev = st.st_dev;
+	key.ino = st.st_ino;
+
+	entry = g_hash_table_lookup (policy->inodes, &key);
+	if (!entry) {
+		entry = g_new0 (InodeEntry, 1);
+		entry->key = key;
+		entry->path = g_strdup (path);
+		entry->fd = -1;
+		entry->uids = g_array_new (FALSE, FALSE, sizeof (guint32));
+		g_hash_table_insert (policy->inodes, &entry->key, entry);
+	}
+
+	for (i = 0; i < entry->uids->len; i++) {
+		if (g_array_index (entry->uids, guint32, i) == uid)
+			return TRUE;
+	}
+	g_array_append_val (entry->uids, uid);
+
+	return TRUE;
+}
+
+gboolean
+exec_gate_policy_guards (const ExecGatePolicy *policy, dev_t dev, ino_t ino)
+{
+	InodeKey key;
+
+	key.dev = dev;
+	key.ino = ino;
+
+	return g_hash_table_contains (policy->inodes, &key);
+}
+
+gboolean
+exec_gate_policy_denies (const ExecGatePolicy *policy, dev_t dev, ino_t ino, guint32 uid)
+{
+	guint i;
+	InodeKey key;
+	InodeEntry *entry;
+
+	key.dev = dev;
+	key.ino = ino;
+
+	entry = g_hash_table_lookup (policy->inodes, &key);
+	if (!entry)
+		return FALSE;
+
+	/* a handful of users per binary at most */
+	for (i = 0; i < entry->uids->len; i++) {
+		if (g_array_index (entry->uids, guint32, i) == uid)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+guint
+exec_gate_policy_size (const ExecGatePolicy *policy)
+{
+	return g_hash_table_size (policy->inodes);
+}
+
+#if defined(HAVE_SYS_FANOTIFY_H) && defined(FAN_OPEN_EXEC_PERM)
+
+/* The real uid of @pid, as the policy is per login user: the owner of
+ * /proc/<pid> can not be used, a process that is not dumpable makes it
+ * root. The pidfd makes sure that the status read is that of @pid and
+ * not of a process that got its number after it was killed. */
+static gboolean
+process_uid (pid_t pid, guint32 *uid)
+{
+	gint pidfd = -1;
+	gchar path[32];
+	gchar *status = NULL, *line;
+	gboolean ret = FALSE;
+
+#ifdef SYS_pidfd_open
+	pidfd = (gint) syscall (SYS_pidfd_open, pid, 0);
+	if (pidfd < 0 && errno != ENOSYS)
+		return FALSE;
+#endif
+
+	g_snprintf (path, sizeof (path), "/proc/%d/status", (gint) pid);
+	if (!g_file_get_contents (path, &status, NULL, NULL))
+		goto out;
+
+	line = strstr (status, "\nUid:");
+	if (!line || sscanf (line, "\nUid:\t%u", uid) != 1)
+		goto out;
+
+	ret = TRUE;
+
+	/* a pidfd becomes readable once the process has exited */
+	if (pidfd >= 0) {
+		struct pollfd pfd = { pidfd, POLLIN, 0 };
+		ret = (poll (&pfd, 1, 0) == 0);
+	}
+
+out:
+	if (pidfd >= 0)
+		close (pidfd);
+	g_free (status);
+
+	return ret;
+}
+
+/* Called on the gate thread */
+static guint32
+exec_gate_decide (ExecGate *gate, const struct fanotify_event_metadata *event)
+{
+	guint32 uid;
+	struct stat st;
+	guint32 response = FAN_ALLOW;
+	gboolean known_uid;
+
+	known_uid = process_uid (event->pid, &uid);
+
+	g_mutex_lock (&gate->lock);
+
+	if (!gate->policy) {
+		response = FAN_ALLOW;
+	} else if (fstat (event->fd, &st) < 0) {
+		/* only guarded binaries are marked */
+		response = FAN_DENY;
+	} else if (!exec_gate_policy_guards (gate->policy, st.st_dev, st.st_ino)) {
+		/* a mark about to be removed */
+		response = FAN_ALLOW;
+	} else if (!known_uid || exec_gate_policy_denies (gate->policy, st.st_dev, st.st_ino, uid)) {
+		response = FAN_DENY;
+	}
+
+	if (response == FAN_DENY)
+		gate->denied++;
+	else
+		gate->allowed++;
+
+	g_mutex_unlock (&gate->lock);
+
+	return response;
+}
+
+static gboolean
+exec_gate_dispatch (gint fd, GIOCondition condition, gpointer user_data)
+{
+	ExecGate *gate = (ExecGate *)user_data;
+	gchar buf[4096] __attribute__ ((aligned (__alignof__ (struct fanotify_event_metadata))));
+
+	for (;;) {
+		ssize_t len;
+		const struct fanotify_event_metadata *event;
+
+		len = read (fd, buf, sizeof (buf));
+		if (len <= 0)
+			break;
+
+		event = (const struct fanotify_event_metadata *) buf;
+		for (; FAN_EVENT_OK (event, len); event = FAN_EVENT_NEXT (event, len)) {
+			if (event->fd < 0)
+				continue;
+
+			if (event->mask & FAN_OPEN_EXEC_PERM) {
+				struct fanotify_response response;
+
+				response.fd = event->fd;
+				response.response = exec_gate_decide (gate, event);
+				if (write (fd, &response, sizeof (response)) < 0)
+					g_warning ("Failed to answer exec of fd %d: %s", event->fd, g_strerror (errno));
+			}
+			close (event->fd);
+		}
+	}
+
+	return G_SOURCE_CONTINUE;
+}
+
+static gpointer
+exec_gate_thread_func (gpointer data)
+{
+	ExecGate *gate = (ExecGate *)data;
+
+	g_main_context_push_thread_default (gate->context);
+	g_main_loop_run (gate->loop);
+	g_main_context_pop_thread_default (gate->context);
+
+	return NULL;
+}
+
+/* Marks the inode @entry was resolved to, through a descriptor that
+ * stays with the mark */
+static void
+exec_gate_mark (ExecGate *gate, InodeEntry *entry)
+{
+	struct stat st;
+
+	entry->fd = open (entry->path, O_RDONLY | O_CLOEXEC | O_NOCTTY);
+	if (entry->fd < 0) {
+		g_warning ("Failed to open %s: %s", entry->path, g_strerror (errno));
+		return;
+	}
+
+	/* replaced since it was resolved, the next update marks the new one */
+	if (fstat (entry->fd, &st) < 0 || st.st_dev != entry->key.dev || st.st_ino != entry->key.ino) {
+		g_warning ("%s changed while the policy was built", entry->path);
+		close (entry->fd);
+		entry->fd = -1;
+		return;
+	}
+
+	if (fanotify_mark (gate->fd, FAN_MARK_ADD, FAN_OPEN_EXEC_PERM, entry->fd, NULL) < 0) {
+		g_warning ("Failed to mark %s: %s", entry->path, g_strerror (errno));
+		close (entry->fd);
+		entry->fd = -1;
+	}
+}
+
+static void
+exec_gate_unmark (ExecGate *gate, InodeEntry *entry)
+{
+	if (entry->fd < 0)
+		return;
+
+	if (fanotify_mark (gate->fd, FAN_MARK_REMOVE, FAN_OPEN_EXEC_PERM, entry->fd, NULL) < 0)
+		g_warning ("Failed to unmark %s: %s", entry->path, g_strerror (errno));
+
+	close (entry->fd);
+	entry->fd = -1;
+}
+
+ExecGate *
+exec_gate_new (GError **error)
+{
+	gint fd;
+	ExecGate *gate;
+
+	fd = fanotify_init (FAN_CLASS_CONTENT | FAN_CLOEXEC | FAN_NONBLOCK, O_RDONLY | O_LARGEFILE | O_CLOEXEC);
+	if (fd < 0) {
+		gint saved_errno = errno;
+		g_set_error (error, G_IO_ERROR, g_io_error_from_errno (saved_errno),
+                     "fanotify_init: %s", g_strerror (saved_errno));
+		return NULL;
+	}
+
+	gate = g_new0 (ExecGate, 1);
+	gate->fd = fd;
+	g_mutex_init (&gate->lock);
+
+	gate->context = g_main_context_new ();
+	gate->loop = g_main_loop_new (gate->context, FALSE);
+
+	gate->source = g_unix_fd_source_new (fd, G_IO_IN);
+	g_source_set_priority (gate->source, G_PRIORITY_HIGH);
+	g_source_set_callback (gate->source, (GSourceFunc) exec_gate_dispatch, gate, NULL);
+	g_source_attach (gate->source, gate->context);
+
+	gate->thread = g_thread_new ("exec-gate", exec_gate_thread_func, gate);
+
+	return gate;
+}
+
+void
+exec_gate_free (ExecGate *gate)
+{
+	if (!gate)
+		return;
+
+	g_main_loop_quit (gate->loop);
+	g_thread_join (gate->thread);
+
+	g_source_destroy (gate->source);
+	g_source_unref (gate->source);
+	g_main_loop_unref (gate->loop);
+	g_main_context_unref (gate->context);
+
+	/* closing the group drops the marks and allows what is pending */
+	close (gate->fd);
+
+	exec_gate_policy_free (gate->policy);
+	g_mutex_clear (&gate->lock);
+	g_free (gate);
+}
+
+/* Takes ownership of @policy. New marks are added before the set is
+ * swapped and stale ones removed after, so no binary is unguarded in
+ * between; marks on inodes in both sets move to the new set. */
+void
+exec_gate_set_policy (ExecGate *gate, ExecGatePolicy *policy)
+{
+	gpointer value;
+	GHashTableIter iter;
+	ExecGatePolicy *old = gate->policy;
+
+	g_hash_table_iter_init (&iter, policy->inodes);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		InodeEntry *entry = (InodeEntry *)value;
+		InodeEntry *marked = old ? g_hash_table_lookup (old->inodes, &entry->key) : NULL;
+
+		if (marked && marked->fd >= 0) {
+			entry->fd = marked->fd;
+			marked->fd = -1;
+		} else {
+			exec_gate_mark (gate, entry);
+		}
+	}
+
+	g_mutex_lock (&gate->lock);
+	gate->policy = policy;
+	g_mutex_unlock (&gate->lock);
+
+	if (old) {
+		g_hash_table_iter_init (&iter, old->inodes);
+		while (g_hash_table_iter_next (&iter, NULL, &value))
+			exec_gate_unmark (gate, (InodeEntry *)value);
+		exec_gate_policy_free (old);
+	}
+}
+
+#else /* no FAN_OPEN_EXEC_PERM */
+
+ExecGate *
+exec_gate_new (GError **error)
+{
+	g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                 "fanotify exec permission events are not supported");
+	return NULL;
+}
+
+void
+exec_gate_free (ExecGate *gate)
+{
+}
+
+void
+exec_gate_set_policy (ExecGate *gate, ExecGatePolicy *policy)
+{
+	exec_gate_policy_free (policy);
+}
+
+#endif
+
+void
+exec_gate_get_counters (ExecGate *gate, guint64 *allowed, guint64 *denied)
+{
+	if (allowed)
+		*allowed = 0;
+	if (denied)
+		*denied = 0;
+
+	if (!gate)
+		return;
+
+	g_mutex_lock (&gate->lock);
+	if (allowed)
+		*allowed = gate->allowed;
+	if (denied)
+		*denied = gate->denied;
+	g_mutex_unlock (&gate->lock);
+}
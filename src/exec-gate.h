@@ -0,0 +1,57 @@
+/*
+ * exec-gate.h: per-user exec blocking with fanotify permission events
+ *
+ * Copyright (C) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef EXEC_GATE_H
+#define EXEC_GATE_H
+
+#include <sys/types.h>
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _ExecGate       ExecGate;
+typedef struct _ExecGatePolicy ExecGatePolicy;
+
+ExecGatePolicy *exec_gate_policy_new     (void);
+void            exec_gate_policy_free    (ExecGatePolicy       *policy);
+gboolean        exec_gate_policy_add     (ExecGatePolicy       *policy,
+                                          const gchar          *path,
+                                          guint32               uid);
+gboolean        exec_gate_policy_guards  (const ExecGatePolicy *policy,
+                                          dev_t                 dev,
+                                          ino_t                 ino);
+gboolean        exec_gate_policy_denies  (const ExecGatePolicy *policy,
+                                          dev_t                 dev,
+                                          ino_t                 ino,
+                                          guint32               uid);
+guint           exec_gate_policy_size    (const ExecGatePolicy *policy);
+
+ExecGate       *exec_gate_new            (GError              **error);
+void            exec_gate_free           (ExecGate             *gate);
+void            exec_gate_set_policy     (ExecGate             *gate,
+                                          ExecGatePolicy       *policy);
+void            exec_gate_get_counters   (ExecGate             *gate,
+                                          guint64              *allowed,
+                                          guint64              *denied);
+
+G_END_DECLS
+
+#endif /* EXEC_GATE_H */
@@ -0,0 +1,221 @@
+/*
+ * flight-recorder.c: ring of the recent events, for diagnosing after the fact
+ *
+ * Copyright (C) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <signal.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <glib-unix.h>
+
+#include "flight-recorder.h"
+
+
+typedef struct {
+	gint     seq;           /* index + 1 once written, 0 while being written */
+	gint     kind;
+	gint     tid;
+	gint64   time_us;
+	gint64   value;
+	gint64   duration_us;
+	gchar    name[40];
+	gchar    detail[88];
+} FlightEvent;
+
+static FlightEvent g_ring[FLIGHT_RECORDER_SIZE];
+static gint        g_next = 0;
+
+
+
+/* Claims the slot of the next event; writers that lap each other on the
+ * same slot would need FLIGHT_RECORDER_SIZE events in between */
+static FlightEvent *
+flight_begin (FlightEventKind kind, const gchar *name, guint *index)
+{
+	FlightEvent *event;
+
+	*index = (guint) g_atomic_int_add (&g_next, 1);
+	event = &g_ring[*index % FLIGHT_RECORDER_SIZE];
+
+	g_atomic_int_set (&event->seq, 0);
+
+	event->kind = kind;
+	event->tid = (gint) syscall (SYS_gettid);
+	event->time_us = g_get_monotonic_time ();
+	event->value = 0;
+	event->duration_us = 0;
+	event->detail[0] = '\0';
+	g_strlcpy (event->name, name ? name : "", sizeof (event->name));
+
+	return event;
+}
+
+static void
+flight_commit (FlightEvent *event, guint index)
+{
+	g_atomic_int_set (&event->seq, (gint) (index + 1));
+}
+
+void
+flight_record (FlightEventKind kind, const gchar *name, gint64 value, gint64 duration_us)
+{
+	guint index;
+	FlightEvent *event = flight_begin (kind, name, &index);
+
+	event->value = value;
+	event->duration_us = duration_us;
+
+	flight_commit (event, index);
+}
+
+void
+flight_record_error (FlightEventKind kind, const gchar *name, const GError *error)
+{
+	guint index;
+	FlightEvent *event = flight_begin (kind, name, &index);
+
+	if (error) {
+		event->value = error->code;
+		g_strlcpy (event->detail, error->message, sizeof (event->detail));
+	}
+
+	flight_commit (event, index);
+}
+
+static void
+append_event (GString *out, const FlightEvent *event, gint64 now_us, gint64 real_now_us)
+{
+	gint64 real_us;
+	GDateTime *time;
+	gchar *stamp;
+
+	real_us = real_now_us - (now_us - event->time_us);
+	time = g_date_time_new_from_unix_local (real_us / G_USEC_PER_SEC);
+	stamp = g_date_time_format (time, "%H:%M:%S");
+	g_string_append_printf (out, "%s.%03d [%d] ", stamp,
+                            (gint) (real_us % G_USEC_PER_SEC / 1000), event->tid);
+	g_free (stamp);
+	g_date_time_unref (time);
+
+	switch (event->kind) {
+		case FLIGHT_EVENT_SIGNAL:
+			g_string_append_printf (out, "signal %s: %" G_GINT64_FORMAT " bytes, handled in %.1f ms",
+                                    event->name, event->value, event->duration_us / 1000.0);
+		break;
+
+		case FLIGHT_EVENT_SPAWN:
+			g_string_append_printf (out, "spawn %s: pid %" G_GINT64_FORMAT,
+                                    event->name, event->value);
+		break;
+
+		case FLIGHT_EVENT_SPAWN_FAILED:
+			g_string_append_printf (out, "spawn %s failed: %s", event->name, event->detail);
+		break;
+
+		case FLIGHT_EVENT_EXIT:
+			if (WIFSIGNALED ((gint) event->value))
+				g_string_append_printf (out, "exit %s: signal %d", event->name,
+                                        WTERMSIG ((gint) event->value));
+			else
+				g_string_append_printf (out, "exit %s: status %d", event->name,
+                                        WEXITSTATUS ((gint) event->value));
+			g_string_append_printf (out, " after %.1f ms", event->duration_us / 1000.0);
+		break;
+
+		case FLIGHT_EVENT_ERROR:
+			g_string_append_printf (out, "error %s: %s (%" G_GINT64_FORMAT ")",
+                                    event->name, event->detail, event->value);
+		break;
+
+		case FLIGHT_EVENT_STALL:
+			g_string_append_printf (out, "stall of %.1f ms after %s",
+                                    event->duration_us / 1000.0, event->name);
+		break;
+
+		default:
+		break;
+	}
+
+	g_string_append_c (out, '\n');
+}
+
+gchar *
+flight_recorder_dump (void)
+{
+	guint i, first, next;
+	gint64 now_us, real_now_us;
+	GString *out;
+
+	out = g_string_new (NULL);
+	now_us = g_get_monotonic_time ();
+	real_now_us = g_get_real_time ();
+
+	next = (guint) g_atomic_int_get (&g_next);
+	first = (next > FLIGHT_RECORDER_SIZE) ? next - FLIGHT_RECORDER_SIZE : 0;
+
+	for (i = first; i != next; i++) {
+		const FlightEvent *slot = &g_ring[i % FLIGHT_RECORDER_SIZE];
+		FlightEvent event;
+
+		/* skip the slots being written, or rewritten since */
+		if (g_atomic_int_get (&slot->seq) != (gint) (i + 1))
+			continue;
+		event = *slot;
+		if (g_atomic_int_get (&slot->seq) != (gint) (i + 1))
+			continue;
+
+		append_event (out, &event, now_us, real_now_us);
+	}
+
+	return g_string_free (out, FALSE);
+}
+
+static gboolean
+dump_signal_cb (gpointer data)
+{
+	const gchar *path = (const gchar *)data;
+	gchar *dump;
+	GError *error = NULL;
+
+	dump = flight_recorder_dump ();
+
+	if (g_file_set_contents (path, dump, -1, &error)) {
+		g_message ("Flight recorder dumped to %s", path);
+	} else {
+		g_warning ("Failed to dump the flight recorder: %s", error->message);
+		g_error_free (error);
+	}
+
+	g_free (dump);
+
+	return G_SOURCE_CONTINUE;
+}
+
+void
+flight_recorder_watch_signal (const gchar *name)
+{
+	gchar *file = g_strdup_printf ("%s.flight", name);
+
+	/* the path lives as long as the process */
+	g_unix_signal_add (SIGUSR1, dump_signal_cb,
+                       g_build_filename (g_get_user_runtime_dir (), file, NULL));
+
+	g_free (file);
+}
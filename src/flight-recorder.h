@@ -0,0 +1,60 @@
+/*
+ * flight-recorder.h: ring of the recent events, for diagnosing after the fact
+ *
+ * Copyright (C) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef FLIGHT_RECORDER_H
+#define FLIGHT_RECORDER_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* The last FLIGHT_RECORDER_SIZE events are kept in a static ring that
+ * any thread writes to without taking a lock; older ones are overwritten.
+ * Recording is always on and costs an atomic increment, a clock read and
+ * a few stores. */
+#define FLIGHT_RECORDER_SIZE    1024
+
+typedef enum {
+	FLIGHT_EVENT_SIGNAL,        /* value: payload bytes, handler duration */
+	FLIGHT_EVENT_SPAWN,         /* value: pid */
+	FLIGHT_EVENT_SPAWN_FAILED,  /* detail: the error */
+	FLIGHT_EVENT_EXIT,          /* value: wait status, run duration */
+	FLIGHT_EVENT_ERROR,         /* value: error code, detail: the error */
+	FLIGHT_EVENT_STALL          /* name: the slowest callback, the lag */
+} FlightEventKind;
+
+void     flight_record                 (FlightEventKind  kind,
+                                        const gchar     *name,
+                                        gint64           value,
+                                        gint64           duration_us);
+void     flight_record_error           (FlightEventKind  kind,
+                                        const gchar     *name,
+                                        const GError    *error);
+
+/* One line per event, oldest first */
+gchar   *flight_recorder_dump          (void);
+
+/* Dumps to $XDG_RUNTIME_DIR/@name.flight on SIGUSR1, from the default
+ * main context */
+void     flight_recorder_watch_signal  (const gchar     *name);
+
+G_END_DECLS
+
+#endif /* FLIGHT_RECORDER_H */
@@ -0,0 +1,861 @@
+/*
+ * gooroom-policy-broker.c: host-wide policy cache and enforcement
+ *
+ * Copyright (C) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pwd.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+#include <glib-unix.h>
+#include <gio/gio.h>
+
+#include "agent-json.h"
+#include "blacklist-resolve.h"
+#include "exec-gate.h"
+#include "flight-recorder.h"
+#include "policy-broker.h"
+#include "process-registry.h"
+
+#define AGENT_CALL_TIMEOUT_MS       5000
+#define POLICY_CACHE_TTL_S          60
+#define BLACKLIST_ACTION_ID         "kr.gooroom.SessionManager.update-blacklist"
+
+
+static const gchar introspection_xml[] =
+	"<node>"
+	"  <interface name='" POLICY_BROKER_INTERFACE "'>"
+	"    <method name='DoTask'>"
+	"      <arg type='s' name='task_name' direction='in'/>"
+	"      <arg type='s' name='reply' direction='out'/>"
+	"    </method>"
+	"    <method name='UpdateBlacklist'>"
+	"      <arg type='as' name='items' direction='in'/>"
+	"    </method>"
+	"  </interface>"
+	"</node>";
+
+/* the tasks a session manager runs at login */
+static const gchar *broker_tasks[] = {
+	"get_app_list", "get_controlcenter_items", "get_update_operation_with_loginid",
+	"dpms_off_time", "sleep_inactive_time",
+	"set_authority_config", "set_authority_config_local", NULL
+};
+
+/* the ones that only read; the others make the agent act (e.g.
+ * get_update_operation_with_loginid has it signal the operation), so
+ * they are only shared while in flight, never cached */
+static const gchar *cached_tasks[] = {
+	"get_app_list", "get_controlcenter_items",
+	"dpms_off_time", "sleep_inactive_time", NULL
+};
+
+/* One agent answer per login and task */
+typedef struct {
+	gchar    *key;
+	gchar    *task_name;
+	gchar    *login_id;
+	gchar    *reply;
+	gint64    expires_us;
+	GSList   *waiters;      /* GDBusMethodInvocation, newest first */
+	gboolean  in_flight;
+	gboolean  stale;        /* the agent changed policy while in flight */
+} PolicyEntry;
+
+/* The blacklist a connected session manager asked for */
+typedef struct {
+	gchar   *sender;
+	guint32  uid;
+	guint    watch_id;
+	gchar  **items;
+} BlacklistClient;
+
+typedef void (*CallerFunc) (GDBusMethodInvocation *invocation, guint32 uid);
+
+typedef struct {
+	GDBusMethodInvocation *invocation;
+	CallerFunc             func;
+} CallerRequest;
+
+static GMainLoop       *g_main_loop = NULL;
+static GDBusConnection *g_system_bus = NULL;
+static GDBusNodeInfo   *g_introspection = NULL;
+static guint            g_object_id = 0;
+static guint            g_owner_id = 0;
+static guint            g_agent_watch_id = 0;
+static guint            g_agent_signal_id = 0;
+
+static GHashTable      *g_policy_cache = NULL;     /* key -> PolicyEntry */
+static GHashTable      *g_login_names = NULL;      /* uid -> login name */
+
+static GHashTable      *g_blacklist_clients = NULL;  /* sender -> BlacklistClient */
+static gchar          **g_blacklist_applied = NULL;
+static GSList          *g_blacklist_waiters = NULL;
+static GSList          *g_blacklist_running_waiters = NULL;
+static gboolean         g_blacklist_running = FALSE;
+
+/* with --exec-gate, blacklists are enforced per user by fanotify */
+static gboolean         g_use_exec_gate = FALSE;
+static ExecGate        *g_exec_gate = NULL;
+
+static void blacklist_schedule (void);
+
+
+
+static gboolean
+strv_contains (const gchar * const *strv, const gchar *str)
+{
+	for (; strv && *strv; strv++) {
+		if (g_str_equal (*strv, str))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+static gboolean
+strv_equal (gchar **a, gchar **b)
+{
+	for (; *a && *b; a++, b++) {
+		if (!g_str_equal (*a, *b))
+			return FALSE;
+	}
+
+	return (*a == NULL && *b == NULL);
+}
+
+static gint
+compare_strings (gconstpointer a, gconstpointer b)
+{
+	return strcmp (*(const gchar **)a, *(const gchar **)b);
+}
+
+/* Resolved once per uid; the first lookup of a network user may block */
+static const gchar *
+login_name_for_uid (guint32 uid)
+{
+	gchar *name;
+	gchar buf[4096];
+	struct passwd pwd, *result = NULL;
+
+	name = g_hash_table_lookup (g_login_names, GUINT_TO_POINTER (uid));
+	if (name)
+		return name;
+
+	if (getpwuid_r (uid, &pwd, buf, sizeof (buf), &result) != 0 || !result)
+		return NULL;
+
+	name = g_strdup (result->pw_name);
+	g_hash_table_insert (g_login_names, GUINT_TO_POINTER (uid), name);
+
+	return name;
+}
+
+static void
+policy_entry_free (gpointer data)
+{
+	PolicyEntry *entry = (PolicyEntry *)data;
+
+	g_free (entry->key);
+	g_free (entry->task_name);
+	g_free (entry->login_id);
+	g_free (entry->reply);
+	g_free (entry);
+}
+
+static void
+policy_cache_flush (void)
+{
+	GHashTableIter iter;
+	gpointer value;
+
+	if (!g_policy_cache)
+		return;
+
+	g_hash_table_iter_init (&iter, g_policy_cache);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		PolicyEntry *entry = (PolicyEntry *)value;
+		if (entry->in_flight)
+			entry->stale = TRUE;
+		else
+			g_hash_table_iter_remove (&iter);
+	}
+}
+
+static void
+agent_reply_cb (GObject      *source_object,
+                GAsyncResult *res,
+                gpointer      user_data)
+{
+	GSList *l;
+	gchar *reply = NULL;
+	GVariant *ret, *v = NULL;
+	GError *error = NULL;
+	PolicyEntry *entry = (PolicyEntry *)user_data;
+
+	ret = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source_object), res, &error);
+	if (ret) {
+		g_variant_get (ret, "(v)", &v);
+		if (g_variant_is_of_type (v, G_VARIANT_TYPE_STRING))
+			reply = g_variant_dup_string (v, NULL);
+		else
+			g_set_error (&error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_SIGNATURE,
+                         "Unexpected reply from Gooroom Agent Service");
+		g_variant_unref (v);
+		g_variant_unref (ret);
+	}
+
+	entry->waiters = g_slist_reverse (entry->waiters);
+	for (l = entry->waiters; l; l = l->next) {
+		GDBusMethodInvocation *invocation = G_DBUS_METHOD_INVOCATION (l->data);
+		if (reply)
+			g_dbus_method_invocation_return_value (invocation, g_variant_new ("(s)", reply));
+		else
+			g_dbus_method_invocation_return_gerror (invocation, error);
+	}
+	g_slist_free (entry->waiters);
+	entry->waiters = NULL;
+	entry->in_flight = FALSE;
+
+	if (error) {
+		flight_record_error (FLIGHT_EVENT_ERROR, entry->task_name, error);
+		g_debug ("do_task %s for %s failed: %s", entry->task_name, entry->login_id, error->message);
+	}
+	g_clear_error (&error);
+
+	if (reply && !entry->stale && strv_contains (cached_tasks, entry->task_name)) {
+		g_free (entry->reply);
+		entry->reply = reply;
+		entry->expires_us = g_get_monotonic_time () + POLICY_CACHE_TTL_S * G_USEC_PER_SEC;
+	} else {
+		g_free (reply);
+		g_hash_table_remove (g_policy_cache, entry->key);
+	}
+}
+
+static void
+do_task (GDBusMethodInvocation *invocation, guint32 uid)
+{
+	gchar *key;
+	const gchar *task_name, *login_id;
+	PolicyEntry *entry;
+
+	g_variant_get (g_dbus_method_invocation_get_parameters (invocation), "(&s)", &task_name);
+
+	login_id = login_name_for_uid (uid);
+	if (!login_id) {
+		g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+                                               "Unknown user %u", uid);
+		return;
+	}
+
+	key = g_strdup_printf ("%s/%s", login_id, task_name);
+	entry = g_hash_table_lookup (g_policy_cache, key);
+
+	if (entry && !entry->in_flight && g_get_monotonic_time () < entry->expires_us) {
+		g_dbus_method_invocation_return_value (invocation, g_variant_new ("(s)", entry->reply));
+		g_free (key);
+		return;
+	}
+
+	if (!entry) {
+		entry = g_new0 (PolicyEntry, 1);
+		entry->key = key;
+		entry->task_name = g_strdup (task_name);
+		entry->login_id = g_strdup (login_id);
+		g_hash_table_insert (g_policy_cache, entry->key, entry);
+	} else {
+		g_free (key);
+	}
+
+	/* sessions of the same user share one request */
+	entry->waiters = g_slist_prepend (entry->waiters, invocation);
+	if (!entry->in_flight) {
+		gchar *request = agent_json_task_request (task_name, login_id);
+
+		entry->in_flight = TRUE;
+		entry->stale = FALSE;
+
+		g_dbus_connection_call (g_system_bus,
+                                "kr.gooroom.agent",
+                                "/kr/gooroom/agent",
+                                "kr.gooroom.agent",
+                                "do_task",
+                                g_variant_new ("(s)", request),
+                                G_VARIANT_TYPE ("(v)"),
+                                G_DBUS_CALL_FLAGS_NO_AUTO_START,
+                                AGENT_CALL_TIMEOUT_MS,
+                                NULL,
+                                agent_reply_cb,
+                                entry);
+		g_free (request);
+	}
+}
+
+static void
+caller_uid_cb (GObject      *source_object,
+               GAsyncResult *res,
+               gpointer      user_data)
+{
+	guint32 uid;
+	GVariant *ret;
+	GError *error = NULL;
+	CallerRequest *request = (CallerRequest *)user_data;
+
+	ret = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source_object), res, &error);
+	if (ret) {
+		g_variant_get (ret, "(u)", &uid);
+		g_variant_unref (ret);
+
+		request->func (request->invocation, uid);
+	} else {
+		flight_record_error (FLIGHT_EVENT_ERROR, "GetConnectionUnixUser", error);
+		g_dbus_method_invocation_take_error (request->invocation, error);
+	}
+
+	g_free (request);
+}
+
+/* Calls @func with the uid of the sender of @invocation */
+static void
+caller_uid_lookup (GDBusMethodInvocation *invocation, CallerFunc func)
+{
+	CallerRequest *request = g_new0 (CallerRequest, 1);
+
+	request->invocation = invocation;
+	request->func = func;
+
+	g_dbus_connection_call (g_system_bus,
+                            "org.freedesktop.DBus",
+                            "/org/freedesktop/DBus",
+                            "org.freedesktop.DBus",
+                            "GetConnectionUnixUser",
+                            g_variant_new ("(s)", g_dbus_method_invocation_get_sender (invocation)),
+                            G_VARIANT_TYPE ("(u)"),
+                            G_DBUS_CALL_FLAGS_NONE,
+                            -1,
+                            NULL,
+                            caller_uid_cb,
+                            request);
+}
+
+static void
+handle_do_task (GDBusMethodInvocation *invocation)
+{
+	const gchar *task_name;
+
+	g_variant_get (g_dbus_method_invocation_get_parameters (invocation), "(&s)", &task_name);
+
+	if (!strv_contains (broker_tasks, task_name)) {
+		g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                                               "Task %s is not handled by the broker", task_name);
+		return;
+	}
+
+	/* the login id is that of the caller, not what the caller claims */
+	caller_uid_lookup (invocation, do_task);
+}
+
+static void
+blacklist_client_free (gpointer data)
+{
+	BlacklistClient *client = (BlacklistClient *)data;
+
+	if (client->watch_id)
+		g_bus_unwatch_name (client->watch_id);
+	g_strfreev (client->items);
+	g_free (client->sender);
+	g_free (client);
+}
+
+/* The blacklist of every connected session, sorted and without duplicates */
+static gchar **
+blacklist_union (void)
+{
+	guint i, n = 0;
+	gchar **ret;
+	gpointer value, *keys;
+	GHashTable *set;
+	GHashTableIter iter;
+
+	set = g_hash_table_new (g_str_hash, g_str_equal);
+
+	g_hash_table_iter_init (&iter, g_blacklist_clients);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		BlacklistClient *client = (BlacklistClient *)value;
+		for (i = 0; client->items[i]; i++) {
+			if (client->items[i][0] != '\0')
+				g_hash_table_add (set, client->items[i]);
+		}
+	}
+
+	keys = g_hash_table_get_keys_as_array (set, &n);
+	qsort (keys, n, sizeof (gpointer), compare_strings);
+
+	ret = g_new0 (gchar *, n + 1);
+	for (i = 0; i < n; i++)
+		ret[i] = g_strdup (keys[i]);
+
+	g_free (keys);
+	g_hash_table_destroy (set);
+
+	return ret;
+}
+
+static void
+blacklist_reply (GSList *waiters, const GError *error)
+{
+	GSList *l;
+
+	for (l = waiters; l; l = l->next) {
+		GDBusMethodInvocation *invocation = G_DBUS_METHOD_INVOCATION (l->data);
+		if (error)
+			g_dbus_method_invocation_return_gerror (invocation, error);
+		else
+			g_dbus_method_invocation_return_value (invocation, NULL);
+	}
+
+	g_slist_free (waiters);
+}
+
+static void
+blacklist_helper_exit_cb (const gchar *name, GPid pid, gint status, gpointer user_data)
+{
+	gchar **items = (gchar **)user_data;
+	GError *error = NULL;
+
+	g_blacklist_running = FALSE;
+
+	if (g_spawn_check_exit_status (status, &error)) {
+		g_strfreev (g_blacklist_applied);
+		g_blacklist_applied = items;
+	} else {
+		g_warning ("Blacklist helper failed: %s", error->message);
+		g_strfreev (items);
+	}
+
+	blacklist_reply (g_slist_reverse (g_blacklist_running_waiters), error);
+	g_blacklist_running_waiters = NULL;
+	g_clear_error (&error);
+
+	/* requests that came in meanwhile */
+	blacklist_schedule ();
+}
+
+/* Per-user enforcement: the binaries of every session's blacklist are
+ * blocked for the uid of that session only, and nothing is written. */
+static void
+blacklist_gate_apply (void)
+{
+	guint i;
+	gpointer value;
+	GList *all_apps;
+	GHashTable *binaries;
+	GHashTableIter iter;
+	ExecGatePolicy *policy;
+
+	all_apps = g_app_info_get_all ();
+	binaries = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_free);
+	policy = exec_gate_policy_new ();
+
+	g_hash_table_iter_init (&iter, g_blacklist_clients);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		BlacklistClient *client = (BlacklistClient *)value;
+
+		for (i = 0; client->items[i]; i++) {
+			gchar *path;
+			const gchar *item = client->items[i];
+
+			if (item[0] == '\0')
+				continue;
+
+			/* sessions mostly share their entries, resolve each once */
+			if (!g_hash_table_lookup_extended (binaries, item, NULL, (gpointer *) &path)) {
+				gchar *desktop = blacklist_resolve_desktop (all_apps, item);
+
+				path = NULL;
+				if (desktop && !g_str_has_suffix (desktop, "gooroomupdate.desktop"))
+					path = blacklist_resolve_binary (desktop);
+				g_hash_table_insert (binaries, (gpointer) item, path);
+				g_free (desktop);
+			}
+
+			if (path)
+				exec_gate_policy_add (policy, path, client->uid);
+		}
+	}
+
+	g_debug ("Exec gate guards %u binaries", exec_gate_policy_size (policy));
+
+	exec_gate_set_policy (g_exec_gate, policy);
+
+	g_hash_table_destroy (binaries);
+	g_list_free_full (all_apps, g_object_unref);
+}
+
+/* One helper run at a time, and only when the effective blacklist of the
+ * host changed: sessions with the same policy do not cause extra runs. */
+static void
+blacklist_schedule (void)
+{
+	guint i;
+	gchar **items;
+	GPtrArray *argv;
+	GError *error = NULL;
+
+	if (g_exec_gate) {
+		blacklist_gate_apply ();
+		blacklist_reply (g_slist_reverse (g_blacklist_waiters), NULL);
+		g_blacklist_waiters = NULL;
+		return;
+	}
+
+	if (g_blacklist_running)
+		return;
+
+	items = blacklist_union ();
+
+	if (g_blacklist_applied && strv_equal (items, g_blacklist_applied)) {
+		blacklist_reply (g_slist_reverse (g_blacklist_waiters), NULL);
+		g_blacklist_waiters = NULL;
+		g_strfreev (items);
+		return;
+	}
+
+	argv = g_ptr_array_new ();
+	g_ptr_array_add (argv, GOOROOM_UPDATE_BLACKLIST_HELPER);
+	for (i = 0; items[i]; i++)
+		g_ptr_array_add (argv, items[i]);
+	g_ptr_array_add (argv, NULL);
+
+	g_blacklist_running_waiters = g_blacklist_waiters;
+	g_blacklist_waiters = NULL;
+
+	if (process_registry_spawn ("gooroom-update-blacklist-helper", (gchar **) argv->pdata,
+                                PROCESS_FLAGS_BACKGROUND, blacklist_helper_exit_cb, items, &error)) {
+		g_blacklist_running = TRUE;
+	} else {
+		g_warning ("Failed to run blacklist helper: %s", error->message);
+		blacklist_reply (g_slist_reverse (g_blacklist_running_waiters), error);
+		g_blacklist_running_waiters = NULL;
+		g_error_free (error);
+		g_strfreev (items);
+	}
+
+	g_ptr_array_free (argv, TRUE);
+}
+
+static void
+blacklist_client_vanished_cb (GDBusConnection *connection,
+                              const gchar     *name,
+                              gpointer         user_data)
+{
+	/* a closed session no longer holds its entries */
+	g_hash_table_remove (g_blacklist_clients, name);
+
+	blacklist_schedule ();
+}
+
+static void
+update_blacklist (GDBusMethodInvocation *invocation, guint32 uid)
+{
+	gchar **items;
+	const gchar *sender;
+	BlacklistClient *client;
+
+	sender = g_dbus_method_invocation_get_sender (invocation);
+	g_variant_get (g_dbus_method_invocation_get_parameters (invocation), "(^as)", &items);
+
+	client = g_hash_table_lookup (g_blacklist_clients, sender);
+	if (!client) {
+		client = g_new0 (BlacklistClient, 1);
+		client->sender = g_strdup (sender);
+		g_hash_table_insert (g_blacklist_clients, client->sender, client);
+		client->watch_id = g_bus_watch_name_on_connection (g_system_bus, sender,
+                                                           G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                                           NULL, blacklist_client_vanished_cb,
+                                                           NULL, NULL);
+	}
+
+	g_strfreev (client->items);
+	client->items = items;
+	client->uid = uid;
+
+	g_blacklist_waiters = g_slist_prepend (g_blacklist_waiters, invocation);
+
+	blacklist_schedule ();
+}
+
+static void
+authorization_cb (GObject      *source_object,
+                  GAsyncResult *res,
+                  gpointer      user_data)
+{
+	GVariant *ret;
+	GError *error = NULL;
+	gboolean authorized = FALSE;
+	GDBusMethodInvocation *invocation = G_DBUS_METHOD_INVOCATION (user_data);
+
+	ret = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source_object), res, &error);
+	if (!ret) {
+		flight_record_error (FLIGHT_EVENT_ERROR, "CheckAuthorization", error);
+		g_dbus_method_invocation_take_error (invocation, error);
+		return;
+	}
+
+	g_variant_get (ret, "((bb@a{ss}))", &authorized, NULL, NULL);
+	g_variant_unref (ret);
+
+	if (!authorized) {
+		g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR, G_DBUS_ERROR_ACCESS_DENIED,
+                                               "Not authorized to update the blacklist");
+		return;
+	}
+
+	caller_uid_lookup (invocation, update_blacklist);
+}
+
+/* Same polkit action the pkexec'ed helper is covered by */
+static void
+handle_update_blacklist (GDBusMethodInvocation *invocation)
+{
+	GVariantBuilder subject, details;
+
+	g_variant_builder_init (&subject, G_VARIANT_TYPE ("a{sv}"));
+	g_variant_builder_add (&subject, "{sv}", "name",
+                           g_variant_new_string (g_dbus_method_invocation_get_sender (invocation)));
+	g_variant_builder_init (&details, G_VARIANT_TYPE ("a{ss}"));
+
+	g_dbus_connection_call (g_system_bus,
+                            "org.freedesktop.PolicyKit1",
+                            "/org/freedesktop/PolicyKit1/Authority",
+                            "org.freedesktop.PolicyKit1.Authority",
+                            "CheckAuthorization",
+                            g_variant_new ("((sa{sv})sa{ss}us)",
+                                           "system-bus-name", &subject,
+                                           BLACKLIST_ACTION_ID, &details,
+                                           1, /* AllowUserInteraction */
+                                           ""),
+                            G_VARIANT_TYPE ("((bba{ss}))"),
+                            G_DBUS_CALL_FLAGS_NONE,
+                            G_MAXINT,
+                            NULL,
+                            authorization_cb,
+                            invocation);
+}
+
+static void
+handle_method_call (GDBusConnection       *connection,
+                    const gchar           *sender,
+                    const gchar           *object_path,
+                    const gchar           *interface_name,
+                    const gchar           *method_name,
+                    GVariant              *parameters,
+                    GDBusMethodInvocation *invocation,
+                    gpointer               user_data)
+{
+	if (g_str_equal (method_name, "DoTask"))
+		handle_do_task (invocation);
+	else if (g_str_equal (method_name, "UpdateBlacklist"))
+		handle_update_blacklist (invocation);
+}
+
+static const GDBusInterfaceVTable interface_vtable = {
+	handle_method_call,
+	NULL,
+	NULL
+};
+
+static void
+agent_signal_cb (GDBusConnection *connection,
+                 const gchar     *sender_name,
+                 const gchar     *object_path,
+                 const gchar     *interface_name,
+                 const gchar     *signal_name,
+                 GVariant        *parameters,
+                 gpointer         user_data)
+{
+	/* every agent signal announces a policy change */
+	policy_cache_flush ();
+}
+
+static void
+agent_name_owner_changed_cb (GDBusConnection *connection,
+                             const gchar     *name,
+                             const gchar     *name_owner,
+                             gpointer         user_data)
+{
+	policy_cache_flush ();
+}
+
+static void
+agent_name_vanished_cb (GDBusConnection *connection,
+                        const gchar     *name,
+                        gpointer         user_data)
+{
+	policy_cache_flush ();
+}
+
+static void
+name_lost_handler (GDBusConnection *connection,
+                   const gchar     *name,
+                   gpointer         user_data)
+{
+	g_warning ("Name taken or bus went away - shutting down");
+
+	g_main_loop_quit (g_main_loop);
+}
+
+static gboolean
+quit_signal_cb (gpointer data)
+{
+	g_main_loop_quit (g_main_loop);
+
+	return G_SOURCE_CONTINUE;
+}
+
+/* What the chmod enforcement of the broker revoked is given back when
+ * the exec gate takes over. */
+static void
+blacklist_helper_restore (void)
+{
+	GError *error = NULL;
+	gchar *argv[] = { GOOROOM_UPDATE_BLACKLIST_HELPER, NULL };
+
+	if (!process_registry_spawn ("gooroom-update-blacklist-helper", argv,
+                                 PROCESS_FLAGS_BACKGROUND, NULL, NULL, &error)) {
+		g_warning ("Failed to run blacklist helper: %s", error->message);
+		g_error_free (error);
+	}
+}
+
+int
+main (int argc, char **argv)
+{
+	GError *error = NULL;
+	GOptionContext *context;
+	GOptionEntry entries[] = {
+		{ "exec-gate", 0, 0, G_OPTION_ARG_NONE, &g_use_exec_gate,
+		  "Block blacklisted binaries per user with fanotify instead of file modes", NULL },
+		{ NULL }
+	};
+
+	context = g_option_context_new (NULL);
+	g_option_context_add_main_entries (context, entries, NULL);
+	if (!g_option_context_parse (context, &argc, &argv, &error)) {
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		g_option_context_free (context);
+		return 1;
+	}
+	g_option_context_free (context);
+
+	g_system_bus = g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL, &error);
+	if (!g_system_bus) {
+		g_warning ("Failed to connect to the system bus: %s", error->message);
+		g_error_free (error);
+		return 1;
+	}
+
+	g_main_loop = g_main_loop_new (NULL, FALSE);
+
+	g_unix_signal_add (SIGTERM, quit_signal_cb, NULL);
+	g_unix_signal_add (SIGINT, quit_signal_cb, NULL);
+	flight_recorder_watch_signal ("gooroom-policy-broker");
+
+	process_registry_init (NULL);
+	process_registry_set_scope_bus (G_BUS_TYPE_SYSTEM);
+
+	if (g_use_exec_gate) {
+		g_exec_gate = exec_gate_new (&error);
+		if (g_exec_gate) {
+			blacklist_helper_restore ();
+		} else {
+			g_warning ("Exec gate is not available, using file modes: %s", error->message);
+			g_clear_error (&error);
+		}
+	}
+
+	g_policy_cache = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, policy_entry_free);
+	g_login_names = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+	g_blacklist_clients = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, blacklist_client_free);
+
+	g_introspection = g_dbus_node_info_new_for_xml (introspection_xml, NULL);
+	g_object_id = g_dbus_connection_register_object (g_system_bus,
+                                                     POLICY_BROKER_PATH,
+                                                     g_introspection->interfaces[0],
+                                                     &interface_vtable,
+                                                     NULL, NULL, &error);
+	if (!g_object_id) {
+		g_warning ("Failed to register %s: %s", POLICY_BROKER_PATH, error->message);
+		g_error_free (error);
+		return 1;
+	}
+
+	g_agent_signal_id = g_dbus_connection_signal_subscribe (g_system_bus,
+                                                            "kr.gooroom.agent",
+                                                            "kr.gooroom.agent",
+                                                            NULL,
+                                                            "/kr/gooroom/agent",
+                                                            NULL,
+                                                            G_DBUS_SIGNAL_FLAGS_NONE,
+                                                            agent_signal_cb,
+                                                            NULL, NULL);
+
+	/* a restarted agent may answer differently */
+	g_agent_watch_id = g_bus_watch_name_on_connection (g_system_bus,
+                                                       "kr.gooroom.agent",
+                                                       G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                                       agent_name_owner_changed_cb,
+                                                       agent_name_vanished_cb,
+                                                       NULL, NULL);
+
+	g_owner_id = g_bus_own_name_on_connection (g_system_bus,
+                                               POLICY_BROKER_NAME,
+                                               G_BUS_NAME_OWNER_FLAGS_NONE,
+                                               NULL,
+                                               name_lost_handler,
+                                               NULL, NULL);
+
+	g_main_loop_run (g_main_loop);
+
+	g_bus_unown_name (g_owner_id);
+	g_bus_unwatch_name (g_agent_watch_id);
+	g_dbus_connection_signal_unsubscribe (g_system_bus, g_agent_signal_id);
+	g_dbus_connection_unregister_object (g_system_bus, g_object_id);
+
+	g_hash_table_destroy (g_blacklist_clients);
+	exec_gate_free (g_exec_gate);
+	g_hash_table_destroy (g_login_names);
+	g_hash_table_destroy (g_policy_cache);
+	g_strfreev (g_blacklist_applied);
+
+	process_registry_shutdown ();
+
+	g_dbus_node_info_unref (g_introspection);
+	g_object_unref (g_system_bus);
+	g_main_loop_unref (g_main_loop);
+
+	return 0;
+}
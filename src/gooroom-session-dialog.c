@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * The session manager runs without a display connection; the only window
+ * it ever shows lives in this helper, so GTK is loaded on demand.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <locale.h>
+
+#include <glib/gi18n.h>
+#include <gtk/gtk.h>
+
+
+static void
+dialog_response_cb (GtkDialog *dialog, gint response_id, gpointer data)
+{
+	gtk_widget_destroy (GTK_WIDGET (dialog));
+	gtk_main_quit ();
+}
+
+int
+main (int argc, char **argv)
+{
+	GtkWidget *message;
+
+	setlocale (LC_ALL, "");
+	bindtextdomain (GETTEXT_PACKAGE, GNOMELOCALEDIR);
+	bind_textdomain_codeset (GETTEXT_PACKAGE, "UTF-8");
+	textdomain (GETTEXT_PACKAGE);
+
+	gtk_init (&argc, &argv);
+
+	message = gtk_message_dialog_new (NULL,
+                                      GTK_DIALOG_MODAL,
+                                      GTK_MESSAGE_ERROR,
+                                      GTK_BUTTONS_OK,
+                                      NULL);
+
+	gtk_message_dialog_format_secondary_text (GTK_MESSAGE_DIALOG (message),
+			_("Could not found user's settings file.\nAfter 10 seconds, the user will be logged out."));
+
+	gtk_window_set_title (GTK_WINDOW (message), _("Terminating Session"));
+
+	g_signal_connect (message, "response", G_CALLBACK (dialog_response_cb), NULL);
+
+	gtk_widget_show (message);
+
+	gtk_main ();
+
+	return 0;
+}
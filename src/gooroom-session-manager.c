@@ -24,101 +24,415 @@
 #include <string.h>
 #include <locale.h>
 #include <libintl.h>
-#include <pwd.h>
+#include <signal.h>
+#include <unistd.h>
 #include <sys/stat.h>
 
-#include <dbus/dbus.h>
 #include <json-c/json.h>
-#include <polkit/polkit.h>
 
 #include <glib.h>
-#include <gtk/gtk.h>
 #include <glib/gi18n.h>
 #include <glib/gstdio.h>
-#include <gio/gdesktopappinfo.h>
-
-#include <libnotify/notify.h>
+#include <glib-unix.h>
+#include <gio/gio.h>
+#include <gio/gunixfdlist.h>
 
 #include "panel-glib.h"
+#include "notification-queue.h"
+#include "root-paths.h"
+#include "process-registry.h"
+#include "task-graph.h"
+#include "session-identity.h"
+#include "scratch-arena.h"
+#include "agent-json.h"
+#include "policy-broker.h"
+#include "blacklist-resolve.h"
+#include "blacklist-snapshot.h"
+#include "metrics.h"
+#include "trace.h"
+#include "flight-recorder.h"
+#include "probes.h"
+#include "loop-monitor.h"
 
 #define	GRM_USER		        ".grm-user"
 #define	BACKGROUND_PATH         "/usr/share/backgrounds/gooroom/"
 #define	DEFAULT_BACKGROUND      "/usr/share/images/desktop-base/desktop-background.xml"
 #define GCSR_CONF               "/etc/gooroom/gooroom-client-server-register/gcsr.conf"
-
+#define GRAC_PACTL              "/usr/bin/grac-pactl.py"
+#define PKEXEC                  "/usr/bin/pkexec"
+
+#define LOGIN_GRAPH_THREADS     2
+#define AGENT_GRAPH_THREADS     3
+
+#define AGENT_CALL_TIMEOUT_MS   5000
+#define AGENT_LOGIN_BUDGET_MS   15000
+#define AGENT_RETRY_MAX         5
+#define AGENT_RETRY_DELAY_S     2
+#define AGENT_RETRY_DELAY_MAX_S 60
+#define AGENT_DEBOUNCE_MS       500
+
+/* the helper scales with the number of applications, a broker taking
+ * longer than this is stuck and the blacklist is applied without it */
+#define BROKER_BLACKLIST_TIMEOUT_MS 30000
+
+#define SCRATCH_ARENA_SIZE      4096
+
+#define GOOROOM_UPDATER         "/usr/lib/gooroom/gooroomUpdate/gooroomUpdate.py"
+
+#define SESSION_MANAGER_PATH                "/kr/gooroom/SessionManager"
+#define SESSION_MANAGER_BLACKLIST_INTERFACE "kr.gooroom.SessionManager.Blacklist"
+#define SESSION_MANAGER_METRICS_INTERFACE   "kr.gooroom.SessionManager.Metrics"
+
+static const gchar introspection_xml[] =
+	"<node>"
+	"  <interface name='" SESSION_MANAGER_BLACKLIST_INTERFACE "'>"
+	"    <method name='GetSnapshot'>"
+	"      <arg type='h' name='snapshot' direction='out'/>"
+	"      <arg type='t' name='generation' direction='out'/>"
+	"    </method>"
+	"    <signal name='SnapshotChanged'>"
+	"      <arg type='t' name='generation'/>"
+	"    </signal>"
+	"  </interface>"
+	"  <interface name='" SESSION_MANAGER_METRICS_INTERFACE "'>"
+	"    <method name='GetCounters'>"
+	"      <arg type='a(sst)' name='counters' direction='out'/>"
+	"    </method>"
+	"    <method name='GetHistograms'>"
+	"      <arg type='at' name='bounds' direction='out'/>"
+	"      <arg type='a(ssttat)' name='histograms' direction='out'/>"
+	"    </method>"
+	"    <method name='DumpFlightRecorder'>"
+	"      <arg type='s' name='events' direction='out'/>"
+	"    </method>"
+	"  </interface>"
+	"</node>";
+
+/* Files the session manager reads or runs, below $GOOROOM_SESSION_MANAGER_ROOT
+ * if that is set, so that it can run unprivileged against a scratch tree */
+static struct {
+	gchar *background_path;
+	gchar *default_background;
+	gchar *gcsr_conf;
+	gchar *grac_pactl;
+	gchar *pkexec;
+	gchar *grac_reload_helper;
+	gchar *update_blacklist_helper;
+	gchar *session_dialog;
+} g_paths;
+
+static const RootPath g_root_paths[] = {
+	{ &g_paths.background_path, BACKGROUND_PATH },
+	{ &g_paths.default_background, DEFAULT_BACKGROUND },
+	{ &g_paths.gcsr_conf, GCSR_CONF },
+	{ &g_paths.grac_pactl, GRAC_PACTL },
+	{ &g_paths.pkexec, PKEXEC },
+	{ &g_paths.grac_reload_helper, GRAC_RELOAD_HELPER },
+	{ &g_paths.update_blacklist_helper, GOOROOM_UPDATE_BLACKLIST_HELPER },
+	{ &g_paths.session_dialog, GOOROOM_SESSION_DIALOG }
+};
 
 static GSettings  *g_blacklist_settings = NULL;
 static GSettings  *g_whitelist_settings = NULL;
-static GDBusProxy *g_grac_proxy = NULL;
-static GDBusProxy *g_agent_proxy = NULL;
+static gboolean    g_blacklist_has_key = FALSE;
+static gboolean    g_whitelist_has_key = FALSE;
+static GDBusConnection *g_system_bus = NULL;
+static GDBusConnection *g_session_bus = NULL;
 static guint g_gda_watch_id = 0;
 static guint g_owner_id = 0, g_timeout_id = 0;
-static guint g_agent_signal_id = 0, g_grac_signal_id = 0;
+
+/* only the signals we handle are subscribed to */
+static const gchar *agent_signals[] = {
+	"dpms_on_x_off", "sleep_time", "agent_msg", "update_operation",
+	"app_black_list", "controlcenter_items", NULL
+};
+static const gchar *grac_signals[] = {
+	"grac_letter", "grac_noti", NULL
+};
+static guint g_agent_signal_ids[G_N_ELEMENTS (agent_signals)] = { 0, };
+static guint g_grac_signal_ids[G_N_ELEMENTS (grac_signals)] = { 0, };
 static gboolean g_agent_name_appeared = FALSE;
 
+/* D-Bus subscriptions and policy handling run on their own context/thread,
+ * so that enforcement signals never wait on the notification daemon or a
+ * dialog. Only UI work is marshalled to the default main context. */
+static GMainContext *g_policy_context = NULL;
+static GMainLoop    *g_policy_loop = NULL;
+static GThread      *g_policy_thread = NULL;
+
+/* The session manager itself has no display connection */
+static GMainLoop    *g_main_loop = NULL;
+
+/* How late either loop dispatches, and what held it up */
+static LoopMonitor  *g_policy_monitor = NULL;
+static LoopMonitor  *g_main_monitor = NULL;
+
+/* Temporaries of a signal or settings dispatch on the policy thread,
+ * reset once the dispatch is done. */
+static ScratchArena *g_scratch = NULL;
+
+enum {
+	SETTINGS_WRITE_DPMS_OFF_TIME,
+	SETTINGS_WRITE_SLEEP_INACTIVE_TIME,
+	SETTINGS_WRITE_LIST,
+	SETTINGS_WRITE_THEME
+};
+
+typedef struct {
+	gint    kind;
+	gint32  value;
+	gchar  *list;
+	gchar  *id;
+} SettingsWrite;
+
+/* per-media state of grac-pactl requests */
+typedef struct {
+	gchar    *media;
+	gchar    *applied;
+	gchar    *pending;
+	gboolean  running;
+} MediaControl;
+
+static GHashTable *g_media_controls = NULL;
+
+/* Milestones of the login in monotonic time, 0 until reached. The
+ * policy is enforced once the login tasks and the first agent sync are
+ * done, or the agent turned out not to be running. */
+static struct {
+	gint64   start_us;
+	gint64   bus_name_us;
+	gint64   identity_begin_us;
+	gint64   identity_us;
+	gint64   login_tasks_us;
+	gint64   agent_us;
+	gint64   agent_sync_us;
+	gboolean reported;
+} g_login;
+static GMutex g_login_lock;
+
+static gint64 g_dockbarx_restart_us = 0;
+
+typedef void (*AgentReplyFunc) (const gchar *data, gsize len);
+
+typedef struct {
+	gchar          *task_name;
+	AgentReplyFunc  reply_func;
+	gint64          deadline_us;   /* 0: only the per-call timeout applies */
+	guint           attempt;
+	gint            generation;
+	GCancellable   *cancellable;
+} AgentJob;
+
+/* Every appearance of kr.gooroom.agent is a new incarnation; jobs of an
+ * older one are cancelled and their replies are dropped. */
+static gint          g_agent_generation = 0;
+static GCancellable *g_agent_cancellable = NULL;
+static guint         g_agent_debounce_id = 0;
+static gboolean      g_agent_sync_running = FALSE;
+static gboolean      g_agent_sync_pending = FALSE;
+static gboolean      g_blacklist_handler_blocked = FALSE;
+
+/* set once the host turns out to have no policy broker */
+static gint          g_broker_missing = FALSE;
+
+/* The resolved blacklist as a sealed memfd for desktop components, see
+ * blacklist-snapshot.h. Every change publishes a new one. */
+static GMutex         g_snapshot_lock;
+static gint           g_snapshot_fd = -1;
+static guint64        g_snapshot_generation = 0;
+static GDBusNodeInfo *g_introspection = NULL;
+static guint          g_object_id = 0;
+
+/* Counters and latencies of what the session manager does, read by
+ * fleet tooling over the Metrics interface, see metrics.h */
+static guint          g_metrics_object_id = 0;
+
 static void gooroom_blacklist_settings_changed (GSettings *settings, const gchar *key, gpointer data);
+static void dpms_off_time_update (gint32 value);
+static void sleep_inactive_time_update (gint32 value);
+static void save_settings (const gchar *list, gssize len, const gchar *id);
+static void set_theme (const gchar *theme_idx);
+
+
+
+static gpointer
+policy_thread_func (gpointer data)
+{
+	g_main_context_push_thread_default (g_policy_context);
+	g_main_loop_run (g_policy_loop);
+	g_main_context_pop_thread_default (g_policy_context);
 
+	return NULL;
+}
 
+static void
+start_policy_thread (void)
+{
+	g_policy_context = g_main_context_new ();
+	g_scratch = scratch_arena_new (SCRATCH_ARENA_SIZE);
+	g_policy_loop = g_main_loop_new (g_policy_context, FALSE);
+	g_policy_monitor = loop_monitor_new ("policy", g_policy_context);
+	g_policy_thread = g_thread_new ("gsm-policy", policy_thread_func, NULL);
+}
 
 static void
-show_notification (const gchar *summary, const gchar *message, const gchar *icon)
+stop_policy_thread (void)
 {
-	NotifyNotification *notification;
+	if (g_policy_loop)
+		g_main_loop_quit (g_policy_loop);
 
-	if (!summary)
-		summary = _("Notification");
+	if (g_policy_thread) {
+		g_thread_join (g_policy_thread);
+		g_policy_thread = NULL;
+	}
+
+	g_clear_pointer (&g_policy_monitor, loop_monitor_free);
+	g_clear_pointer (&g_policy_loop, g_main_loop_unref);
+	g_clear_pointer (&g_scratch, scratch_arena_free);
+}
+
+static guint
+policy_idle_add (GSourceFunc func, gpointer data)
+{
+	guint id;
+	GSource *source;
+
+	source = g_idle_source_new ();
+	g_source_set_callback (source, func, data, NULL);
+	id = g_source_attach (source, g_policy_context);
+	g_source_unref (source);
+
+	return id;
+}
+
+static guint
+policy_timeout_add (guint interval, GSourceFunc func, gpointer data)
+{
+	guint id;
+	GSource *source;
+
+	source = g_timeout_source_new (interval);
+	g_source_set_callback (source, func, data, NULL);
+	id = g_source_attach (source, g_policy_context);
+	g_source_unref (source);
+
+	return id;
+}
+
+static void
+policy_source_remove (guint *id)
+{
+	GSource *source;
+
+	if (*id == 0)
+		return;
 
-	notify_init (PACKAGE_NAME);
-	notification = notify_notification_new (summary, message, icon);
+	source = g_main_context_find_source_by_id (g_policy_context, *id);
+	if (source)
+		g_source_destroy (source);
 
-	notify_notification_set_urgency (notification, NOTIFY_URGENCY_NORMAL);
-	notify_notification_set_timeout (notification, NOTIFY_EXPIRES_DEFAULT);
-	notify_notification_show (notification, NULL);
+	*id = 0;
+}
+
+static void
+settings_write_free (gpointer data)
+{
+	SettingsWrite *sw = (SettingsWrite *)data;
 
-	g_object_unref (notification);
+	g_free (sw->list);
+	g_free (sw->id);
+	g_free (sw);
 }
 
 static gboolean
-is_gpms_user (const gchar *username)
+settings_write_dispatch (gpointer data)
 {
-	gboolean ret = FALSE;
+	SettingsWrite *sw = (SettingsWrite *)data;
 
-	struct passwd *entry = getpwnam (username);
-	if (entry) {
-		gchar **tokens = g_strsplit (entry->pw_gecos, ",", -1);
-		if (g_strv_length (tokens) > 4 ) {
-			if (tokens[4] && (g_strcmp0 (tokens[4], "gooroom-account") == 0)) {
-				ret = TRUE;
-			}
-		}
-		g_strfreev (tokens);
+	loop_monitor_enter ("settings-write");
+
+	switch (sw->kind) {
+		case SETTINGS_WRITE_DPMS_OFF_TIME:
+			dpms_off_time_update (sw->value);
+		break;
+
+		case SETTINGS_WRITE_SLEEP_INACTIVE_TIME:
+			sleep_inactive_time_update (sw->value);
+		break;
+
+		case SETTINGS_WRITE_LIST:
+			save_settings (sw->list, -1, sw->id);
+			scratch_arena_reset (g_scratch);
+		break;
+
+		case SETTINGS_WRITE_THEME:
+			set_theme (sw->list);
+		break;
+
+		default:
+		break;
 	}
 
-	return ret;
+	loop_monitor_leave ();
+
+	return FALSE;
+}
+
+/* GSettings objects emit their signals on the policy context, so writes
+ * coming from worker threads are marshalled there. */
+static void
+queue_settings_write (gint kind, gint32 value, const gchar *list, const gchar *id)
+{
+	SettingsWrite *sw = g_new0 (SettingsWrite, 1);
+
+	sw->kind = kind;
+	sw->value = value;
+	sw->list = g_strdup (list);
+	sw->id = g_strdup (id);
+
+	g_main_context_invoke_full (g_policy_context, G_PRIORITY_DEFAULT,
+                                settings_write_dispatch, sw, settings_write_free);
+}
+
+static gchar *
+grac_burst_message (guint count)
+{
+	return g_strdup_printf (ngettext ("%u device event", "%u device events", count), count);
+}
+
+static gchar *
+agent_burst_message (guint count)
+{
+	return g_strdup_printf (ngettext ("%u message", "%u messages", count), count);
+}
+
+static void
+show_notification (const gchar *category, const gchar *summary, const gchar *message, const gchar *icon)
+{
+	if (!summary)
+		summary = _("Notification");
+
+	notification_queue_push (category, summary, message, icon);
 }
 
 static gboolean
 get_object_path (gchar **object_path, const gchar *service_name)
 {
-	GVariant   *variant;
-	GDBusProxy *proxy;
-	GError     *error = NULL;
-
-	proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
-			G_DBUS_CALL_FLAGS_NONE, NULL,
-			"org.freedesktop.systemd1",
-			"/org/freedesktop/systemd1",
-			"org.freedesktop.systemd1.Manager",
-			NULL, &error);
+	GVariant *variant;
+	GError   *error = NULL;
 
-	if (!proxy) {
-		g_error_free (error);
+	if (!g_system_bus)
 		return FALSE;
-	}
 
-	variant = g_dbus_proxy_call_sync (proxy, "GetUnit",
-			g_variant_new ("(s)", service_name),
-			G_DBUS_CALL_FLAGS_NONE, -1, NULL, &error);
+	variant = g_dbus_connection_call_sync (g_system_bus,
+                                           "org.freedesktop.systemd1",
+                                           "/org/freedesktop/systemd1",
+                                           "org.freedesktop.systemd1.Manager",
+                                           "GetUnit",
+                                           g_variant_new ("(s)", service_name),
+                                           G_VARIANT_TYPE ("(o)"),
+                                           G_DBUS_CALL_FLAGS_NO_AUTO_START,
+                                           -1, NULL, &error);
 
 	if (!variant) {
 		g_error_free (error);
@@ -127,8 +441,6 @@ get_object_path (gchar **object_path, const gchar *service_name)
 		g_variant_unref (variant);
 	}
 
-	g_object_unref (proxy);
-
 	return TRUE;
 }
 
@@ -139,7 +451,6 @@ is_systemd_service_active (const gchar *service_name)
 	gboolean ret = FALSE;
 
 	GVariant   *variant;
-	GDBusProxy *proxy;
 	GError     *error = NULL;
 	gchar      *obj_path = NULL;
 
@@ -148,60 +459,35 @@ is_systemd_service_active (const gchar *service_name)
 		goto done;
 	}
 
-	proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
-			G_DBUS_CALL_FLAGS_NONE, NULL,
-			"org.freedesktop.systemd1",
-			obj_path,
-			"org.freedesktop.DBus.Properties",
-			NULL, &error);
-
-	if (!proxy)
-		goto done;
-
-	variant = g_dbus_proxy_call_sync (proxy, "GetAll",
-			g_variant_new ("(s)", "org.freedesktop.systemd1.Unit"),
-			G_DBUS_CALL_FLAGS_NONE, -1, NULL, &error);
+	variant = g_dbus_connection_call_sync (g_system_bus,
+                                           "org.freedesktop.systemd1",
+                                           obj_path,
+                                           "org.freedesktop.DBus.Properties",
+                                           "Get",
+                                           g_variant_new ("(ss)", "org.freedesktop.systemd1.Unit", "ActiveState"),
+                                           G_VARIANT_TYPE ("(v)"),
+                                           G_DBUS_CALL_FLAGS_NO_AUTO_START,
+                                           -1, NULL, &error);
 
 	if (variant) {
-		gchar *output = NULL;
-		GVariant *asv = g_variant_get_child_value(variant, 0);
-		GVariant *value = g_variant_lookup_value(asv, "ActiveState", NULL);
-		if(value && g_variant_is_of_type(value, G_VARIANT_TYPE_STRING)) {
-			output = g_variant_dup_string(value, NULL);
-			if (g_strcmp0 (output, "active") == 0) {
-				ret = TRUE;;
+		GVariant *value = NULL;
+		g_variant_get (variant, "(v)", &value);
+		if (value && g_variant_is_of_type (value, G_VARIANT_TYPE_STRING)) {
+			if (g_strcmp0 (g_variant_get_string (value, NULL), "active") == 0) {
+				ret = TRUE;
 			}
-			g_free (output);
 		}
+		if (value)
+			g_variant_unref (value);
 
 		g_variant_unref (variant);
 	}
 
-	g_object_unref (proxy);
-
 done:
 	if (error)
 		g_error_free (error);
 
-	return ret;
-}
-
-static gboolean
-registered_gpms (void)
-{
-	gchar *glm = NULL;
-	gboolean ret = FALSE;
-	GKeyFile *keyfile = NULL;
-
-	keyfile = g_key_file_new ();
-	if (g_key_file_load_from_file (keyfile, GCSR_CONF, G_KEY_FILE_KEEP_COMMENTS, NULL)) {
-		glm  = g_key_file_get_string (keyfile, "domain", "glm", NULL);
-	}
-
-	ret = (glm != NULL) ? TRUE : FALSE;
-
-	g_free (glm);
-	g_key_file_free (keyfile);
+	g_free (obj_path);
 
 	return ret;
 }
@@ -249,6 +535,9 @@ dpms_off_time_update (gint32 value)
 	settings = g_settings_new ("org.gnome.desktop.session");
 	g_settings_set_uint (settings, "idle-delay", val);
 	g_object_unref (settings);
+
+	metrics_count ("settings_writes", "idle-delay", 1);
+	PROBE1 (settings_write, "idle-delay");
 }
 
 static void
@@ -268,92 +557,9 @@ sleep_inactive_time_update (gint32 value)
 	g_settings_set_enum (settings, "sleep-inactive-battery-type", 1);
 
 	g_object_unref (settings);
-}
-
-static GDBusProxy *
-proxy_get (const char *id)
-{
-	GDBusProxy *proxy = NULL;
-
-	if (g_str_equal (id, "agent")) {
-		proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
-				G_DBUS_CALL_FLAGS_NONE,
-				NULL,
-				"kr.gooroom.agent",
-				"/kr/gooroom/agent",
-				"kr.gooroom.agent",
-				NULL,
-				NULL);
-	} else if (g_str_equal (id, "grac")) {
-		proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
-				G_DBUS_CALL_FLAGS_NONE,
-				NULL,
-				"kr.gooroom.GRACDEVD",
-				"/kr/gooroom/GRACDEVD",
-				"kr.gooroom.GRACDEVD",
-				NULL,
-				NULL);
-	} 
-
-	return proxy;
-}
-
-static gchar *
-get_dpms_off_time_from_json (const gchar *data)
-{
-	g_return_val_if_fail (data != NULL, NULL);
-
-	gchar *ret = NULL;
-
-	enum json_tokener_error jerr = json_tokener_success;
-	json_object *root_obj = json_tokener_parse_verbose (data, &jerr);
-
-	if (jerr == json_tokener_success) {
-		json_object *obj1 = NULL, *obj2 = NULL, *obj3 = NULL, *obj4 = NULL;
-		obj1 = JSON_OBJECT_GET (root_obj, "module");
-		obj2 = JSON_OBJECT_GET (obj1, "task");
-		obj3 = JSON_OBJECT_GET (obj2, "out");
-		obj4 = JSON_OBJECT_GET (obj3, "status");
-		if (obj4) {
-			const char *val = json_object_get_string (obj4);
-			if (val && g_strcmp0 (val, "200") == 0) {
-				json_object *obj = JSON_OBJECT_GET (obj3, "screen_time");
-				ret = g_strdup (json_object_get_string (obj));
-			}
-		}
-		json_object_put (root_obj);
-	}
-
-	return ret;
-}
-
-static gchar *
-get_sleep_inactive_time_from_json (const gchar *data)
-{
-	g_return_val_if_fail (data != NULL, NULL);
-
-	gchar *ret = NULL;
-
-	enum json_tokener_error jerr = json_tokener_success;
-	json_object *root_obj = json_tokener_parse_verbose (data, &jerr);
-
-	if (jerr == json_tokener_success) {
-		json_object *obj1 = NULL, *obj2 = NULL, *obj3 = NULL, *obj4 = NULL;
-		obj1 = JSON_OBJECT_GET (root_obj, "module");
-		obj2 = JSON_OBJECT_GET (obj1, "task");
-		obj3 = JSON_OBJECT_GET (obj2, "out");
-		obj4 = JSON_OBJECT_GET (obj3, "status");
-		if (obj4) {
-			const char *val = json_object_get_string (obj4);
-			if (val && g_strcmp0 (val, "200") == 0) {
-				json_object *obj = JSON_OBJECT_GET (obj3, "sleep_inactive_time");
-				ret = g_strdup (json_object_get_string (obj));
-			}
-		}
-		json_object_put (root_obj);
-	}
 
-	return ret;
+	metrics_count ("settings_writes", "sleep-inactive-timeout", 1);
+	PROBE1 (settings_write, "sleep-inactive-timeout");
 }
 
 static void
@@ -362,26 +568,31 @@ set_theme (const gchar *theme_idx)
 	g_return_if_fail (theme_idx != NULL);
 
 	GSettings *settings;
-	const gchar *icon_theme, *background;
+	gchar *background;
+	const gchar *icon_theme, *background_name;
 
 	if (g_str_equal (theme_idx, "1")) {
 		icon_theme = "Gooroom-Arc";
-		background = BACKGROUND_PATH"gooroom_theme_bg_1.jpg";
+		background_name = "gooroom_theme_bg_1.jpg";
 	} else if (g_str_equal (theme_idx, "2")) {
 		icon_theme = "Gooroom-Faenza";
-		background = BACKGROUND_PATH"gooroom_theme_bg_2.jpg";
+		background_name = "gooroom_theme_bg_2.jpg";
 	} else if (g_str_equal (theme_idx, "3")) {
 		icon_theme = "Gooroom-Papirus";
-		background = BACKGROUND_PATH"gooroom_theme_bg_3.jpg";
+		background_name = "gooroom_theme_bg_3.jpg";
 	} else {
 		icon_theme = "Gooroom-Papirus";
-		background = BACKGROUND_PATH"gooroom_theme_bg_3.jpg";
+		background_name = "gooroom_theme_bg_3.jpg";
 	}
 
-	if (!g_file_test (background, G_FILE_TEST_EXISTS))
-		background = DEFAULT_BACKGROUND;
+	background = g_strconcat (g_paths.background_path, background_name, NULL);
 
-	gchar *bg_file = g_strdup_printf ("file://%s", background);
+	gchar *bg_file;
+	if (g_file_test (background, G_FILE_TEST_EXISTS))
+		bg_file = g_strdup_printf ("file://%s", background);
+	else
+		bg_file = g_strdup_printf ("file://%s", g_paths.default_background);
+	g_free (background);
 
 	settings = g_settings_new ("org.gnome.desktop.interface");
 	g_settings_set_string (settings, "icon-theme", icon_theme);
@@ -395,12 +606,61 @@ set_theme (const gchar *theme_idx)
 	g_settings_set_string (settings, "picture-uri", bg_file);
 	g_object_unref (settings);
 
+	metrics_count ("settings_writes", "theme", 1);
+	PROBE1 (settings_write, "theme");
+
 	g_free (bg_file);
 }
 
+static gint
+login_ms (gint64 milestone_us)
+{
+	return milestone_us ? (gint) ((milestone_us - g_login.start_us) / 1000) : -1;
+}
+
+static void
+login_timeline_report (void)
+{
+	GError *error = NULL;
+
+	/* -1: the agent never appeared */
+	g_message ("Login timeline (ms since start): bus-name=%d identity=%d login-tasks=%d "
+               "agent=%d agent-sync=%d, policy enforced after %d ms",
+               login_ms (g_login.bus_name_us), login_ms (g_login.identity_us),
+               login_ms (g_login.login_tasks_us), login_ms (g_login.agent_us),
+               login_ms (g_login.agent_sync_us),
+               login_ms (MAX (g_login.login_tasks_us, g_login.agent_sync_us)));
+
+	trace_instant ("login", "policy-enforced");
+	if (!trace_write (&error)) {
+		g_warning ("Failed to write the login trace: %s", error->message);
+		g_error_free (error);
+	}
+}
+
+/* Sets @milestone the first time it is reached */
+static void
+login_timeline_mark (gint64 *milestone)
+{
+	gboolean enforced;
+
+	g_mutex_lock (&g_login_lock);
+	if (*milestone == 0)
+		*milestone = g_get_monotonic_time ();
+	enforced = !g_login.reported && g_login.login_tasks_us && g_login.agent_sync_us;
+	if (enforced)
+		g_login.reported = TRUE;
+	g_mutex_unlock (&g_login_lock);
+
+	if (enforced)
+		login_timeline_report ();
+}
+
 static void
 handle_desktop_configuration (void)
 {
+	gint64 begin = trace_now ();
+	gchar *theme_idx = NULL;
 	gchar *data = get_grm_user_data ();
 
 	if (data) {
@@ -412,44 +672,37 @@ handle_desktop_configuration (void)
 			obj2 = JSON_OBJECT_GET (obj1, "desktopInfo");
 			obj2_1 = JSON_OBJECT_GET (obj2, "themeId");
 
-			if (obj2_1) {
-				const char *theme_idx = json_object_get_string (obj2_1);
-
-				/* set icon theme */
-				set_theme (theme_idx);
-			}
+			if (obj2_1)
+				theme_idx = g_strdup (json_object_get_string (obj2_1));
 
 			json_object_put (root_obj);
 		}
 	}
 
 	g_free (data);
+
+	trace_complete ("login", "grm-user", begin, trace_now ());
+
+	/* set icon theme, the login graph runs this on a worker */
+	if (theme_idx)
+		queue_settings_write (SETTINGS_WRITE_THEME, 0, theme_idx, NULL);
+
+	g_free (theme_idx);
 }
 
 static void
-grac_reload_done_cb (GPid pid, gint status, gpointer data)
+grac_reload_done_cb (const gchar *name, GPid pid, gint status, gpointer data)
 {
-	g_print ("Reload Grac Service done cb!!!\n");
-	g_spawn_close_pid (pid);
+	g_debug ("Grac service reloaded, status %d", status);
 }
 
 static void
 reload_grac_service (void)
 {
-	GPid pid;
-	gchar *cmd;
-	gchar **argv; 
-	GError *error = NULL;
-
-	cmd = g_strdup_printf ("/usr/bin/pkexec %s", GRAC_RELOAD_HELPER);
-
-	g_shell_parse_argv (cmd, NULL, &argv, NULL);
+	gchar *argv[] = { g_paths.pkexec, g_paths.grac_reload_helper, NULL };
 
-	if (g_spawn_async (NULL, argv, NULL, G_SPAWN_DO_NOT_REAP_CHILD, NULL, NULL, &pid, NULL))
-		g_child_watch_add (pid, (GChildWatchFunc) grac_reload_done_cb, NULL);
-
-	g_free (cmd);
-	g_strfreev (argv);
+	process_registry_spawn ("grac-reload-helper", argv, PROCESS_FLAGS_BACKGROUND,
+                            grac_reload_done_cb, NULL, NULL);
 }
 
 static void
@@ -459,171 +712,95 @@ gooroom_agent_start_done_cb (GPid pid, gint status, gpointer data)
 }
 
 static void
-set_dpms_off_time (void)
+apply_dpms_off_time (const gchar *data, gsize len)
 {
-	if (!g_agent_proxy)
-		g_agent_proxy = proxy_get ("agent");
-
-	if (g_agent_proxy) {
-		const gchar *json;
-		gchar *arg = NULL, *data = NULL;
-		GVariant *variant = NULL;
-
-		json = "{\"module\":{\"module_name\":\"config\",\"task\":{\"task_name\":\"dpms_off_time\",\"in\":{\"login_id\":\"%s\"}}}}";
-
-		arg = g_strdup_printf (json, g_get_user_name ());
-
-		variant = g_dbus_proxy_call_sync (g_agent_proxy,
-                                          "do_task",
-                                          g_variant_new ("(s)", arg),
-                                          G_DBUS_CALL_FLAGS_NONE, -1,
-                                          NULL, NULL);
-
-		if (variant) {
-			GVariant *v = NULL;
-			g_variant_get (variant, "(v)", &v);
-			if (v) {
-				data = g_variant_dup_string (v, NULL);
-				g_variant_unref (v);
-			}
-			g_variant_unref (variant);
-		}
+	AgentJsonValue value;
 
-		if (data) {
-			gchar *value = get_dpms_off_time_from_json (data);
-			if (value) {
-				dpms_off_time_update (atoi (value));
-			} else {
-				g_warning ("Failed to get dpms_off_time from Gooroom Agent Service");
-			}
-			g_free (value);
-			g_free (data);
-		}
-
-		g_free (arg);
+	if (agent_json_task_output (data, len, "screen_time", &value)) {
+		/* the value is a number, or a string holding one */
+		gchar *str = agent_json_value_dup (&value);
+		queue_settings_write (SETTINGS_WRITE_DPMS_OFF_TIME, atoi (str), NULL, NULL);
+		g_free (str);
+	} else {
+		g_warning ("Failed to get dpms_off_time from Gooroom Agent Service");
 	}
 }
 
 static void
-set_sleep_inactive_time (void)
+apply_sleep_inactive_time (const gchar *data, gsize len)
 {
-	if (!g_agent_proxy)
-		g_agent_proxy = proxy_get ("agent");
-
-	if (g_agent_proxy) {
-		const gchar *json;
-		gchar *arg = NULL, *data = NULL;
-		GVariant *variant = NULL;
-
-		json = "{\"module\":{\"module_name\":\"config\",\"task\":{\"task_name\":\"sleep_inactive_time\",\"in\":{\"login_id\":\"%s\"}}}}";
-
-		arg = g_strdup_printf (json, g_get_user_name ());
-
-		variant = g_dbus_proxy_call_sync (g_agent_proxy,
-                                          "do_task",
-                                          g_variant_new ("(s)", arg),
-                                          G_DBUS_CALL_FLAGS_NONE, -1,
-                                          NULL, NULL);
-
-		if (variant) {
-			GVariant *v = NULL;
-			g_variant_get (variant, "(v)", &v);
-			if (v) {
-				data = g_variant_dup_string (v, NULL);
-				g_variant_unref (v);
-			}
-			g_variant_unref (variant);
-		}
-
-		if (data) {
-			gchar *value = get_sleep_inactive_time_from_json (data);
-			if (value) {
-				sleep_inactive_time_update (atoi (value));
-			} else {
-				g_warning ("Failed to get sleep_inactive_time from Gooroom Agent Service");
-			}
-			g_free (value);
-			g_free (data);
-		}
+	AgentJsonValue value;
 
-		g_free (arg);
+	if (agent_json_task_output (data, len, "sleep_inactive_time", &value)) {
+		gchar *str = agent_json_value_dup (&value);
+		queue_settings_write (SETTINGS_WRITE_SLEEP_INACTIVE_TIME, atoi (str), NULL, NULL);
+		g_free (str);
+	} else {
+		g_warning ("Failed to get sleep_inactive_time from Gooroom Agent Service");
 	}
 }
 
 static void
 do_update_operation (gint32 value)
 {
-	gchar *cmdline = NULL;
-	NotifyNotification *notification;
-
 	const gchar *message = NULL;
 	const gchar *icon = "software-update-available-symbolic";
 	const gchar *summary = _("Update Blocking Function");
 
 	if (value == 0) {
 		message = _("Update blocking function has been disabled.");
-		cmdline = g_find_program_in_path ("gooroom-update-launcher");
+		/* an updater we did not start (e.g. autostarted) counts too */
+		if (!process_registry_is_running ("gooroom-update") &&
+            !process_registry_signal_unregistered (GOOROOM_UPDATER, 0)) {
+			gchar *argv[] = { "gooroom-update-launcher", NULL };
+			/* the launcher forks the updater and exits, the group
+			 * keeps the updater registered */
+			process_registry_spawn ("gooroom-update", argv, PROCESS_FLAGS_NEW_GROUP,
+                                    NULL, NULL, NULL);
+		}
 	} else if (value == 1) {
 		message = _("Update blocking function has been enabled.");
-		gchar *cmd = g_find_program_in_path ("pkill");
-		if (cmd)
-			cmdline = g_strdup_printf ("%s -f '/usr/lib/gooroom/gooroomUpdate/gooroomUpdate.py'", cmd);
-		g_free (cmd);
+		/* the updater the launcher forked is still in its group; one we
+		 * did not start, or that left the group, has to be looked up */
+		if (!process_registry_stop ("gooroom-update", SIGTERM))
+			process_registry_signal_unregistered (GOOROOM_UPDATER, SIGTERM);
 	}
 
-	g_spawn_command_line_async (cmdline, NULL);
-	g_free (cmdline);
-
-	show_notification (summary, message, icon);
+	show_notification ("update", summary, message, icon);
 }
 
+/* Runs on the policy thread, the split list lives in the scratch arena */
 static void
-save_settings (gchar *list, const gchar *id)
+save_settings (const gchar *list, gssize len, const gchar *id)
 {
 	g_return_if_fail (list != NULL);
 
+	gchar **filters;
 	GSettings *settings = NULL;
-	GSettingsSchema *schema = NULL;
-	const gchar *schema_name, *key;
+	const gchar *key;
 
 	if (g_str_equal (id, "black_list")) {
 		key = "blacklist";
-		schema_name = "apps.gooroom-applauncher-applet";
-		settings = g_blacklist_settings;
+		settings = g_blacklist_has_key ? g_blacklist_settings : NULL;
 	} else if (g_str_equal (id, "controlcenter_items")) {
 		key = "whitelist-panels";
-		schema_name = "org.gnome.ControlCenter";
-		settings = g_whitelist_settings;
+		settings = g_whitelist_has_key ? g_whitelist_settings : NULL;
 	} else {
 		key = NULL;
-		schema_name = NULL;
-		settings = NULL;
 	}
 
-	if (!key || !schema_name || !settings)
+	if (!key || !settings)
 		return;
 
-	gchar **filters = g_strsplit (list, ",", -1);
-
-	schema = g_settings_schema_source_lookup (g_settings_schema_source_get_default (),
-                                              schema_name, TRUE);
-
-	if (g_settings_schema_has_key (schema, key))
-		g_settings_set_strv (settings, key, (const char * const *) filters);
+	if (len < 0)
+		len = strlen (list);
 
-	g_strfreev (filters);
+	filters = scratch_arena_split (g_scratch, list, len, ',');
 
-	g_settings_schema_unref (schema);
-}
+	g_settings_set_strv (settings, key, (const char * const *) filters);
 
-static void
-grac_notifications_close (GList *list)
-{
-	GList *l = NULL;
-	for (l = list; l; l = l->next) {
-		NotifyNotification *n = (NotifyNotification *)l->data;
-		if (n) notify_notification_close (n, NULL);
-	}
+	metrics_count ("settings_writes", key, 1);
+	PROBE1 (settings_write, key);
 }
 
 #ifdef GRAC_DEBUG
@@ -632,108 +809,238 @@ grac_notifications_close (GList *list)
 #define GRAC_LOG(fmt, args...) 
 #endif //GRAC_DEBUG
 
+static void media_control_run (MediaControl *mc);
+
 static void
-do_resource_access_control (gchar *data)
+media_control_free (gpointer data)
 {
-	if (!data) {
-		GRAC_LOG ("data is null\n");
+	MediaControl *mc = (MediaControl *)data;
+
+	g_free (mc->media);
+	g_free (mc->applied);
+	g_free (mc->pending);
+	g_free (mc);
+}
+
+static void
+media_control_done_cb (const gchar *name, GPid pid, gint status, gpointer data)
+{
+	MediaControl *mc = (MediaControl *)data;
+
+	mc->running = FALSE;
+
+	if (!g_spawn_check_exit_status (status, NULL))
+		g_clear_pointer (&mc->applied, g_free);
+
+	GRAC_LOG ("%s %s => done(%d)\n", mc->media, mc->applied, status);
+
+	/* run the latest request that arrived while this one was running */
+	if (mc->pending && g_strcmp0 (mc->pending, mc->applied) != 0)
+		media_control_run (mc);
+	else
+		g_clear_pointer (&mc->pending, g_free);
+}
+
+static void
+media_control_run (MediaControl *mc)
+{
+	gchar *argv[] = { g_paths.grac_pactl, mc->media, mc->pending, NULL };
+
+	if (!process_registry_spawn ("grac-pactl", argv, PROCESS_FLAGS_NONE,
+                                 media_control_done_cb, mc, NULL)) {
+		g_clear_pointer (&mc->pending, g_free);
+		return;
+	}
+
+	g_free (mc->applied);
+	mc->applied = mc->pending;
+	mc->pending = NULL;
+	mc->running = TRUE;
+}
+
+static void
+media_control_request (const gchar *media, const gchar *control)
+{
+	MediaControl *mc;
+
+	if (!g_media_controls)
+		g_media_controls = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, media_control_free);
+
+	mc = g_hash_table_lookup (g_media_controls, media);
+	if (!mc) {
+		mc = g_new0 (MediaControl, 1);
+		mc->media = g_strdup (media);
+		g_hash_table_insert (g_media_controls, mc->media, mc);
+	}
+
+	/* a repeated control costs no allocation at all */
+	if (!mc->running && g_strcmp0 (mc->applied, control) == 0) {
+		GRAC_LOG ("%s %s => already applied\n", media, control);
+		g_clear_pointer (&mc->pending, g_free);
 		return;
 	}
 
-	enum json_tokener_error jerr = json_tokener_success;
-	json_object *root_obj = json_tokener_parse_verbose (data, &jerr);
-	if (jerr != json_tokener_success) {
-		GRAC_LOG ("json parsing error(%d)\n", jerr);
+	g_free (mc->pending);
+	mc->pending = g_strdup (control);
+
+	/* one helper per media at a time, the latest request wins */
+	if (mc->running)
+		return;
+
+	media_control_run (mc);
+}
+
+static void
+media_control_reset (void)
+{
+	GHashTableIter iter;
+	gpointer value;
+
+	if (!g_media_controls)
 		return;
+
+	/* forget what was applied, a restarted GRAC resends its state */
+	g_hash_table_iter_init (&iter, g_media_controls);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		MediaControl *mc = (MediaControl *)value;
+		g_clear_pointer (&mc->applied, g_free);
 	}
+}
 
-	json_object *obj_title = JSON_OBJECT_GET (root_obj, "title");
-	if (!obj_title) 
-		goto NO_CARE;
+static void
+do_resource_access_control (const gchar *data, gsize len)
+{
+	AgentJsonValue title, media, control;
 
-	const char *title = json_object_get_string (obj_title);
-	if (!title) 
-		goto NO_CARE;
-	
-	if (g_strcmp0 (title, "media-control") == 0) {
-		json_object *obj_body = JSON_OBJECT_GET (root_obj, "body");
-		if (!obj_body) 
-			goto NO_CARE;
+	if (!data) {
+		GRAC_LOG ("data is null\n");
+		return;
+	}
 
-		json_object *obj_media = JSON_OBJECT_GET (obj_body, "media");
-		json_object *obj_control = JSON_OBJECT_GET (obj_body, "control");
-		if (!obj_media || !obj_control) 
-			goto NO_CARE;
+	if (!agent_json_lookup (data, len, &title, "title", NULL))
+		goto NO_CARE;
 
-		const char *media = json_object_get_string (obj_media);
-		const char *control = json_object_get_string (obj_control);
-		if (!media || !control) 
+	if (agent_json_value_equal (&title, "media-control")) {
+		if (!agent_json_lookup (data, len, &media, "body", "media", NULL) ||
+            !agent_json_lookup (data, len, &control, "body", "control", NULL))
 			goto NO_CARE;
 
-		char *cmd = g_strdup_printf ("/usr/bin/grac-pactl.py %s %s", media, control);
-		g_spawn_command_line_async (cmd, NULL);
-		GRAC_LOG("%s => done\n", cmd);
-		g_free(cmd);
+		media_control_request (agent_json_value_scratch (&media, g_scratch),
+                               agent_json_value_scratch (&control, g_scratch));
 	}
 	else {
 		goto NO_CARE;
 	}
 
-	json_object_put (root_obj);
 	return;
 
 NO_CARE:
-	json_object_put (root_obj);
-	GRAC_LOG ("unknown json-data=%s\n", data);
+	GRAC_LOG ("unknown json-data=%.*s\n", (gint)len, data);
 	return;
 }
 
+/* Returns the string carried by a "(v)" signal argument without copying
+ * it; it stays valid as long as @holder, which the caller unrefs. */
+static const gchar *
+signal_borrow_string (GVariant *parameters, GVariant **holder, gsize *len)
+{
+	GVariant *v;
+
+	*holder = NULL;
+
+	if (!g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(v)")))
+		return NULL;
+
+	g_variant_get_child (parameters, 0, "v", &v);
+	if (!g_variant_is_of_type (v, G_VARIANT_TYPE_STRING)) {
+		g_variant_unref (v);
+		return NULL;
+	}
+
+	*holder = v;
+
+	return g_variant_get_string (v, len);
+}
+
 static void
-grac_signal_cb (GDBusProxy *proxy,
-                gchar *sender_name,
-                gchar *signal_name,
-                GVariant *parameters,
-                gpointer user_data)
+grac_signal_cb (GDBusConnection *connection,
+                const gchar     *sender_name,
+                const gchar     *object_path,
+                const gchar     *interface_name,
+                const gchar     *signal_name,
+                GVariant        *parameters,
+                gpointer         user_data)
 {
-	gchar *data = NULL;
+	gsize len = 0;
 	GVariant *v = NULL;
+	const gchar *data;
+	gboolean handled = FALSE;
+	gint64 end, begin = g_get_monotonic_time ();
 
-	if (g_str_equal (signal_name, "grac_letter")) {
-		g_variant_get (parameters, "(v)", &v);
-		if (v) {
-			data = g_variant_dup_string (v, NULL);
-			g_variant_unref (v);
-		}
+	metrics_count ("signals_received", signal_name, 1);
+	PROBE2 (signal_entry, signal_name, g_variant_get_size (parameters));
+	loop_monitor_enter (signal_name);
 
+	if (g_str_equal (signal_name, "grac_letter")) {
+		data = signal_borrow_string (parameters, &v, &len);
 		if (data) {
-			do_resource_access_control (data);
-			g_free (data);
+			do_resource_access_control (data, len);
+			handled = TRUE;
 		}
 	} else if (g_str_equal (signal_name, "grac_noti")) {
-		g_variant_get (parameters, "(v)", &v);
-		if (v) {
-			data = g_variant_dup_string (v, NULL);
-			g_variant_unref (v);
-		}
-
+		data = signal_borrow_string (parameters, &v, &len);
 		if (data) {
-			gchar **infos = g_strsplit (data, ":", -1);
-			show_notification (_("Gooroom Resource Access Control"), infos[1], "dialog-information");
-			g_strfreev (infos);
-			g_free (data);
+			/* the message is the second ':' separated field */
+			const gchar *message = memchr (data, ':', len);
+			if (message) {
+				const gchar *end;
+
+				message++;
+				end = memchr (message, ':', data + len - message);
+				if (!end)
+					end = data + len;
+
+				show_notification ("grac", _("Gooroom Resource Access Control"),
+                                   scratch_arena_strndup (g_scratch, message, end - message),
+                                   "dialog-information");
+				handled = TRUE;
+			}
 		}
-	} else {
-		return;
 	}
+
+	if (v)
+		g_variant_unref (v);
+
+	scratch_arena_reset (g_scratch);
+
+	end = g_get_monotonic_time ();
+	flight_record (FLIGHT_EVENT_SIGNAL, signal_name, g_variant_get_size (parameters), end - begin);
+	PROBE3 (signal_return, signal_name, end - begin, handled);
+	loop_monitor_leave ();
+
+	if (handled)
+		metrics_observe ("signals_handled", signal_name, end - begin);
 }
 
 static void
-agent_signal_cb (GDBusProxy *proxy,
-                 gchar *sender_name,
-                 gchar *signal_name,
-                 GVariant *parameters,
-                 gpointer user_data)
+agent_signal_cb (GDBusConnection *connection,
+                 const gchar     *sender_name,
+                 const gchar     *object_path,
+                 const gchar     *interface_name,
+                 const gchar     *signal_name,
+                 GVariant        *parameters,
+                 gpointer         user_data)
 {
+	gsize len = 0;
+	GVariant *v = NULL;
+	const gchar *data = NULL;
+	gboolean handled = TRUE;
+	gint64 end, begin = g_get_monotonic_time ();
+
+	metrics_count ("signals_received", signal_name, 1);
+	PROBE2 (signal_entry, signal_name, g_variant_get_size (parameters));
+	loop_monitor_enter (signal_name);
+
 	if (g_str_equal (signal_name, "dpms_on_x_off")) {
 		gint32 value = 0;
 		g_variant_get (parameters, "(i)", &value);
@@ -743,204 +1050,143 @@ agent_signal_cb (GDBusProxy *proxy,
 		g_variant_get (parameters, "(i)", &value);
 		sleep_inactive_time_update (value);
 	} else if (g_str_equal (signal_name, "agent_msg")) {
-		GVariant *v = NULL;
-		gchar *data = NULL;
-		g_variant_get (parameters, "(v)", &v);
-		if (v) {
-			data = g_variant_dup_string (v, NULL);
-			g_variant_unref (v);
-		}
-		if (data) {
-			show_notification (NULL, data, "dialog-information");
-			g_free (data);
-		}
+		data = signal_borrow_string (parameters, &v, &len);
+		if (data)
+			show_notification ("agent", NULL, data, "dialog-information");
+		handled = (data != NULL);
 	} else if (g_str_equal (signal_name, "update_operation")) {
 		gint32 value = -1;
 		g_variant_get (parameters, "(i)", &value);
 		do_update_operation (value);
 	} else if (g_str_equal (signal_name, "app_black_list")) {
-		GVariant *v = NULL;
-		gchar *blacklist = NULL;
-		g_variant_get (parameters, "(v)", &v);
-		if (v) {
-			blacklist = g_variant_dup_string (v, NULL);
-			g_variant_unref (v);
-		}
-		if (blacklist) {
-			save_settings (blacklist, "black_list");
-			g_free (blacklist);
-		}
+		data = signal_borrow_string (parameters, &v, &len);
+		if (data)
+			save_settings (data, len, "black_list");
+		handled = (data != NULL);
 	} else if (g_str_equal (signal_name, "controlcenter_items")) {
-		GVariant *v = NULL;
-		gchar *items = NULL;
-		g_variant_get (parameters, "(v)", &v);
-		if (v) {
-			items = g_variant_dup_string (v, NULL);
-			g_variant_unref (v);
-		}
-		if (items) {
-			save_settings (items, "controlcenter_items");
-			g_free (items);
-		}
+		data = signal_borrow_string (parameters, &v, &len);
+		if (data)
+			save_settings (data, len, "controlcenter_items");
+		handled = (data != NULL);
+	} else {
+		handled = FALSE;
 	}
+
+	if (v)
+		g_variant_unref (v);
+
+	scratch_arena_reset (g_scratch);
+
+	end = g_get_monotonic_time ();
+	flight_record (FLIGHT_EVENT_SIGNAL, signal_name, g_variant_get_size (parameters), end - begin);
+	PROBE3 (signal_return, signal_name, end - begin, handled);
+	loop_monitor_leave ();
+
+	if (handled)
+		metrics_observe ("signals_handled", signal_name, end - begin);
 }
 
 static void
-unbind_grac_signal (void)
+signals_subscribe (guint               *ids,
+                   const gchar * const *signals,
+                   const gchar         *name,
+                   const gchar         *path,
+                   GDBusSignalCallback  callback)
 {
-	if (g_grac_proxy && g_grac_signal_id != 0) {
-		g_signal_handler_disconnect (g_grac_proxy, g_grac_signal_id);
-		g_grac_signal_id = 0;
+	guint i;
+
+	if (!g_system_bus || ids[0] != 0)
+		return;
+
+	/* emitted on the thread-default (policy) context */
+	for (i = 0; signals[i]; i++) {
+		ids[i] = g_dbus_connection_signal_subscribe (g_system_bus,
+                                                     name, name, signals[i], path,
+                                                     NULL, G_DBUS_SIGNAL_FLAGS_NONE,
+                                                     callback, NULL, NULL);
 	}
 }
 
 static void
-bind_grac_signal (void)
+signals_unsubscribe (guint *ids, const gchar * const *signals)
 {
-	if (!g_grac_proxy)
-		g_grac_proxy = proxy_get ("grac");
+	guint i;
 
-	if (g_grac_proxy && g_grac_signal_id == 0) {
-		g_grac_signal_id = g_signal_connect (g_grac_proxy, "g-signal",
-                                             G_CALLBACK (grac_signal_cb), NULL);
+	for (i = 0; signals[i]; i++) {
+		if (ids[i] != 0) {
+			g_dbus_connection_signal_unsubscribe (g_system_bus, ids[i]);
+			ids[i] = 0;
+		}
 	}
 }
 
 static void
-unbind_gooroom_agent_signal (void)
+unbind_grac_signal (void)
 {
-	if (g_agent_proxy && g_agent_signal_id != 0) {
-		g_signal_handler_disconnect (g_agent_proxy, g_agent_signal_id);
-		g_agent_signal_id = 0;
-	}
+	signals_unsubscribe (g_grac_signal_ids, grac_signals);
 }
 
 static void
-bind_gooroom_agent_signal (void)
+bind_grac_signal (void)
 {
-	if (!g_agent_proxy)
-		g_agent_proxy = proxy_get ("agent");
-
-	if (g_agent_proxy && g_agent_signal_id == 0) {
-		g_agent_signal_id = g_signal_connect (g_agent_proxy, "g-signal",
-                                              G_CALLBACK (agent_signal_cb), NULL);
-	}
+	signals_subscribe (g_grac_signal_ids, grac_signals,
+                       "kr.gooroom.GRACDEVD", "/kr/gooroom/GRACDEVD", grac_signal_cb);
 }
 
-static gchar *
-get_list_from_json (const gchar *data, const gchar *property)
-{
-	g_return_val_if_fail (data != NULL, NULL);
-
-	gchar *ret = NULL;
-
-	enum json_tokener_error jerr = json_tokener_success;
-	json_object *root_obj = json_tokener_parse_verbose (data, &jerr);
-
-	if (jerr == json_tokener_success) {
-		json_object *obj1 = NULL, *obj2 = NULL, *obj3 = NULL, *obj4 = NULL;
-		obj1 = JSON_OBJECT_GET (root_obj, "module");
-		obj2 = JSON_OBJECT_GET (obj1, "task");
-		obj3 = JSON_OBJECT_GET (obj2, "out");
-		obj4 = JSON_OBJECT_GET (obj3, "status");
-		if (obj4) {
-			const char *val = json_object_get_string (obj4);
-			if (val && g_strcmp0 (val, "200") == 0) {
-				json_object *obj = JSON_OBJECT_GET (obj3, property);
-				ret = g_strdup (json_object_get_string (obj));
-			}
-		}
-		json_object_put (root_obj);
-	}
-
-	return ret;
+static void
+unbind_gooroom_agent_signal (void)
+{
+	signals_unsubscribe (g_agent_signal_ids, agent_signals);
 }
 
 static void
-set_controlcenter_whitelist (void)
+bind_gooroom_agent_signal (void)
 {
-	if (!g_agent_proxy)
-		g_agent_proxy = proxy_get ("agent");
-
-	if (g_agent_proxy) {
-		const gchar *json;
-		GVariant *variant = NULL;
-		gchar *arg = NULL, *data = NULL;
-
-		json = "{\"module\":{\"module_name\":\"config\",\"task\":{\"task_name\":\"get_controlcenter_items\",\"in\":{\"login_id\":\"%s\"}}}}";
-
-		arg = g_strdup_printf (json, g_get_user_name ());
-
-		variant = g_dbus_proxy_call_sync (g_agent_proxy,
-                                          "do_task",
-                                          g_variant_new ("(s)", arg),
-                                          G_DBUS_CALL_FLAGS_NONE, -1,
-                                          NULL, NULL);
-
-		if (variant) {
-			GVariant *v = NULL;
-			g_variant_get (variant, "(v)", &v);
-			if (v) {
-				data = g_variant_dup_string (v, NULL);
-				g_variant_unref (v);
-			}
-			g_variant_unref (variant);
-		}
+	signals_subscribe (g_agent_signal_ids, agent_signals,
+                       "kr.gooroom.agent", "/kr/gooroom/agent", agent_signal_cb);
+}
 
-		if (data) {
-			gchar *list = get_list_from_json (data, "controlcenter_items");
-			if (list) {
-				save_settings (list, "controlcenter_items");
-				g_free (list);
-			}
-			g_free (data);
-		}
+static void
+apply_controlcenter_whitelist (const gchar *data, gsize len)
+{
+	AgentJsonValue value;
 
-		g_free (arg);
+	if (agent_json_task_output (data, len, "controlcenter_items", &value)) {
+		gchar *list = agent_json_value_dup (&value);
+		queue_settings_write (SETTINGS_WRITE_LIST, 0, list, "controlcenter_items");
+		g_free (list);
 	}
 }
 
 static void
-set_application_blacklist (void)
+apply_application_blacklist (const gchar *data, gsize len)
 {
-	if (!g_agent_proxy)
-		g_agent_proxy = proxy_get ("agent");
-
-	if (g_agent_proxy) {
-		const gchar *json;
-		GVariant *variant = NULL;
-		gchar *arg = NULL, *data = NULL;
-
-		json = "{\"module\":{\"module_name\":\"config\",\"task\":{\"task_name\":\"get_app_list\",\"in\":{\"login_id\":\"%s\"}}}}";
-
-		arg = g_strdup_printf (json, g_get_user_name ());
-
-		variant = g_dbus_proxy_call_sync (g_agent_proxy,
-                                          "do_task",
-                                          g_variant_new ("(s)", arg),
-                                          G_DBUS_CALL_FLAGS_NONE, -1,
-                                          NULL, NULL);
+	AgentJsonValue value;
 
-		if (variant) {
-			GVariant *v = NULL;
-			g_variant_get (variant, "(v)", &v);
-			if (v) {
-				data = g_variant_dup_string (v, NULL);
-				g_variant_unref (v);
-			}
-			g_variant_unref (variant);
-		}
+	if (agent_json_task_output (data, len, "black_list", &value)) {
+		gchar *list = agent_json_value_dup (&value);
+		queue_settings_write (SETTINGS_WRITE_LIST, 0, list, "black_list");
+		g_free (list);
+	}
+}
 
-		if (data) {
-			gchar *list = get_list_from_json (data, "black_list");
-			if (list) {
-				save_settings (list, "black_list");
-				g_free (list);
-			}
-			g_free (data);
-		}
+static void
+blacklist_handler_block (void)
+{
+	if (g_blacklist_settings && !g_blacklist_handler_blocked) {
+		g_signal_handlers_block_by_func (g_blacklist_settings,
+                                         gooroom_blacklist_settings_changed, NULL);
+		g_blacklist_handler_blocked = TRUE;
+	}
+}
 
-		g_free (arg);
+static void
+blacklist_handler_unblock (void)
+{
+	if (g_blacklist_settings && g_blacklist_handler_blocked) {
+		g_signal_handlers_unblock_by_func (g_blacklist_settings,
+                                           gooroom_blacklist_settings_changed, NULL);
+		g_blacklist_handler_blocked = FALSE;
 	}
 }
 
@@ -949,10 +1195,20 @@ restart_dockbarx_done_cb (GObject      *source_object,
                           GAsyncResult *res,
                           gpointer      user_data)
 {
-	if (g_blacklist_settings) {
-		g_signal_handlers_unblock_by_func (g_blacklist_settings,
-                                           gooroom_blacklist_settings_changed, NULL);
+	GVariant *variant;
+	GError *error = NULL;
+
+	variant = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source_object), res, &error);
+	if (variant) {
+		g_variant_unref (variant);
+	} else {
+		flight_record_error (FLIGHT_EVENT_ERROR, "dockbarx-restart", error);
+		g_error_free (error);
 	}
+
+	trace_complete ("desktop", "dockbarx-restart", g_dockbarx_restart_us, trace_now ());
+
+	blacklist_handler_unblock ();
 }
 
 static void
@@ -968,41 +1224,34 @@ gooroom_dockbarx_applet_appeared_cb (GDBusConnection *connection,
                                      const gchar     *name_owner,
                                      gpointer         data)
 {
-	GDBusProxy *proxy = NULL;
-
 	if (g_gda_watch_id) {
 		g_bus_unwatch_name (g_gda_watch_id);
 		g_gda_watch_id = 0;
 	}
 
-	proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SESSION,
-                                           G_DBUS_CALL_FLAGS_NONE,
-                                           NULL,
-                                           "kr.gooroom.dockbarx.applet",
-                                           "/kr/gooroom/dockbarx/applet",
-                                           "kr.gooroom.dockbarx.applet",
-                                           NULL,
-                                           NULL);
-
-	if (proxy == NULL) {
-		g_warning ("Failed to get dockbarx applet proxy");
+	if (!g_session_bus) {
+		g_warning ("Failed to restart dockbarx applet: no session bus");
 		return;
 	}
 
-	g_dbus_proxy_call (proxy,
-                       "Restart", g_variant_new ("()"),
-                       G_DBUS_CALL_FLAGS_NONE,
-                       -1,
-                       NULL,
-                       restart_dockbarx_done_cb,
-                       NULL);
-
-	g_clear_object (&proxy);
+	g_dbus_connection_call (g_session_bus,
+                            "kr.gooroom.dockbarx.applet",
+                            "/kr/gooroom/dockbarx/applet",
+                            "kr.gooroom.dockbarx.applet",
+                            "Restart", g_variant_new ("()"),
+                            NULL,
+                            G_DBUS_CALL_FLAGS_NO_AUTO_START,
+                            -1,
+                            NULL,
+                            restart_dockbarx_done_cb,
+                            NULL);
 }
 
 static gboolean
 request_to_restart_dockbarx_idle (gpointer data)
 {
+	g_dockbarx_restart_us = trace_now ();
+
 	if (g_gda_watch_id != 0) {
 		g_bus_unwatch_name (g_gda_watch_id);
 		g_gda_watch_id = 0;
@@ -1018,41 +1267,203 @@ request_to_restart_dockbarx_idle (gpointer data)
 	return FALSE;
 }
 
+/* Whether a failed broker call should be retried without the broker */
+static gboolean
+broker_unavailable (const GError *error)
+{
+	if (error->domain != G_DBUS_ERROR)
+		return FALSE;
+
+	switch (error->code) {
+		case G_DBUS_ERROR_SERVICE_UNKNOWN:
+			/* not installed on this host, don't ask again */
+			g_atomic_int_set (&g_broker_missing, TRUE);
+			return TRUE;
+
+		case G_DBUS_ERROR_NAME_HAS_NO_OWNER:
+		case G_DBUS_ERROR_UNKNOWN_METHOD:
+		case G_DBUS_ERROR_SPAWN_EXEC_FAILED:
+		case G_DBUS_ERROR_SPAWN_CHILD_EXITED:
+		case G_DBUS_ERROR_SPAWN_SERVICE_NOT_FOUND:
+		case G_DBUS_ERROR_SPAWN_FAILED:
+			return TRUE;
+
+		default:
+		break;
+	}
+
+	return FALSE;
+}
+
+/* The broker runs the helper once for all sessions of the host; FALSE
+ * if the blacklist is still to be applied */
+static gboolean
+update_blacklist_by_broker (gchar **blacklist)
+{
+	GVariant *ret;
+	GError *error = NULL;
+	const gchar *none[] = { NULL };
+
+	if (!g_system_bus || g_atomic_int_get (&g_broker_missing))
+		return FALSE;
+
+	ret = g_dbus_connection_call_sync (g_system_bus,
+                                       POLICY_BROKER_NAME,
+                                       POLICY_BROKER_PATH,
+                                       POLICY_BROKER_INTERFACE,
+                                       "UpdateBlacklist",
+                                       g_variant_new ("(^as)", blacklist ? blacklist : (gchar **) none),
+                                       NULL,
+                                       G_DBUS_CALL_FLAGS_NONE, BROKER_BLACKLIST_TIMEOUT_MS,
+                                       NULL, &error);
+	if (ret) {
+		g_variant_unref (ret);
+		return TRUE;
+	}
+
+	flight_record_error (FLIGHT_EVENT_ERROR, "UpdateBlacklist", error);
+
+	/* a timeout or a refusal by the broker, by polkit too, leaves the
+	 * update to the helper, which asks polkit itself */
+	if (!broker_unavailable (error))
+		g_warning ("Failed to update blacklist through the broker: %s", error->message);
+	g_error_free (error);
+
+	return FALSE;
+}
+
 static void
 update_blacklist (gchar **blacklist)
 {
-	gchar *pkexec, *cmd;
+	guint i;
+	GPtrArray *argv;
 
-	pkexec = g_find_program_in_path ("pkexec");
+	if (update_blacklist_by_broker (blacklist))
+		return;
 
-	if (blacklist) {
-		gchar *str_blacklist = g_strjoinv (" ", blacklist);
-		cmd = g_strdup_printf ("%s %s %s", pkexec, GOOROOM_UPDATE_BLACKLIST_HELPER, str_blacklist);
-		g_free (str_blacklist);
-	} else {
-		cmd = g_strdup_printf ("%s %s", pkexec, GOOROOM_UPDATE_BLACKLIST_HELPER);
+	argv = g_ptr_array_new ();
+	g_ptr_array_add (argv, g_paths.pkexec);
+	g_ptr_array_add (argv, g_paths.update_blacklist_helper);
+	for (i = 0; blacklist && blacklist[i]; i++)
+		g_ptr_array_add (argv, blacklist[i]);
+	g_ptr_array_add (argv, NULL);
+
+	process_registry_spawn_sync ("gooroom-update-blacklist-helper",
+                                 (gchar **) argv->pdata, PROCESS_FLAGS_BACKGROUND, NULL, NULL);
+
+	g_ptr_array_free (argv, TRUE);
+}
+
+static void
+blacklist_snapshot_publish (gchar **blacklist)
+{
+	guint i;
+	gint fd, old_fd = -1;
+	guint64 generation;
+	GList *all_apps;
+	GError *error = NULL;
+	BlacklistSnapshotBuilder *builder;
+
+	all_apps = g_app_info_get_all ();
+	builder = blacklist_snapshot_builder_new ();
+
+	for (i = 0; blacklist && blacklist[i]; i++) {
+		struct stat st;
+		gchar *desktop, *binary = NULL;
+
+		if (blacklist[i][0] == '\0')
+			continue;
+
+		/* not enforced by the helper, so not published either */
+		desktop = blacklist_resolve_desktop (all_apps, blacklist[i]);
+		if (desktop && g_str_has_suffix (desktop, "gooroomupdate.desktop")) {
+			g_free (desktop);
+			continue;
+		}
+
+		blacklist_snapshot_builder_add_name (builder, blacklist[i]);
+		if (desktop) {
+			blacklist_snapshot_builder_add_name (builder, desktop);
+			binary = blacklist_resolve_binary (desktop);
+		}
+		if (binary) {
+			blacklist_snapshot_builder_add_name (builder, binary);
+			if (stat (binary, &st) == 0)
+				blacklist_snapshot_builder_add_inode (builder, st.st_dev, st.st_ino);
+		}
+
+		g_free (desktop);
+		g_free (binary);
+	}
+
+	/* sealed under the lock, so that generations are published in order */
+	g_mutex_lock (&g_snapshot_lock);
+	generation = g_snapshot_generation + 1;
+	fd = blacklist_snapshot_builder_seal (builder, generation, &error);
+	if (fd >= 0) {
+		old_fd = g_snapshot_fd;
+		g_snapshot_fd = fd;
+		g_snapshot_generation = generation;
+	}
+	g_mutex_unlock (&g_snapshot_lock);
+
+	blacklist_snapshot_builder_free (builder);
+	g_list_free_full (all_apps, g_object_unref);
+
+	if (fd < 0) {
+		g_warning ("Failed to publish the blacklist: %s", error->message);
+		g_error_free (error);
+		return;
 	}
 
-	g_spawn_command_line_sync (cmd, NULL, NULL, NULL, NULL);
+	if (old_fd >= 0)
+		close (old_fd);
 
-	g_free (pkexec);
-	g_free (cmd);
+	if (g_session_bus)
+		g_dbus_connection_emit_signal (g_session_bus, NULL,
+                                       SESSION_MANAGER_PATH,
+                                       SESSION_MANAGER_BLACKLIST_INTERFACE,
+                                       "SnapshotChanged",
+                                       g_variant_new ("(t)", generation),
+                                       NULL);
+}
+
+static void
+update_blacklist_thread_done_cb (GObject      *source_object,
+                                 GAsyncResult *result,
+                                 gpointer      user_data)
+{
+	request_to_restart_dockbarx_idle (NULL);
+
+	g_timeout_id = 0;
+}
+
+static void
+update_blacklist_thread (GTask        *task,
+                         gpointer      source_object,
+                         gpointer      task_data,
+                         GCancellable *cancellable)
+{
+	update_blacklist ((gchar **)task_data);
+	blacklist_snapshot_publish ((gchar **)task_data);
+
+	g_task_return_boolean (task, TRUE);
 }
 
 static gboolean
 update_blacklist_idle (gpointer user_data)
 {
-	gchar **blacklist = (gchar **)user_data;
+	GTask *task;
 
-	update_blacklist (blacklist);
-	g_strfreev (blacklist);
+	loop_monitor_enter ("update_blacklist_idle");
 
-	request_to_restart_dockbarx_idle (NULL);
+	/* the helper walks every desktop file, keep it off the policy context */
+	task = g_task_new (NULL, NULL, update_blacklist_thread_done_cb, NULL);
+	g_task_set_task_data (task, user_data, (GDestroyNotify) g_strfreev);
+	g_task_run_in_thread (task, update_blacklist_thread);
+	g_object_unref (task);
 
-	if (g_timeout_id > 0) {
-		g_source_remove (g_timeout_id);
-		g_timeout_id = 0;
-	}
+	loop_monitor_leave ();
 
 	return FALSE;
 }
@@ -1062,68 +1473,289 @@ gooroom_blacklist_settings_changed (GSettings *settings,
                                     const gchar *key,
                                     gpointer data)
 {
+	loop_monitor_enter ("blacklist-changed");
+
 	if (g_str_equal (key, "blacklist")) {
 		if (g_timeout_id == 0) {
 			gchar **blacklist = g_settings_get_strv (settings, key);
-			g_timeout_id = g_idle_add ((GSourceFunc) update_blacklist_idle, blacklist);
+			g_timeout_id = policy_idle_add ((GSourceFunc) update_blacklist_idle, blacklist);
 		}
 	}
+
+	loop_monitor_leave ();
+}
+
+static void
+agent_call_stats_record (const gchar *task_name, gint64 elapsed_us, const GError *error)
+{
+	metrics_observe ("agent_call", task_name, elapsed_us);
+
+	if (error) {
+		flight_record_error (FLIGHT_EVENT_ERROR, task_name, error);
+		metrics_count ("agent_call_failures", task_name, 1);
+		if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT) ||
+            g_error_matches (error, G_DBUS_ERROR, G_DBUS_ERROR_TIMED_OUT) ||
+            g_error_matches (error, G_DBUS_ERROR, G_DBUS_ERROR_NO_REPLY))
+			metrics_count ("agent_call_timeouts", task_name, 1);
+	}
 }
 
 static void
-send_request_to_gooroom_agent (const gchar *request)
+agent_call_stats_log (void)
 {
-	if (!g_agent_proxy)
-		g_agent_proxy = proxy_get ("agent");
+	metrics_log ("agent_call");
+	metrics_log ("agent_call_failures");
+	metrics_log ("agent_call_timeouts");
+}
 
-	if (g_agent_proxy) {
-		const gchar *json;
-		gchar *arg = NULL;
-		GVariant *variant = NULL;
+/* The policy broker answers for the calling user and shares the request
+ * with other sessions of the same user; without one the agent is asked
+ * directly. */
+static GVariant *
+agent_call (const gchar   *task_name,
+            gint           timeout_ms,
+            GCancellable  *cancellable,
+            GError       **error)
+{
+	gchar *arg;
+	GVariant *variant;
+	GError *broker_error = NULL;
+
+	if (!g_atomic_int_get (&g_broker_missing)) {
+		variant = g_dbus_connection_call_sync (g_system_bus,
+                                               POLICY_BROKER_NAME,
+                                               POLICY_BROKER_PATH,
+                                               POLICY_BROKER_INTERFACE,
+                                               "DoTask",
+                                               g_variant_new ("(s)", task_name),
+                                               G_VARIANT_TYPE ("(s)"),
+                                               G_DBUS_CALL_FLAGS_NONE, timeout_ms,
+                                               cancellable, &broker_error);
+		if (variant || !broker_unavailable (broker_error)) {
+			if (broker_error)
+				g_propagate_error (error, broker_error);
+			return variant;
+		}
+		g_error_free (broker_error);
+	}
 
-		json = "{\"module\":{\"module_name\":\"config\",\"task\":{\"task_name\":\"%s\",\"in\":{\"login_id\":\"%s\"}}}}";
+	arg = agent_json_task_request (task_name, g_get_user_name ());
 
-		arg = g_strdup_printf (json, request, g_get_user_name ());
+	variant = g_dbus_connection_call_sync (g_system_bus,
+                                           "kr.gooroom.agent",
+                                           "/kr/gooroom/agent",
+                                           "kr.gooroom.agent",
+                                           "do_task",
+                                           g_variant_new ("(s)", arg),
+                                           NULL,
+                                           G_DBUS_CALL_FLAGS_NO_AUTO_START, timeout_ms,
+                                           cancellable, error);
+	g_free (arg);
+
+	return variant;
+}
 
-		variant = g_dbus_proxy_call_sync (g_agent_proxy,
-                                          "do_task",
-                                          g_variant_new ("(s)", arg),
-                                          G_DBUS_CALL_FLAGS_NONE, -1,
-                                          NULL, NULL);
-		if (variant)
-			g_variant_unref (variant);
+/* Returns FALSE if the agent did not answer, @reply is set only if the
+ * answer carried a string. */
+static gboolean
+agent_do_task (const gchar   *task_name,
+               gint           timeout_ms,
+               GCancellable  *cancellable,
+               GVariant     **reply,
+               GError       **error)
+{
+	gint64 begin, end;
+	GVariant *variant = NULL;
+	GError *call_error = NULL;
 
-		g_free (arg);
+	if (!g_system_bus) {
+		g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_CONNECTED,
+                     "Gooroom Agent Service is not available");
+		return FALSE;
 	}
+
+	PROBE1 (agent_call_start, task_name);
+	begin = g_get_monotonic_time ();
+	variant = agent_call (task_name, timeout_ms, cancellable, &call_error);
+	end = g_get_monotonic_time ();
+	PROBE3 (agent_call_done, task_name, end - begin, variant == NULL);
+	agent_call_stats_record (task_name, end - begin, call_error);
+	trace_complete ("agent", task_name, begin, end);
+
+	if (!variant) {
+		g_propagate_error (error, call_error);
+		return FALSE;
+	}
+
+	if (reply && g_variant_is_of_type (variant, G_VARIANT_TYPE ("(s)"))) {
+		*reply = g_variant_get_child_value (variant, 0);
+	} else if (reply && g_variant_is_of_type (variant, G_VARIANT_TYPE ("(v)"))) {
+		GVariant *v = NULL;
+		g_variant_get_child (variant, 0, "v", &v);
+		if (g_variant_is_of_type (v, G_VARIANT_TYPE_STRING))
+			*reply = v;
+		else
+			g_variant_unref (v);
+	}
+	g_variant_unref (variant);
+
+	return TRUE;
+}
+
+static AgentJob *
+agent_job_new (const gchar *task_name, AgentReplyFunc reply_func, gint64 deadline_us)
+{
+	AgentJob *job = g_new0 (AgentJob, 1);
+
+	job->task_name = g_strdup (task_name);
+	job->reply_func = reply_func;
+	job->deadline_us = deadline_us;
+	job->generation = g_atomic_int_get (&g_agent_generation);
+	job->cancellable = g_object_ref (g_agent_cancellable);
+
+	return job;
+}
+
+static void
+agent_job_free (AgentJob *job)
+{
+	g_object_unref (job->cancellable);
+	g_free (job->task_name);
+	g_free (job);
 }
 
 static gboolean
-logout_session_cb (gpointer data)
+agent_job_is_stale (AgentJob *job)
+{
+	return (g_cancellable_is_cancelled (job->cancellable) ||
+            job->generation != g_atomic_int_get (&g_agent_generation));
+}
+
+static void agent_job_retry (AgentJob *job);
+
+/* Takes ownership of the job: it is freed, or rescheduled on failure */
+static void
+agent_job_run (gpointer data)
+{
+	AgentJob *job = (AgentJob *)data;
+	gint timeout_ms = AGENT_CALL_TIMEOUT_MS;
+	GVariant *reply = NULL;
+	GError *error = NULL;
+
+	if (agent_job_is_stale (job)) {
+		agent_job_free (job);
+		return;
+	}
+
+	if (job->deadline_us) {
+		gint64 remaining_ms = (job->deadline_us - g_get_monotonic_time ()) / 1000;
+		if (remaining_ms <= 0) {
+			g_set_error (&error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
+                         "Login budget for Gooroom Agent Service is exhausted");
+			agent_call_stats_record (job->task_name, 0, error);
+			goto failed;
+		}
+		timeout_ms = MIN (timeout_ms, remaining_ms);
+	}
+
+	if (agent_do_task (job->task_name, timeout_ms, job->cancellable, &reply, &error)) {
+		/* the agent may have restarted while we were waiting */
+		if (reply && job->reply_func && !agent_job_is_stale (job)) {
+			gsize len = 0;
+			const gchar *data = g_variant_get_string (reply, &len);
+			job->reply_func (data, len);
+		}
+		if (reply)
+			g_variant_unref (reply);
+		agent_job_free (job);
+		return;
+	}
+
+	if (agent_job_is_stale (job)) {
+		g_error_free (error);
+		agent_job_free (job);
+		return;
+	}
+
+failed:
+	g_warning ("do_task %s failed (attempt %u): %s",
+               job->task_name, job->attempt + 1, error->message);
+	g_error_free (error);
+
+	agent_job_retry (job);
+}
+
+static void
+agent_job_retry_thread (GTask        *task,
+                        gpointer      source_object,
+                        gpointer      task_data,
+                        GCancellable *cancellable)
 {
-	g_spawn_command_line_async ("/usr/bin/gooroom-logout-command --logout", NULL);
+	agent_job_run (task_data);
+
+	g_task_return_boolean (task, TRUE);
+}
+
+static gboolean
+agent_job_retry_cb (gpointer data)
+{
+	GTask *task;
+
+	task = g_task_new (NULL, NULL, NULL, NULL);
+	g_task_set_task_data (task, data, NULL);
+	g_task_run_in_thread (task, agent_job_retry_thread);
+	g_object_unref (task);
 
 	return FALSE;
 }
 
 static void
-terminate_session (void)
+agent_job_retry (AgentJob *job)
+{
+	guint delay;
+	GSource *source;
+
+	if (++job->attempt > AGENT_RETRY_MAX) {
+		g_warning ("Giving up do_task %s after %u attempts", job->task_name, job->attempt);
+		agent_job_free (job);
+		return;
+	}
+
+	/* retries run in the background, outside the login budget */
+	job->deadline_us = 0;
+	delay = MIN (AGENT_RETRY_DELAY_S << (job->attempt - 1), AGENT_RETRY_DELAY_MAX_S);
+
+	source = g_timeout_source_new_seconds (delay);
+	g_source_set_callback (source, agent_job_retry_cb, job, NULL);
+	g_source_attach (source, g_policy_context);
+	g_source_unref (source);
+}
+
+static gboolean
+logout_session_cb (gpointer data)
 {
-	GtkWidget *message = gtk_message_dialog_new (NULL,
-                                                 GTK_DIALOG_MODAL,
-                                                 GTK_MESSAGE_ERROR,
-                                                 GTK_BUTTONS_OK,
-                                                 NULL);
+	gchar *argv[] = { "/usr/bin/gooroom-logout-command", "--logout", NULL };
 
-	gtk_message_dialog_format_secondary_text (GTK_MESSAGE_DIALOG (message),
-			_("Could not found user's settings file.\nAfter 10 seconds, the user will be logged out."));
+	process_registry_spawn ("gooroom-logout-command", argv, PROCESS_FLAGS_NONE, NULL, NULL, NULL);
 
-	gtk_window_set_title (GTK_WINDOW (message), _("Terminating Session"));
+	return FALSE;
+}
 
-	g_signal_connect (message, "response", G_CALLBACK (gtk_widget_destroy), NULL);
+static gboolean
+terminate_session (gpointer data)
+{
+	gchar *argv[] = { g_paths.session_dialog, NULL };
+	GError *error = NULL;
+
+	if (!process_registry_spawn ("gooroom-session-dialog", argv, PROCESS_FLAGS_NONE,
+                                 NULL, NULL, &error)) {
+		g_warning ("Failed to show the session dialog: %s", error->message);
+		g_error_free (error);
+	}
 
 	g_timeout_add (1000 * 10, (GSourceFunc) logout_session_cb, NULL);
 
-	gtk_widget_show (message);
+	return FALSE;
 }
 
 static void
@@ -1142,54 +1774,58 @@ grac_name_appeared_cb (GDBusConnection *connection,
                        const gchar     *name_owner,
                        gpointer         data)
 {
+	media_control_reset ();
+
 	bind_grac_signal ();
 }
 
 static void
-agent_job_thread_done_cb (GObject      *source_object,
-                          GAsyncResult *result,
-                          gpointer      user_data)
+agent_task_grac_reload (gpointer data)
 {
-	bind_gooroom_agent_signal ();
-
-	if (!g_agent_name_appeared || registered_gpms ()) {
-		if (is_systemd_service_active ("grac-device-daemon.service"))
-			reload_grac_service ();
+	if (is_systemd_service_active ("grac-device-daemon.service"))
+		reload_grac_service ();
+}
 
-		g_idle_add ((GSourceFunc) request_to_restart_dockbarx_idle, NULL);
-	}
+static void
+agent_task_restart_dockbarx (gpointer data)
+{
+	request_to_restart_dockbarx_idle (NULL);
+}
 
-	g_agent_name_appeared = TRUE;
+/* The whole graph is given under its own name, e.g. "login" */
+static void
+graph_phase_record (const gchar *id, gint64 start_us, gint64 end_us, gpointer user_data)
+{
+	metrics_observe ((const gchar *)user_data, id, end_us - start_us);
+	trace_complete ((const gchar *)user_data, id, start_us, end_us);
 }
 
+static void start_agent_sync (void);
+
 static void
-agent_job_thread (GTask        *task,
-                  gpointer      source_object,
-                  gpointer      task_data,
-                  GCancellable *cancellable)
+agent_graph_done_cb (TaskGraph *graph, gpointer user_data)
 {
-	if (registered_gpms ()) {
-		const gchar *req_arg;
+	bind_gooroom_agent_signal ();
 
-		if (g_blacklist_settings) {
-			g_signal_handlers_block_by_func (g_blacklist_settings,
-                                             gooroom_blacklist_settings_changed, NULL);
-		}
-		req_arg = is_gpms_user (g_get_user_name ()) ? "set_authority_config" : "set_authority_config_local";
+	g_agent_name_appeared = TRUE;
 
-		/* request to save GRAC's rule for Gooroom */
-		send_request_to_gooroom_agent (req_arg);
-		/* request to check blocking packages change */
-		send_request_to_gooroom_agent ("get_update_operation_with_loginid");
+	task_graph_log_timings (graph);
+	task_graph_foreach_timing (graph, graph_phase_record, "agent_sync_phase");
+	agent_call_stats_log ();
+	task_graph_free (graph);
 
-		set_dpms_off_time ();
-		set_sleep_inactive_time ();
-		set_controlcenter_whitelist ();
-		set_application_blacklist ();
-	}
+	login_timeline_mark (&g_login.agent_sync_us);
 
-	/* The task has finished */
-	g_task_return_boolean (task, TRUE);
+	/* a cancelled sync may have skipped the dockbarx restart */
+	if (GPOINTER_TO_INT (user_data) != g_atomic_int_get (&g_agent_generation))
+		blacklist_handler_unblock ();
+
+	g_agent_sync_running = FALSE;
+
+	if (g_agent_sync_pending) {
+		g_agent_sync_pending = FALSE;
+		start_agent_sync ();
+	}
 }
 
 static void
@@ -1201,12 +1837,98 @@ gooroom_agent_name_vanished_cb (GDBusConnection *connection,
 
 	unbind_gooroom_agent_signal ();
 
+	if (g_agent_cancellable)
+		g_cancellable_cancel (g_agent_cancellable);
+
+	policy_source_remove (&g_agent_debounce_id);
+	g_agent_sync_pending = FALSE;
+
 	if (!g_agent_name_appeared) {
+		/* nothing to wait for */
+		login_timeline_mark (&g_login.agent_sync_us);
+
 		if (is_systemd_service_active ("grac-device-daemon.service"))
 			reload_grac_service ();
 
-		g_idle_add ((GSourceFunc) request_to_restart_dockbarx_idle, NULL);
+		policy_idle_add ((GSourceFunc) request_to_restart_dockbarx_idle, NULL);
+	}
+}
+
+static void
+start_agent_sync (void)
+{
+	TaskGraph *graph;
+	gboolean registered;
+	gint64 deadline;
+	const gchar *authority_task;
+
+	graph = task_graph_new ("agent", AGENT_GRAPH_THREADS);
+
+	registered = session_identity_is_registered ();
+	if (registered) {
+		blacklist_handler_block ();
+
+		/* whatever does not finish within the budget is applied later */
+		deadline = g_get_monotonic_time () + AGENT_LOGIN_BUDGET_MS * G_GINT64_CONSTANT (1000);
+
+		authority_task = session_identity_is_gpms_user () ? "set_authority_config" : "set_authority_config_local";
+
+		/* the agent requests are independent of each other,
+		 * the ones the user sees in the panel go first */
+		task_graph_add (graph, "app-blacklist", TASK_GRAPH_NODE_NONE, G_PRIORITY_HIGH,
+                        agent_job_run, agent_job_new ("get_app_list", apply_application_blacklist, deadline),
+                        NULL);
+		task_graph_add (graph, "controlcenter-items", TASK_GRAPH_NODE_NONE, G_PRIORITY_HIGH,
+                        agent_job_run, agent_job_new ("get_controlcenter_items", apply_controlcenter_whitelist, deadline),
+                        NULL);
+		/* request to save GRAC's rule for Gooroom */
+		task_graph_add (graph, "authority-config", TASK_GRAPH_NODE_NONE, G_PRIORITY_DEFAULT,
+                        agent_job_run, agent_job_new (authority_task, NULL, deadline),
+                        NULL);
+		/* request to check blocking packages change */
+		task_graph_add (graph, "update-operation", TASK_GRAPH_NODE_NONE, G_PRIORITY_DEFAULT,
+                        agent_job_run, agent_job_new ("get_update_operation_with_loginid", NULL, deadline),
+                        NULL);
+		task_graph_add (graph, "dpms-off-time", TASK_GRAPH_NODE_NONE, G_PRIORITY_LOW,
+                        agent_job_run, agent_job_new ("dpms_off_time", apply_dpms_off_time, deadline),
+                        NULL);
+		task_graph_add (graph, "sleep-inactive-time", TASK_GRAPH_NODE_NONE, G_PRIORITY_LOW,
+                        agent_job_run, agent_job_new ("sleep_inactive_time", apply_sleep_inactive_time, deadline),
+                        NULL);
+	}
+
+	if (!g_agent_name_appeared || registered) {
+		/* GRAC reads the rules saved by set_authority_config */
+		task_graph_add (graph, "grac-reload", TASK_GRAPH_NODE_NONE, G_PRIORITY_DEFAULT,
+                        agent_task_grac_reload, NULL,
+                        registered ? "authority-config" : NULL, NULL);
+		task_graph_add (graph, "dockbarx-restart", TASK_GRAPH_NODE_IN_CONTEXT, G_PRIORITY_DEFAULT,
+                        agent_task_restart_dockbarx, NULL,
+                        registered ? "app-blacklist" : NULL, NULL);
 	}
+
+	g_agent_sync_running = TRUE;
+
+	task_graph_run (graph, g_policy_context, agent_graph_done_cb,
+                    GINT_TO_POINTER (g_atomic_int_get (&g_agent_generation)));
+}
+
+static gboolean
+agent_debounce_cb (gpointer data)
+{
+	g_agent_debounce_id = 0;
+
+	loop_monitor_enter ("agent-debounce");
+
+	/* only one policy sync at a time, the running one is already cancelled */
+	if (g_agent_sync_running)
+		g_agent_sync_pending = TRUE;
+	else
+		start_agent_sync ();
+
+	loop_monitor_leave ();
+
+	return FALSE;
 }
 
 static void
@@ -1215,17 +1937,48 @@ gooroom_agent_name_appeared_cb (GDBusConnection *connection,
                                 const gchar     *name_owner,
                                 gpointer         data)
 {
-	GTask *task;
+	trace_instant ("agent", "agent-appeared");
+	login_timeline_mark (&g_login.agent_us);
 
-	task = g_task_new (NULL, NULL, agent_job_thread_done_cb, NULL);
-	g_task_run_in_thread (task, agent_job_thread);
-	g_object_unref (task);
+	if (g_agent_cancellable) {
+		g_cancellable_cancel (g_agent_cancellable);
+		g_object_unref (g_agent_cancellable);
+	}
+
+	g_agent_cancellable = g_cancellable_new ();
+	g_atomic_int_inc (&g_agent_generation);
+
+	/* an agent that keeps restarting is synced once it settles down */
+	policy_source_remove (&g_agent_debounce_id);
+	g_agent_debounce_id = policy_timeout_add (AGENT_DEBOUNCE_MS, agent_debounce_cb, NULL);
 }
 
 static void
-start_init_thread_done_cb (GObject      *source_object,
-                           GAsyncResult *result,
-                           gpointer      user_data)
+login_task_desktop_theme (gpointer data)
+{
+	/* configure icon-theme and background */
+	handle_desktop_configuration ();
+}
+
+static void
+login_task_blacklist_apply (gpointer data)
+{
+	gchar **blacklist = NULL;
+
+	if (g_blacklist_settings)
+		blacklist = g_settings_get_strv (g_blacklist_settings, "blacklist");
+
+	/* the helper diffs against what this user held before, an empty
+	 * list gives back whatever an earlier session revoked */
+	update_blacklist (blacklist);
+
+	/* published even when empty, consumers wait for the first one */
+	blacklist_snapshot_publish (blacklist);
+	g_strfreev (blacklist);
+}
+
+static void
+login_task_watch_services (gpointer data)
 {
 	g_bus_watch_name (G_BUS_TYPE_SYSTEM,
                       "kr.gooroom.agent",
@@ -1243,49 +1996,51 @@ start_init_thread_done_cb (GObject      *source_object,
 }
 
 static void
-start_init_thread (GTask        *task,
-                  gpointer      source_object,
-                  gpointer      task_data,
-                  GCancellable *cancellable)
+login_graph_done_cb (TaskGraph *graph, gpointer user_data)
 {
-	/* initialize blacklist */
-	update_blacklist (NULL);
+	task_graph_log_timings (graph);
+	task_graph_foreach_timing (graph, graph_phase_record, "login_phase");
+	task_graph_free (graph);
 
-	/* remove permission from binary */
-	gchar **blacklist = g_settings_get_strv (g_blacklist_settings, "blacklist");
-	if (blacklist)
-		update_blacklist (blacklist);
-	g_strfreev (blacklist);
-
-	/* The task has finished */
-	g_task_return_boolean (task, TRUE);
+	login_timeline_mark (&g_login.login_tasks_us);
 }
 
 static void
-name_acquired_handler (GDBusConnection *connection,
-                       const gchar     *name,
-                       gpointer         user_data)
+start_session_policy (void)
 {
-	GTask *task;
+	TaskGraph *graph;
 	gchar *grm_user = NULL;
 	GSettingsSchema *schema = NULL;
 
 	grm_user = g_strdup_printf ("%s/.gooroom/%s", g_get_home_dir (), GRM_USER);
 
-	if (is_gpms_user (g_get_user_name ())) {
+	if (!g_system_bus) {
+		GError *error = NULL;
+		g_system_bus = g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL, &error);
+		if (!g_system_bus) {
+			g_warning ("Failed to connect to the system bus: %s", error->message);
+			g_error_free (error);
+		}
+	}
+
+	graph = task_graph_new ("login", LOGIN_GRAPH_THREADS);
+
+	if (session_identity_is_gpms_user ()) {
 		if (!g_file_test (grm_user, G_FILE_TEST_EXISTS)) {
-			terminate_session ();
+			g_main_context_invoke (NULL, terminate_session, NULL);
+			task_graph_free (graph);
 			goto done;
 		}
 
-		/* configure icon-theme and background */
-		handle_desktop_configuration ();
+		task_graph_add (graph, "desktop-theme", TASK_GRAPH_NODE_NONE, G_PRIORITY_HIGH,
+                        login_task_desktop_theme, NULL, NULL);
 	}
 
 	schema = g_settings_schema_source_lookup (g_settings_schema_source_get_default (),
                                               "apps.gooroom-applauncher-applet", TRUE);
 	if (schema) {
 		g_blacklist_settings = g_settings_new_full (schema, NULL, NULL);
+		g_blacklist_has_key = g_settings_schema_has_key (schema, "blacklist");
 		g_signal_connect (G_OBJECT (g_blacklist_settings), "changed",
                           G_CALLBACK (gooroom_blacklist_settings_changed), NULL);
 		g_settings_schema_unref (schema);
@@ -1295,18 +2050,164 @@ name_acquired_handler (GDBusConnection *connection,
                                               "org.gnome.ControlCenter", TRUE);
 	if (schema) {
 		g_whitelist_settings = g_settings_new_full (schema, NULL, NULL);
+		g_whitelist_has_key = g_settings_schema_has_key (schema, "whitelist-panels");
 		g_settings_schema_unref (schema);
 	}
 
-	task = g_task_new (NULL, NULL, start_init_thread_done_cb, NULL);
-	g_task_run_in_thread (task, start_init_thread);
-	g_object_unref (task);
+	task_graph_add (graph, "blacklist-apply", TASK_GRAPH_NODE_NONE, G_PRIORITY_DEFAULT,
+                    login_task_blacklist_apply, NULL, NULL);
+	/* the agent must not push a new blacklist before ours is applied */
+	task_graph_add (graph, "service-watches", TASK_GRAPH_NODE_IN_CONTEXT, G_PRIORITY_DEFAULT,
+                    login_task_watch_services, NULL, "blacklist-apply", NULL);
 
+	task_graph_run (graph, g_policy_context, login_graph_done_cb, NULL);
 
 done:
 	g_free (grm_user);
 }
 
+static void
+session_identity_ready_cb (GObject      *source_object,
+                           GAsyncResult *result,
+                           gpointer      user_data)
+{
+	session_identity_init_finish (result, NULL);
+
+	login_timeline_mark (&g_login.identity_us);
+	trace_complete ("login", "session-identity", g_login.identity_begin_us, g_login.identity_us);
+
+	start_session_policy ();
+}
+
+static gboolean
+resolve_session_identity (gpointer data)
+{
+	g_login.identity_begin_us = g_get_monotonic_time ();
+
+	/* the passwd lookup may block on NSS, keep it off the policy context */
+	session_identity_init_async (g_paths.gcsr_conf, session_identity_ready_cb, NULL);
+
+	return FALSE;
+}
+
+static void
+handle_get_snapshot (GDBusMethodInvocation *invocation)
+{
+	gint index = -1;
+	guint64 generation;
+	GUnixFDList *fd_list;
+	GError *error = NULL;
+
+	fd_list = g_unix_fd_list_new ();
+
+	/* the same sealed memfd for everybody, it cannot be changed */
+	g_mutex_lock (&g_snapshot_lock);
+	generation = g_snapshot_generation;
+	if (g_snapshot_fd >= 0)
+		index = g_unix_fd_list_append (fd_list, g_snapshot_fd, &error);
+	g_mutex_unlock (&g_snapshot_lock);
+
+	if (index >= 0) {
+		g_dbus_method_invocation_return_value_with_unix_fd_list (invocation,
+                                                                 g_variant_new ("(ht)", index, generation),
+                                                                 fd_list);
+	} else if (error) {
+		g_dbus_method_invocation_take_error (invocation, error);
+	} else {
+		g_dbus_method_invocation_return_error_literal (invocation, G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+                                                       "The blacklist has not been resolved yet");
+	}
+
+	g_object_unref (fd_list);
+}
+
+static void
+handle_dump_flight_recorder (GDBusMethodInvocation *invocation)
+{
+	gchar *dump = flight_recorder_dump ();
+
+	g_dbus_method_invocation_return_value (invocation, g_variant_new ("(s)", dump));
+
+	g_free (dump);
+}
+
+static void
+handle_method_call (GDBusConnection       *connection,
+                    const gchar           *sender,
+                    const gchar           *object_path,
+                    const gchar           *interface_name,
+                    const gchar           *method_name,
+                    GVariant              *parameters,
+                    GDBusMethodInvocation *invocation,
+                    gpointer               user_data)
+{
+	loop_monitor_enter (method_name);
+
+	if (g_str_equal (method_name, "GetSnapshot"))
+		handle_get_snapshot (invocation);
+	else if (g_str_equal (method_name, "GetCounters"))
+		g_dbus_method_invocation_return_value (invocation,
+                                               g_variant_new ("(@a(sst))", metrics_get_counters ()));
+	else if (g_str_equal (method_name, "GetHistograms"))
+		g_dbus_method_invocation_return_value (invocation,
+                                               g_variant_new ("(@at@a(ssttat))",
+                                                              metrics_get_bounds (),
+                                                              metrics_get_histograms ()));
+	else if (g_str_equal (method_name, "DumpFlightRecorder"))
+		handle_dump_flight_recorder (invocation);
+
+	loop_monitor_leave ();
+}
+
+static const GDBusInterfaceVTable interface_vtable = {
+	handle_method_call,
+	NULL,
+	NULL
+};
+
+static void
+bus_acquired_handler (GDBusConnection *connection,
+                      const gchar     *name,
+                      gpointer         user_data)
+{
+	GError *error = NULL;
+
+	g_introspection = g_dbus_node_info_new_for_xml (introspection_xml, NULL);
+	g_object_id = g_dbus_connection_register_object (connection,
+                                                     SESSION_MANAGER_PATH,
+                                                     g_introspection->interfaces[0],
+                                                     &interface_vtable,
+                                                     NULL, NULL, &error);
+	if (!g_object_id) {
+		g_warning ("Failed to register %s: %s", SESSION_MANAGER_PATH, error->message);
+		g_clear_error (&error);
+	}
+
+	g_metrics_object_id = g_dbus_connection_register_object (connection,
+                                                             SESSION_MANAGER_PATH,
+                                                             g_introspection->interfaces[1],
+                                                             &interface_vtable,
+                                                             NULL, NULL, &error);
+	if (!g_metrics_object_id) {
+		g_warning ("Failed to register %s: %s", SESSION_MANAGER_METRICS_INTERFACE, error->message);
+		g_error_free (error);
+	}
+}
+
+static void
+name_acquired_handler (GDBusConnection *connection,
+                       const gchar     *name,
+                       gpointer         user_data)
+{
+	if (!g_session_bus)
+		g_session_bus = g_object_ref (connection);
+
+	login_timeline_mark (&g_login.bus_name_us);
+	trace_complete ("login", "bus-name", g_login.start_us, g_login.bus_name_us);
+
+	g_main_context_invoke (g_policy_context, resolve_session_identity, NULL);
+}
+
 static void
 name_lost_handler (GDBusConnection *connection,
                    const gchar *name,
@@ -1315,33 +2216,70 @@ name_lost_handler (GDBusConnection *connection,
 	/* Name was already taken, or the bus went away */
 	g_warning ("Name taken or bus went away - shutting down");
 
-	gtk_main_quit ();
+	g_main_loop_quit (g_main_loop);
+}
+
+static gboolean
+quit_signal_cb (gpointer data)
+{
+	g_main_loop_quit (g_main_loop);
+
+	return G_SOURCE_CONTINUE;
 }
 
 int
 main (int argc, char **argv)
 {
+	GError *error = NULL;
+
+	g_login.start_us = g_get_monotonic_time ();
+
 	setlocale (LC_ALL, "");
 	bindtextdomain (GETTEXT_PACKAGE, GNOMELOCALEDIR);
 	textdomain (GETTEXT_PACKAGE);
 
-	gtk_init (&argc, &argv);
+	root_paths_init (g_root_paths, G_N_ELEMENTS (g_root_paths));
+	trace_init (g_getenv ("GOOROOM_SESSION_MANAGER_TRACE"));
+	flight_recorder_watch_signal (PACKAGE_NAME);
+
+	g_main_loop = g_main_loop_new (NULL, FALSE);
+
+	g_unix_signal_add (SIGTERM, quit_signal_cb, NULL);
+	g_unix_signal_add (SIGINT, quit_signal_cb, NULL);
+
+	notification_queue_init (PACKAGE_NAME);
+	notification_queue_add_category ("grac", grac_burst_message);
+	notification_queue_add_category ("agent", agent_burst_message);
+
+	start_policy_thread ();
+	process_registry_init (g_policy_context);
+	/* helpers yield to the desktop starting at the same time */
+	process_registry_set_scope_bus (G_BUS_TYPE_SESSION);
 
 	g_owner_id = g_bus_own_name (G_BUS_TYPE_SESSION,
                                  "kr.gooroom.SessionManager",
                                  G_BUS_NAME_OWNER_FLAGS_NONE,
-                                 NULL,
+                                 (GBusAcquiredCallback) bus_acquired_handler,
                                  (GBusNameAcquiredCallback) name_acquired_handler,
                                  (GBusNameLostCallback) name_lost_handler,
                                  NULL,
                                  NULL);
 
-	gtk_main ();
+	g_main_monitor = loop_monitor_new ("main", NULL);
 
-	if (g_timeout_id > 0) {
-		g_source_remove (g_timeout_id);
-		g_timeout_id = 0;
-	}
+	g_main_loop_run (g_main_loop);
+
+	g_clear_pointer (&g_main_monitor, loop_monitor_free);
+
+	stop_policy_thread ();
+
+	session_identity_shutdown ();
+
+	notification_queue_shutdown ();
+	process_registry_shutdown ();
+
+	policy_source_remove (&g_timeout_id);
+	policy_source_remove (&g_agent_debounce_id);
 
 	if (g_gda_watch_id) {
 		g_bus_unwatch_name (g_gda_watch_id);
@@ -1353,17 +2291,22 @@ main (int argc, char **argv)
 		g_owner_id = 0;
 	}
 
-	if (g_agent_proxy) {
-		if (g_agent_signal_id)
-			g_signal_handler_disconnect (g_agent_proxy, g_agent_signal_id);
-		g_object_unref (g_agent_proxy);
+	if (g_system_bus) {
+		unbind_gooroom_agent_signal ();
+		unbind_grac_signal ();
+		g_object_unref (g_system_bus);
 	}
 
-	if (g_grac_proxy) {
-		if (g_grac_signal_id)
-			g_signal_handler_disconnect (g_grac_proxy, g_grac_signal_id);
-		g_object_unref (g_grac_proxy);
-	}
+	if (g_object_id && g_session_bus)
+		g_dbus_connection_unregister_object (g_session_bus, g_object_id);
+	if (g_metrics_object_id && g_session_bus)
+		g_dbus_connection_unregister_object (g_session_bus, g_metrics_object_id);
+	if (g_introspection)
+		g_dbus_node_info_unref (g_introspection);
+	if (g_snapshot_fd >= 0)
+		close (g_snapshot_fd);
+
+	g_clear_object (&g_session_bus);
 
 	if(g_blacklist_settings)
 		g_object_unref (g_blacklist_settings);
@@ -1371,6 +2314,22 @@ main (int argc, char **argv)
 	if(g_whitelist_settings)
 		g_object_unref (g_whitelist_settings);
 
+	if (g_media_controls)
+		g_hash_table_destroy (g_media_controls);
+
+	g_clear_object (&g_agent_cancellable);
+
+	g_main_context_unref (g_policy_context);
+	g_main_loop_unref (g_main_loop);
+
+	if (!trace_write (&error)) {
+		g_warning ("Failed to write the trace: %s", error->message);
+		g_error_free (error);
+	}
+
+	trace_shutdown ();
+	metrics_shutdown ();
+	root_paths_free (g_root_paths, G_N_ELEMENTS (g_root_paths));
 
 	return 0;
 }
@@ -19,6 +19,13 @@
  *
  */
 
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
 #include <sys/stat.h>
 
 #include <glib.h>
@@ -26,161 +33,577 @@
 #include <gio/gio.h>
 #include <gio/gdesktopappinfo.h>
 
-#include "panel-glib.h"
+#include "blacklist-resolve.h"
+#include "root-paths.h"
+#include "probes.h"
 
+/*
+ * Several helpers may run at once (logins, settings changes in other
+ * sessions), and the binaries they chmod are shared by the whole host.
+ * Runs are serialized by a lock, and the state file records for every
+ * revoked binary which owners (uids of the requesting sessions) want it
+ * revoked. A binary is restored only when no owner is left, and a run
+ * that would not change anything returns without walking the desktop
+ * files.
+ *
+ *   [owner 1001]
+ *   items=org.example.App.desktop;
+ *
+ *   [/usr/bin/example-app]
+ *   desktop=/usr/share/applications/org.example.App.desktop
+ *   owners=1001;
+ */
 
-static gchar *
-find_full_desktop_id (const gchar *find_str)
+#define BLACKLIST_LOCK_DIR      "/run/gooroom-session-manager"
+#define BLACKLIST_LOCK_FILE     BLACKLIST_LOCK_DIR "/blacklist.lock"
+#define BLACKLIST_STATE_FILE    BLACKLIST_STATE_DIR "/blacklist.state"
+#define OWNER_GROUP_PREFIX      "owner "
+
+/* The lock and the state, below $GOOROOM_SESSION_MANAGER_ROOT if that is
+ * set, so that a benchmark can run the helper unprivileged against a
+ * scratch tree; pkexec clears the environment of the helpers it runs */
+static struct {
+	gchar *lock_dir;
+	gchar *lock_file;
+	gchar *state_dir;
+	gchar *state_file;
+} g_paths;
+
+static const RootPath g_root_paths[] = {
+	{ &g_paths.lock_dir, BLACKLIST_LOCK_DIR },
+	{ &g_paths.lock_file, BLACKLIST_LOCK_FILE },
+	{ &g_paths.state_dir, BLACKLIST_STATE_DIR },
+	{ &g_paths.state_file, BLACKLIST_STATE_FILE }
+};
+
+
+/* Returns TRUE if the mode of @cmd had to be changed */
+static gboolean
+set_binary_executable (const gchar *cmd, const gchar *full_desktop_id, gboolean executable)
 {
-	gchar *ret = NULL;
-	GList *all_apps = NULL, *l = NULL;
+	GStatBuf stat_buf;
+	gboolean changed = FALSE;
 
-	if (!find_str || g_str_equal (find_str, ""))
-		return NULL;
+	if (g_stat (cmd, &stat_buf) == 0) {
+		mode_t perm = stat_buf.st_mode;
+		gboolean cur_exec = perm & S_IXOTH;
 
-	all_apps = g_app_info_get_all ();
+		if (executable) {
+			if (!cur_exec) {
+				PROBE2 (binary_chmod, cmd, TRUE);
+				g_chmod (cmd, perm | S_IXOTH);
+				changed = TRUE;
+			}
+		} else {
+			if (cur_exec) {
+				PROBE2 (binary_chmod, cmd, FALSE);
+				g_chmod (cmd, perm & ~(S_IXOTH));
+				changed = TRUE;
+			}
+		}
+	}
 
-	for (l = all_apps; l; l = l->next) {
-		GAppInfo *appinfo = G_APP_INFO (l->data);
-		if (!appinfo)
-			continue;
+	if (changed && full_desktop_id) {
+		/* For updating libgnome-menu cache */
+		GKeyFile *keyfile = g_key_file_new ();
+		if (g_key_file_load_from_file (keyfile, full_desktop_id,
+					G_KEY_FILE_KEEP_COMMENTS | G_KEY_FILE_KEEP_TRANSLATIONS, NULL)) {
+			g_key_file_save_to_file (keyfile, full_desktop_id, NULL);
+		}
+		g_key_file_free (keyfile);
+	}
 
-		const gchar *id;
-		GDesktopAppInfo *dt_info;
-		gchar *locale_name, *name, *exec;
+	return changed;
+}
 
-		dt_info = G_DESKTOP_APP_INFO (appinfo);
+static gboolean
+binary_is_executable (const gchar *cmd)
+{
+	GStatBuf stat_buf;
 
-		id = g_app_info_get_id (appinfo);
-		if (g_str_equal (id, find_str))
-			goto find;
+	return (g_stat (cmd, &stat_buf) == 0 && (stat_buf.st_mode & S_IXOTH));
+}
 
-		name = g_desktop_app_info_get_string (dt_info, G_KEY_FILE_DESKTOP_KEY_NAME);
-		if (name && ((g_utf8_collate (name, find_str) == 0) || (panel_g_utf8_strstrcase (name, find_str) != NULL))) {
-			goto find;
-		}
+/* Starts reading the desktop files of @dir and its subdirectories ahead,
+ * so that g_app_info_get_all(), which reads them one after the other,
+ * finds them in the page cache rather than waiting on the disk for each */
+static void
+prefetch_desktop_dir (const gchar *dir, guint depth)
+{
+	GDir *gdir;
+	const gchar *name;
 
-		locale_name = g_desktop_app_info_get_locale_string (dt_info, G_KEY_FILE_DESKTOP_KEY_NAME);
-		if (locale_name && ((g_utf8_collate (locale_name, find_str) == 0) || (panel_g_utf8_strstrcase (locale_name, find_str) != NULL))) {
-			goto find;
-		}
+	gdir = g_dir_open (dir, 0, NULL);
+	if (!gdir)
+		return;
 
-		exec = g_desktop_app_info_get_string (dt_info, G_KEY_FILE_DESKTOP_KEY_EXEC);
-		if (exec && ((g_utf8_collate (exec, find_str) == 0) || (panel_g_utf8_strstrcase (exec, find_str) != NULL))) {
-			goto find;
-		}
-		continue;
+	while ((name = g_dir_read_name (gdir))) {
+		gchar *path = g_build_filename (dir, name, NULL);
 
-find:
-		ret = g_strdup (g_desktop_app_info_get_filename (dt_info));
+		if (g_str_has_suffix (name, ".desktop")) {
+			gint fd = open (path, O_RDONLY | O_CLOEXEC);
+			if (fd >= 0) {
+				posix_fadvise (fd, 0, 0, POSIX_FADV_WILLNEED);
+				close (fd);
+			}
+		} else if (depth > 0 && g_file_test (path, G_FILE_TEST_IS_DIR)) {
+			prefetch_desktop_dir (path, depth - 1);
+		}
 
-		g_free (name);
-		g_free (locale_name);
-		g_free (exec);
-		break;
+		g_free (path);
 	}
-	g_list_free_full (all_apps, g_object_unref);
 
-	return ret;
+	g_dir_close (gdir);
 }
 
 static void
-make_exec_executable (const gchar *full_desktop_id, gboolean executable)
+prefetch_desktop_files (void)
 {
-	g_return_if_fail (full_desktop_id != NULL);
-
-	gchar *exec = NULL;
-	gboolean changed = FALSE;
-	GDesktopAppInfo *dt_appinfo;
-
-	dt_appinfo = g_desktop_app_info_new_from_filename (full_desktop_id);
+	guint i;
+	gchar *dir;
+	const gchar * const *dirs = g_get_system_data_dirs ();
+
+	dir = g_build_filename (g_get_user_data_dir (), "applications", NULL);
+	prefetch_desktop_dir (dir, 2);
+	g_free (dir);
+
+	for (i = 0; dirs[i]; i++) {
+		dir = g_build_filename (dirs[i], "applications", NULL);
+		prefetch_desktop_dir (dir, 2);
+		g_free (dir);
+	}
+}
 
-	exec = g_desktop_app_info_get_string (dt_appinfo, G_KEY_FILE_DESKTOP_KEY_EXEC);
+static void
+applications_stamp_dir (const gchar *dir, guint depth, guint64 *count, guint64 *sum)
+{
+	GDir *gdir;
+	GStatBuf st;
+	const gchar *name;
 
-	if (exec) {
-		GStatBuf stat_buf;
-		gchar **argv;
+	if (g_stat (dir, &st) < 0)
+		return;
 
-		g_shell_parse_argv (exec, NULL, &argv, NULL);
+	/* packages install desktop files by renaming them into place */
+	*sum += st.st_mtim.tv_sec * G_GUINT64_CONSTANT (1000000000) + st.st_mtim.tv_nsec;
 
-		if (g_strv_length (argv) > 0) {
-			gchar *cmd = g_find_program_in_path (argv[0]);
+	gdir = g_dir_open (dir, 0, NULL);
+	if (!gdir)
+		return;
 
-			if (g_stat (cmd, &stat_buf) == 0) {
-				mode_t perm = stat_buf.st_mode;
-				gboolean cur_exec = perm & S_IXOTH;
+	while ((name = g_dir_read_name (gdir))) {
+		gchar *path = g_build_filename (dir, name, NULL);
 
-				if (executable) {
-					if (!cur_exec) {
-						g_chmod (cmd, perm | S_IXOTH);
-						changed = TRUE;
-					}
-				} else {
-					if (cur_exec) {
-						g_chmod (cmd, perm & ~(S_IXOTH));
-						changed = TRUE;
-					}
-				}
+		if (g_str_has_suffix (name, ".desktop")) {
+			/* an edit in place only changes the file */
+			if (g_stat (path, &st) == 0) {
+				*sum += st.st_mtim.tv_sec * G_GUINT64_CONSTANT (1000000000) + st.st_mtim.tv_nsec;
+				(*count)++;
 			}
-			g_free (cmd);
+		} else if (depth > 0 && g_file_test (path, G_FILE_TEST_IS_DIR)) {
+			applications_stamp_dir (path, depth - 1, count, sum);
 		}
-		g_strfreev (argv);
+
+		g_free (path);
 	}
 
-	if (changed) {
-		/* For updating libgnome-menu cache */
-		GKeyFile *keyfile = g_key_file_new ();
-		if (g_key_file_load_from_file (keyfile, full_desktop_id,
-					G_KEY_FILE_KEEP_COMMENTS | G_KEY_FILE_KEEP_TRANSLATIONS, NULL)) {
-			g_key_file_save_to_file (keyfile, full_desktop_id, NULL);
-		}
-		g_key_file_free (keyfile);
+	g_dir_close (gdir);
+}
+
+/* A fingerprint of the desktop files items are resolved against, the
+ * same ones prefetch_desktop_files() reads; it changes when one is
+ * added, removed or changed, so that a blacklisted application
+ * installed later, or a new Exec line, gets resolved again */
+static gchar *
+applications_stamp (void)
+{
+	guint i;
+	gchar *dir;
+	guint64 count = 0, sum = 0;
+	const gchar * const *dirs = g_get_system_data_dirs ();
+
+	dir = g_build_filename (g_get_user_data_dir (), "applications", NULL);
+	applications_stamp_dir (dir, 2, &count, &sum);
+	g_free (dir);
+
+	for (i = 0; dirs[i]; i++) {
+		dir = g_build_filename (dirs[i], "applications", NULL);
+		applications_stamp_dir (dir, 2, &count, &sum);
+		g_free (dir);
 	}
 
-	g_object_unref (dt_appinfo);
+	return g_strdup_printf ("%" G_GUINT64_FORMAT ":%" G_GUINT64_FORMAT, count, sum);
 }
 
+/* Restores every application; only done when there is no state yet, so
+ * that whatever an older helper revoked is not left behind. */
 static void
-init_blacklist (void)
+init_blacklist (GList *all_apps)
 {
-	GList *all_apps = NULL, *l = NULL;
-
-	all_apps = g_app_info_get_all ();
+	GList *l = NULL;
 
 	for (l = all_apps; l; l = l->next) {
 		GAppInfo *appinfo = G_APP_INFO (l->data);
 		if (appinfo) {
+			gchar *cmd;
 			const gchar *full_desktop_id = g_desktop_app_info_get_filename (G_DESKTOP_APP_INFO (appinfo));
 
 			/* don't care gooroomupdate.desktop */
-			if (g_str_has_suffix (full_desktop_id, "gooroomupdate.desktop"))
+			if (!full_desktop_id || g_str_has_suffix (full_desktop_id, "gooroomupdate.desktop"))
 				continue;
 
 			/* restore exec permission */
-			make_exec_executable (full_desktop_id, TRUE);
+			cmd = blacklist_resolve_binary (full_desktop_id);
+			if (cmd)
+				set_binary_executable (cmd, full_desktop_id, TRUE);
+			g_free (cmd);
 		}
 	}
+}
 
-	g_list_free_full (all_apps, g_object_unref);
+static gint
+blacklist_lock (void)
+{
+	gint fd;
+
+	g_mkdir_with_parents (g_paths.lock_dir, 0755);
+
+	fd = open (g_paths.lock_file, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if (fd < 0) {
+		g_warning ("Failed to open %s: %s", g_paths.lock_file, g_strerror (errno));
+		return -1;
+	}
+
+	while (flock (fd, LOCK_EX) < 0) {
+		if (errno != EINTR) {
+			g_warning ("Failed to lock %s: %s", g_paths.lock_file, g_strerror (errno));
+			close (fd);
+			return -1;
+		}
+	}
+
+	return fd;
 }
 
-int
-main (int argc, char **argv)
+/* The uid of the session asking, as told by pkexec */
+static gchar *
+blacklist_owner (void)
 {
-	init_blacklist ();
+	const gchar *uid = g_getenv ("PKEXEC_UID");
+
+	if (uid && *uid)
+		return g_strdup (uid);
 
-	if (argc > 1) {
-		guint i = 0;
-		for (i = 1; argv[i]; i++) {
-			gchar *full_desktop_id = find_full_desktop_id (argv[i]);
-			g_debug ("Blacklist Destkop = %s", full_desktop_id);
-			if (!g_str_has_suffix (full_desktop_id, "gooroomupdate.desktop")) {
-				/* remove exec permission */
-				make_exec_executable (full_desktop_id, FALSE);
+	return g_strdup_printf ("%u", (guint) getuid ());
+}
+
+static gchar *
+owner_group (const gchar *owner)
+{
+	return g_strconcat (OWNER_GROUP_PREFIX, owner, NULL);
+}
+
+static gboolean
+strv_contains (gchar **strv, const gchar *str)
+{
+	for (; strv && *strv; strv++) {
+		if (g_str_equal (*strv, str))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+static gboolean
+state_remove_owner (GKeyFile *state, const gchar *group, const gchar *owner)
+{
+	guint i, n = 0;
+	gchar **owners;
+	GPtrArray *rest;
+
+	owners = g_key_file_get_string_list (state, group, "owners", NULL, NULL);
+	if (!strv_contains (owners, owner)) {
+		g_strfreev (owners);
+		return FALSE;
+	}
+
+	rest = g_ptr_array_new ();
+	for (i = 0; owners[i]; i++) {
+		if (!g_str_equal (owners[i], owner)) {
+			g_ptr_array_add (rest, owners[i]);
+			n++;
+		}
+	}
+
+	g_key_file_set_string_list (state, group, "owners",
+                                (const gchar * const *) rest->pdata, n);
+
+	g_ptr_array_free (rest, TRUE);
+	g_strfreev (owners);
+
+	return TRUE;
+}
+
+static void
+state_add_owner (GKeyFile *state, const gchar *group, const gchar *owner)
+{
+	gsize n = 0;
+	gchar **owners;
+
+	owners = g_key_file_get_string_list (state, group, "owners", &n, NULL);
+	if (!strv_contains (owners, owner)) {
+		owners = g_renew (gchar *, owners, n + 2);
+		owners[n] = g_strdup (owner);
+		owners[n + 1] = NULL;
+		n++;
+	}
+
+	g_key_file_set_string_list (state, group, "owners", (const gchar * const *) owners, n);
+
+	g_strfreev (owners);
+}
+
+/* Owners whose user has no session left (logind removes /run/user/<uid>
+ * at the last logout) no longer hold their binaries. uid 0 is the policy
+ * broker, which keeps its own record of its sessions. */
+static gboolean
+state_prune_owners (GKeyFile *state, const gchar *current)
+{
+	guint i, j;
+	gboolean pruned = FALSE;
+	gchar **groups;
+
+	groups = g_key_file_get_groups (state, NULL);
+	for (i = 0; groups[i]; i++) {
+		gchar *run_dir;
+		const gchar *owner;
+
+		if (!g_str_has_prefix (groups[i], OWNER_GROUP_PREFIX))
+			continue;
+
+		owner = groups[i] + strlen (OWNER_GROUP_PREFIX);
+		if (g_str_equal (owner, current) || g_str_equal (owner, "0"))
+			continue;
+
+		run_dir = g_strdup_printf ("/run/user/%s", owner);
+		if (!g_file_test (run_dir, G_FILE_TEST_IS_DIR)) {
+			for (j = 0; groups[j]; j++) {
+				if (!g_str_has_prefix (groups[j], OWNER_GROUP_PREFIX))
+					state_remove_owner (state, groups[j], owner);
 			}
+			g_key_file_remove_group (state, groups[i], NULL);
+			pruned = TRUE;
+		}
+		g_free (run_dir);
+	}
+	g_strfreev (groups);
+
+	return pruned;
+}
+
+/* Whether @owner already asked for @items, they were resolved against
+ * the desktop files installed now, and nothing undid it since, e.g. a
+ * package upgrade restoring the mode of a binary */
+static gboolean
+state_is_current (GKeyFile *state, const gchar *owner, gchar **items)
+{
+	guint i;
+	gchar *group, *old_stamp, *stamp;
+	gchar **old_items, **groups;
+	gboolean ret = TRUE;
+
+	group = owner_group (owner);
+	old_items = g_key_file_get_string_list (state, group, "items", NULL, NULL);
+	old_stamp = g_key_file_get_string (state, group, "applications", NULL);
+	g_free (group);
+
+	if (!old_items) {
+		g_free (old_stamp);
+		return (items[0] == NULL);
+	}
+
+	stamp = applications_stamp ();
+	ret = (g_strcmp0 (old_stamp, stamp) == 0);
+	g_free (old_stamp);
+	g_free (stamp);
+
+	if (!ret) {
+		g_strfreev (old_items);
+		return FALSE;
+	}
+
+	for (i = 0; old_items[i] && items[i]; i++) {
+		if (!g_str_equal (old_items[i], items[i]))
+			break;
+	}
+	ret = (old_items[i] == NULL && items[i] == NULL);
+	g_strfreev (old_items);
+
+	if (!ret)
+		return FALSE;
+
+	groups = g_key_file_get_groups (state, NULL);
+	for (i = 0; ret && groups[i]; i++) {
+		gchar **owners;
+
+		if (g_str_has_prefix (groups[i], OWNER_GROUP_PREFIX))
+			continue;
+
+		owners = g_key_file_get_string_list (state, groups[i], "owners", NULL, NULL);
+		if (strv_contains (owners, owner) && binary_is_executable (groups[i]))
+			ret = FALSE;
+		g_strfreev (owners);
+	}
+	g_strfreev (groups);
+
+	return ret;
+}
+
+static void
+state_apply (GKeyFile *state, GList *all_apps, const gchar *owner, gchar **items)
+{
+	guint i;
+	gchar *group;
+	gchar **groups;
+	GHashTable *wanted;
+	GHashTableIter iter;
+	gpointer key, value;
+
+	/* binary -> desktop file for the items of this owner */
+	wanted = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+	for (i = 0; items[i]; i++) {
+		gchar *cmd = NULL;
+		gchar *full_desktop_id = blacklist_resolve_desktop (all_apps, items[i]);
+
+		g_debug ("Blacklist Destkop = %s", full_desktop_id);
+
+		if (full_desktop_id && !g_str_has_suffix (full_desktop_id, "gooroomupdate.desktop"))
+			cmd = blacklist_resolve_binary (full_desktop_id);
+
+		PROBE3 (blacklist_match, items[i], full_desktop_id, cmd);
+
+		if (cmd)
+			g_hash_table_replace (wanted, cmd, full_desktop_id);
+		else
 			g_free (full_desktop_id);
+	}
+
+	groups = g_key_file_get_groups (state, NULL);
+	for (i = 0; groups[i]; i++) {
+		if (!g_str_has_prefix (groups[i], OWNER_GROUP_PREFIX) &&
+            !g_hash_table_contains (wanted, groups[i]))
+			state_remove_owner (state, groups[i], owner);
+	}
+	g_strfreev (groups);
+
+	g_hash_table_iter_init (&iter, wanted);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		g_key_file_set_string (state, key, "desktop", value);
+		state_add_owner (state, key, owner);
+	}
+	g_hash_table_destroy (wanted);
+
+	/* bring every recorded binary in line with its owners */
+	groups = g_key_file_get_groups (state, NULL);
+	for (i = 0; groups[i]; i++) {
+		gsize n = 0;
+		gchar *desktop;
+		gchar **owners;
+
+		if (g_str_has_prefix (groups[i], OWNER_GROUP_PREFIX))
+			continue;
+
+		desktop = g_key_file_get_string (state, groups[i], "desktop", NULL);
+		owners = g_key_file_get_string_list (state, groups[i], "owners", &n, NULL);
+
+		if (n == 0) {
+			/* remove exec permission no more */
+			set_binary_executable (groups[i], desktop, TRUE);
+			g_key_file_remove_group (state, groups[i], NULL);
+		} else {
+			/* remove exec permission */
+			set_binary_executable (groups[i], desktop, FALSE);
 		}
+
+		g_strfreev (owners);
+		g_free (desktop);
+	}
+	g_strfreev (groups);
+
+	group = owner_group (owner);
+	if (items[0]) {
+		/* taken after the desktop files of changed binaries were
+		 * rewritten above */
+		gchar *stamp = applications_stamp ();
+
+		g_key_file_set_string_list (state, group, "items",
+                                    (const gchar * const *) items, g_strv_length (items));
+		g_key_file_set_string (state, group, "applications", stamp);
+		g_free (stamp);
+	} else {
+		g_key_file_remove_group (state, group, NULL);
 	}
+	g_free (group);
+}
+
+int
+main (int argc, char **argv)
+{
+	gint lock_fd;
+	gchar *owner;
+	gchar **items;
+	GKeyFile *state;
+	GList *all_apps;
+	GError *error = NULL;
+	gboolean first_run, pruned;
+
+	items = argv + 1;
+
+	root_paths_init (g_root_paths, G_N_ELEMENTS (g_root_paths));
+
+	/* without the lock a concurrent run could lose our update of the
+	 * state file, leaving binaries revoked for good */
+	lock_fd = blacklist_lock ();
+	if (lock_fd < 0) {
+		root_paths_free (g_root_paths, G_N_ELEMENTS (g_root_paths));
+		return 1;
+	}
+
+	state = g_key_file_new ();
+	first_run = !g_key_file_load_from_file (state, g_paths.state_file, G_KEY_FILE_NONE, NULL);
+
+	owner = blacklist_owner ();
+	pruned = state_prune_owners (state, owner);
+
+	/* a concurrent run may have done it already */
+	if (!first_run && !pruned && state_is_current (state, owner, items)) {
+		g_debug ("Blacklist of %s is up to date", owner);
+		goto out;
+	}
+
+	prefetch_desktop_files ();
+	all_apps = g_app_info_get_all ();
+
+	if (first_run)
+		init_blacklist (all_apps);
+
+	state_apply (state, all_apps, owner, items);
+
+	g_list_free_full (all_apps, g_object_unref);
+
+	g_mkdir_with_parents (g_paths.state_dir, 0755);
+	if (!g_key_file_save_to_file (state, g_paths.state_file, &error)) {
+		g_warning ("Failed to save %s: %s", g_paths.state_file, error->message);
+		g_clear_error (&error);
+	}
+
+out:
+	g_key_file_free (state);
+	g_free (owner);
+
+	close (lock_fd);
+
+	root_paths_free (g_root_paths, G_N_ELEMENTS (g_root_paths));
 
 	return 0;
 }
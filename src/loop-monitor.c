@@ -0,0 +1,235 @@
+/*
+ * loop-monitor.c: main loop stall detection
+ *
+ * Copyright (C) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "loop-monitor.h"
+#include "metrics.h"
+#include "flight-recorder.h"
+
+
+struct _LoopMonitor {
+	gchar        *name;
+	GMainContext *context;
+	GSource      *heartbeat;
+
+	/* shared with the watchdog, under g_lock */
+	gint64        due_us;           /* when the next beat should run */
+	const gchar  *current;          /* callback running, or NULL */
+	gint64        current_since;
+	guint         depth;
+	gchar         culprit[48];      /* slowest callback since the last beat */
+	gint64        culprit_us;
+	gboolean      warned;
+};
+
+static GMutex    g_lock;
+static GCond     g_watchdog_cond;
+static GSList   *g_monitors = NULL;
+static GThread  *g_watchdog = NULL;
+static gboolean  g_watchdog_quit = FALSE;
+
+
+
+static gboolean
+heartbeat_cb (gpointer data)
+{
+	LoopMonitor *monitor = (LoopMonitor *)data;
+	gchar culprit[sizeof (monitor->culprit)];
+	gint64 now, lag;
+	gboolean stalled;
+
+	now = g_get_monotonic_time ();
+
+	g_mutex_lock (&g_lock);
+	lag = MAX (now - monitor->due_us, 0);
+	stalled = (lag > LOOP_MONITOR_STALL_MS * G_GINT64_CONSTANT (1000));
+	if (stalled) {
+		/* a shorter callback did not stall the loop on its own */
+		g_strlcpy (culprit, (monitor->culprit_us >= LOOP_MONITOR_STALL_MS * G_GINT64_CONSTANT (1000)) ?
+                            monitor->culprit : "unattributed", sizeof (culprit));
+	}
+	monitor->due_us = now + LOOP_MONITOR_INTERVAL_MS * G_GINT64_CONSTANT (1000);
+	monitor->culprit[0] = '\0';
+	monitor->culprit_us = 0;
+	monitor->warned = FALSE;
+	g_mutex_unlock (&g_lock);
+
+	metrics_observe ("loop_lag", monitor->name, lag);
+
+	if (stalled) {
+		metrics_count ("loop_stalls", monitor->name, 1);
+		metrics_observe ("loop_stall_source", culprit, lag);
+		flight_record (FLIGHT_EVENT_STALL, culprit, 0, lag);
+	}
+
+	return G_SOURCE_CONTINUE;
+}
+
+static gpointer
+watchdog_func (gpointer data)
+{
+	GSList *l, *warnings;
+
+	g_mutex_lock (&g_lock);
+
+	while (!g_watchdog_quit) {
+		gint64 now = g_get_monotonic_time ();
+
+		warnings = NULL;
+		for (l = g_monitors; l; l = l->next) {
+			LoopMonitor *monitor = (LoopMonitor *)l->data;
+
+			if (monitor->warned || now - monitor->due_us < LOOP_MONITOR_WARN_MS * G_GINT64_CONSTANT (1000))
+				continue;
+
+			/* @current is only valid while the lock is held */
+			monitor->warned = TRUE;
+			warnings = g_slist_prepend (warnings,
+                                        g_strdup_printf ("The %s loop has been stalled for %d ms in %s",
+                                                         monitor->name, (gint) ((now - monitor->due_us) / 1000),
+                                                         monitor->current ? monitor->current : "an unnamed source"));
+		}
+
+		if (warnings) {
+			g_mutex_unlock (&g_lock);
+			for (l = warnings; l; l = l->next)
+				g_warning ("%s", (const gchar *)l->data);
+			g_slist_free_full (warnings, g_free);
+			g_mutex_lock (&g_lock);
+			continue;
+		}
+
+		g_cond_wait_until (&g_watchdog_cond, &g_lock,
+                           now + LOOP_MONITOR_INTERVAL_MS * G_GINT64_CONSTANT (1000));
+	}
+
+	g_mutex_unlock (&g_lock);
+
+	return NULL;
+}
+
+/* @context is NULL for the default one */
+LoopMonitor *
+loop_monitor_new (const gchar *name, GMainContext *context)
+{
+	LoopMonitor *monitor;
+
+	monitor = g_new0 (LoopMonitor, 1);
+	monitor->name = g_strdup (name);
+	monitor->context = g_main_context_ref (context ? context : g_main_context_default ());
+	monitor->due_us = g_get_monotonic_time () + LOOP_MONITOR_INTERVAL_MS * G_GINT64_CONSTANT (1000);
+
+	g_mutex_lock (&g_lock);
+	g_monitors = g_slist_prepend (g_monitors, monitor);
+	if (!g_watchdog) {
+		g_watchdog_quit = FALSE;
+		g_watchdog = g_thread_new ("gsm-watchdog", watchdog_func, NULL);
+	}
+	g_mutex_unlock (&g_lock);
+
+	monitor->heartbeat = g_timeout_source_new (LOOP_MONITOR_INTERVAL_MS);
+	g_source_set_name (monitor->heartbeat, "loop-monitor");
+	g_source_set_callback (monitor->heartbeat, heartbeat_cb, monitor, NULL);
+	g_source_attach (monitor->heartbeat, monitor->context);
+
+	return monitor;
+}
+
+void
+loop_monitor_free (LoopMonitor *monitor)
+{
+	GThread *watchdog = NULL;
+
+	if (!monitor)
+		return;
+
+	g_source_destroy (monitor->heartbeat);
+	g_source_unref (monitor->heartbeat);
+
+	g_mutex_lock (&g_lock);
+	g_monitors = g_slist_remove (g_monitors, monitor);
+	if (!g_monitors) {
+		watchdog = g_watchdog;
+		g_watchdog = NULL;
+		g_watchdog_quit = TRUE;
+		g_cond_signal (&g_watchdog_cond);
+	}
+	g_mutex_unlock (&g_lock);
+
+	if (watchdog)
+		g_thread_join (watchdog);
+
+	g_main_context_unref (monitor->context);
+	g_free (monitor->name);
+	g_free (monitor);
+}
+
+/* Called with the lock held; NULL on threads not dispatching a
+ * monitored context, e.g. the workers of a pool */
+static LoopMonitor *
+monitor_for_thread (void)
+{
+	GSList *l;
+	GMainContext *context;
+
+	context = g_main_context_get_thread_default ();
+	if (!context)
+		context = g_main_context_default ();
+
+	for (l = g_monitors; l; l = l->next) {
+		LoopMonitor *monitor = (LoopMonitor *)l->data;
+		if (monitor->context == context)
+			return g_main_context_is_owner (context) ? monitor : NULL;
+	}
+
+	return NULL;
+}
+
+void
+loop_monitor_enter (const gchar *what)
+{
+	LoopMonitor *monitor;
+
+	g_mutex_lock (&g_lock);
+	monitor = monitor_for_thread ();
+	if (monitor && monitor->depth++ == 0) {
+		monitor->current = what;
+		monitor->current_since = g_get_monotonic_time ();
+	}
+	g_mutex_unlock (&g_lock);
+}
+
+void
+loop_monitor_leave (void)
+{
+	gint64 elapsed;
+	LoopMonitor *monitor;
+
+	g_mutex_lock (&g_lock);
+	monitor = monitor_for_thread ();
+	if (monitor && monitor->depth > 0 && --monitor->depth == 0) {
+		elapsed = g_get_monotonic_time () - monitor->current_since;
+		if (elapsed > monitor->culprit_us) {
+			monitor->culprit_us = elapsed;
+			g_strlcpy (monitor->culprit, monitor->current ? monitor->current : "", sizeof (monitor->culprit));
+		}
+		monitor->current = NULL;
+	}
+	g_mutex_unlock (&g_lock);
+}
@@ -0,0 +1,54 @@
+/*
+ * loop-monitor.h: main loop stall detection
+ *
+ * Copyright (C) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef LOOP_MONITOR_H
+#define LOOP_MONITOR_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* A heartbeat on the monitored context measures how late its sources are
+ * dispatched. Every lag goes to the "loop_lag" histogram. When a beat is
+ * later than LOOP_MONITOR_STALL_MS, the stall is counted in
+ * "loop_stalls". It is also recorded in "loop_stall_source", under the
+ * slowest callback that ran since the previous beat. Only the callbacks
+ * bracketed by loop_monitor_enter() and loop_monitor_leave() can be
+ * named; the others show up as "unattributed".
+ * A watchdog thread warns about a stall while it still lasts. */
+#define LOOP_MONITOR_INTERVAL_MS    100
+#define LOOP_MONITOR_STALL_MS       50
+#define LOOP_MONITOR_WARN_MS        1000
+
+typedef struct _LoopMonitor LoopMonitor;
+
+LoopMonitor *loop_monitor_new   (const gchar  *name,
+                                 GMainContext *context);
+void         loop_monitor_free  (LoopMonitor  *monitor);
+
+/* Names the callback running on the calling thread's monitored context,
+ * if any; @what must stay valid until loop_monitor_leave(). Nested calls
+ * are attributed to the outermost one. */
+void         loop_monitor_enter (const gchar  *what);
+void         loop_monitor_leave (void);
+
+G_END_DECLS
+
+#endif /* LOOP_MONITOR_H */
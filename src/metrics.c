@@ -0,0 +1,212 @@
+/*
+ * metrics.c: counters and latency histograms of a running process
+ *
+ * Copyright (C) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "metrics.h"
+
+/* from a fast D-Bus call to a helper waiting for a password */
+static const guint64 bucket_bounds[] = {
+	100, 250, 500,
+	1000, 2500, 5000,
+	10000, 25000, 50000,
+	100000, 250000, 500000,
+	1000000, 2500000, 5000000,
+	10000000
+};
+
+#define N_BUCKETS               (G_N_ELEMENTS (bucket_bounds) + 1)
+
+typedef struct {
+	gboolean histogram;
+	guint64  value;                 /* count of observations for a histogram */
+	guint64  sum_us;
+	guint64  buckets[N_BUCKETS];
+} Metric;
+
+static GMutex      g_lock;
+static GHashTable *g_names = NULL;      /* name -> GHashTable of label -> Metric */
+
+
+
+/* Called with the lock held. Looking up does not allocate, so that the
+ * paths counted stay free of allocations. */
+static Metric *
+metric_get (const gchar *name, const gchar *label, gboolean histogram)
+{
+	Metric *metric;
+	GHashTable *labels;
+
+	if (!label)
+		label = "";
+
+	if (!g_names)
+		g_names = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                         g_free, (GDestroyNotify) g_hash_table_destroy);
+
+	labels = g_hash_table_lookup (g_names, name);
+	if (!labels) {
+		labels = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+		g_hash_table_insert (g_names, g_strdup (name), labels);
+	}
+
+	metric = g_hash_table_lookup (labels, label);
+	if (!metric) {
+		metric = g_new0 (Metric, 1);
+		metric->histogram = histogram;
+		g_hash_table_insert (labels, g_strdup (label), metric);
+	}
+
+	return metric;
+}
+
+void
+metrics_count (const gchar *name, const gchar *label, guint64 n)
+{
+	g_return_if_fail (name != NULL);
+
+	g_mutex_lock (&g_lock);
+	metric_get (name, label, FALSE)->value += n;
+	g_mutex_unlock (&g_lock);
+}
+
+void
+metrics_observe (const gchar *name, const gchar *label, gint64 elapsed_us)
+{
+	guint i;
+	Metric *metric;
+
+	g_return_if_fail (name != NULL);
+
+	if (elapsed_us < 0)
+		elapsed_us = 0;
+
+	for (i = 0; i < G_N_ELEMENTS (bucket_bounds); i++) {
+		if ((guint64) elapsed_us <= bucket_bounds[i])
+			break;
+	}
+
+	g_mutex_lock (&g_lock);
+	metric = metric_get (name, label, TRUE);
+	metric->value++;
+	metric->sum_us += elapsed_us;
+	metric->buckets[i]++;
+	g_mutex_unlock (&g_lock);
+}
+
+GVariant *
+metrics_get_counters (void)
+{
+	GVariantBuilder builder;
+	GHashTableIter names, labels;
+	gpointer name, label, table, value;
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sst)"));
+
+	g_mutex_lock (&g_lock);
+
+	if (g_names) {
+		g_hash_table_iter_init (&names, g_names);
+		while (g_hash_table_iter_next (&names, &name, &table)) {
+			g_hash_table_iter_init (&labels, table);
+			while (g_hash_table_iter_next (&labels, &label, &value)) {
+				Metric *metric = (Metric *)value;
+				if (!metric->histogram)
+					g_variant_builder_add (&builder, "(sst)", name, label, metric->value);
+			}
+		}
+	}
+
+	g_mutex_unlock (&g_lock);
+
+	return g_variant_builder_end (&builder);
+}
+
+GVariant *
+metrics_get_bounds (void)
+{
+	return g_variant_new_fixed_array (G_VARIANT_TYPE_UINT64, bucket_bounds,
+                                      G_N_ELEMENTS (bucket_bounds), sizeof (guint64));
+}
+
+GVariant *
+metrics_get_histograms (void)
+{
+	GVariantBuilder builder;
+	GHashTableIter names, labels;
+	gpointer name, label, table, value;
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ssttat)"));
+
+	g_mutex_lock (&g_lock);
+
+	if (g_names) {
+		g_hash_table_iter_init (&names, g_names);
+		while (g_hash_table_iter_next (&names, &name, &table)) {
+			g_hash_table_iter_init (&labels, table);
+			while (g_hash_table_iter_next (&labels, &label, &value)) {
+				Metric *metric = (Metric *)value;
+				if (!metric->histogram)
+					continue;
+				g_variant_builder_add (&builder, "(sstt@at)", name, label,
+                                       metric->value, metric->sum_us,
+                                       g_variant_new_fixed_array (G_VARIANT_TYPE_UINT64, metric->buckets,
+                                                                  N_BUCKETS, sizeof (guint64)));
+			}
+		}
+	}
+
+	g_mutex_unlock (&g_lock);
+
+	return g_variant_builder_end (&builder);
+}
+
+/* The metrics of @name as debug messages */
+void
+metrics_log (const gchar *name)
+{
+	GHashTable *labels;
+	GHashTableIter iter;
+	gpointer label, value;
+
+	g_mutex_lock (&g_lock);
+
+	labels = g_names ? g_hash_table_lookup (g_names, name) : NULL;
+	if (labels) {
+		g_hash_table_iter_init (&iter, labels);
+		while (g_hash_table_iter_next (&iter, &label, &value)) {
+			Metric *metric = (Metric *)value;
+			if (metric->histogram)
+				g_debug ("%s %-36s count=%" G_GUINT64_FORMAT " avg=%.1f ms", name,
+                         (const gchar *)label, metric->value,
+                         metric->value ? metric->sum_us / 1000.0 / metric->value : 0.0);
+			else
+				g_debug ("%s %-36s %" G_GUINT64_FORMAT, name, (const gchar *)label, metric->value);
+		}
+	}
+
+	g_mutex_unlock (&g_lock);
+}
+
+void
+metrics_shutdown (void)
+{
+	g_mutex_lock (&g_lock);
+	g_clear_pointer (&g_names, g_hash_table_destroy);
+	g_mutex_unlock (&g_lock);
+}
@@ -0,0 +1,56 @@
+/*
+ * metrics.h: counters and latency histograms of a running process
+ *
+ * Copyright (C) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Metrics are kept by name and label, e.g. "agent_call" and the task
+ * name; a name is either a counter or a histogram. Everything can be
+ * called from any thread, and only the first use of a name and label
+ * allocates. */
+
+void      metrics_count          (const gchar *name,
+                                  const gchar *label,
+                                  guint64      n);
+void      metrics_observe        (const gchar *name,
+                                  const gchar *label,
+                                  gint64       elapsed_us);
+
+/* a(sst): name, label and value of every counter */
+GVariant *metrics_get_counters   (void);
+
+/* at: the upper bounds of the histogram buckets in microseconds, the
+ * last bucket has none */
+GVariant *metrics_get_bounds     (void);
+
+/* a(ssttat): name, label, number of observations, their sum in
+ * microseconds and the count of every bucket */
+GVariant *metrics_get_histograms (void);
+
+void      metrics_log            (const gchar *name);
+void      metrics_shutdown       (void);
+
+G_END_DECLS
+
+#endif /* METRICS_H */
@@ -0,0 +1,316 @@
+/*
+ * notification-queue.c: coalescing, asynchronous desktop notifications
+ *
+ * Copyright (C) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <gio/gio.h>
+
+#include "notification-queue.h"
+#include "metrics.h"
+#include "flight-recorder.h"
+
+/* Events of one category arriving within this window are folded into
+ * a single notification. */
+#define BURST_WINDOW_MS         1000
+
+#define NOTIFICATIONS_NAME      "org.freedesktop.Notifications"
+#define NOTIFICATIONS_PATH      "/org/freedesktop/Notifications"
+
+
+typedef struct {
+	gchar                 *name;
+	NotificationBurstFunc  burst_func;
+	guint                  flush_id;
+	guint                  pending;
+	gchar                 *summary;
+	gchar                 *message;
+	gchar                 *icon;
+	guint32                id;          /* replaced by the next one */
+	gboolean               in_flight;   /* until the daemon gave the id */
+	gboolean               held;        /* a flush waits for the id */
+} Category;
+
+typedef struct {
+	gchar *category;
+	gchar *summary;
+	gchar *message;
+	gchar *icon;
+} Request;
+
+/* Everything is owned by the default main context. Notifications are
+ * sent with an asynchronous Notify call instead of libnotify, whose
+ * show blocks and which is not safe to use from a second thread. */
+static GHashTable      *g_categories = NULL;
+static GDBusConnection *g_bus = NULL;
+static gchar           *g_app_name = NULL;
+
+
+
+static Request *
+request_new (const gchar *category,
+             const gchar *summary,
+             const gchar *message,
+             const gchar *icon)
+{
+	Request *req = g_new0 (Request, 1);
+
+	req->category = g_strdup (category);
+	req->summary = g_strdup (summary);
+	req->message = g_strdup (message);
+	req->icon = g_strdup (icon);
+
+	return req;
+}
+
+static void
+request_free (gpointer data)
+{
+	Request *req = (Request *)data;
+
+	g_free (req->category);
+	g_free (req->summary);
+	g_free (req->message);
+	g_free (req->icon);
+	g_free (req);
+}
+
+static void
+category_free (gpointer data)
+{
+	Category *cat = (Category *)data;
+
+	if (cat->flush_id)
+		g_source_remove (cat->flush_id);
+
+	g_free (cat->name);
+	g_free (cat->summary);
+	g_free (cat->message);
+	g_free (cat->icon);
+	g_free (cat);
+}
+
+static Category *
+category_get (const gchar *name)
+{
+	Category *cat = g_hash_table_lookup (g_categories, name);
+
+	if (!cat) {
+		cat = g_new0 (Category, 1);
+		cat->name = g_strdup (name);
+		g_hash_table_insert (g_categories, cat->name, cat);
+	}
+
+	return cat;
+}
+
+static void category_flush (Category *cat);
+
+static void
+notify_done_cb (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+	gchar *name = (gchar *)user_data;
+	GVariant *ret;
+	GError *error = NULL;
+	Category *cat;
+
+	cat = g_categories ? g_hash_table_lookup (g_categories, name) : NULL;
+
+	ret = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source), res, &error);
+	if (ret) {
+		if (cat)
+			g_variant_get (ret, "(u)", &cat->id);
+		g_variant_unref (ret);
+	} else {
+		flight_record_error (FLIGHT_EVENT_ERROR, "notification", error);
+		g_warning ("Failed to show notification: %s", error->message);
+		g_error_free (error);
+	}
+
+	if (cat) {
+		cat->in_flight = FALSE;
+		/* what arrived meanwhile now replaces the one just shown */
+		if (cat->held) {
+			cat->held = FALSE;
+			category_flush (cat);
+		}
+	}
+
+	g_free (name);
+}
+
+static void
+category_send (Category *cat, const gchar *summary, const gchar *message, const gchar *icon)
+{
+	GVariantBuilder hints;
+
+	if (!g_bus)
+		return;
+
+	metrics_count ("notifications_shown", cat->name, 1);
+	cat->in_flight = TRUE;
+
+	g_variant_builder_init (&hints, G_VARIANT_TYPE ("a{sv}"));
+	g_variant_builder_add (&hints, "{sv}", "urgency", g_variant_new_byte (1));
+
+	g_dbus_connection_call (g_bus,
+                            NOTIFICATIONS_NAME,
+                            NOTIFICATIONS_PATH,
+                            NOTIFICATIONS_NAME,
+                            "Notify",
+                            g_variant_new ("(susssasa{sv}i)",
+                                           g_app_name, cat->id,
+                                           icon ? icon : "",
+                                           summary ? summary : "",
+                                           message ? message : "",
+                                           NULL, &hints, -1),
+                            G_VARIANT_TYPE ("(u)"),
+                            G_DBUS_CALL_FLAGS_NONE, -1,
+                            NULL, notify_done_cb, g_strdup (cat->name));
+}
+
+static void
+category_flush (Category *cat)
+{
+	if (cat->pending == 0)
+		return;
+
+	/* the first event of the window was shown, the last one is now */
+	if (cat->pending > 1)
+		metrics_count ("notifications_coalesced", cat->name, cat->pending - 1);
+
+	if (cat->pending > 1 && cat->burst_func) {
+		gchar *body = cat->burst_func (cat->pending);
+		category_send (cat, cat->summary, body, cat->icon);
+		g_free (body);
+	} else {
+		category_send (cat, cat->summary, cat->message, cat->icon);
+	}
+
+	cat->pending = 0;
+}
+
+static gboolean
+category_flush_cb (gpointer data)
+{
+	Category *cat = (Category *)data;
+
+	if (cat->pending == 0) {
+		/* quiet for a whole window, next event is shown immediately */
+		cat->flush_id = 0;
+		return FALSE;
+	}
+
+	/* sent without the id of the one before, it would be shown next to
+	 * it; the reply flushes what is pending by then */
+	if (cat->in_flight)
+		cat->held = TRUE;
+	else
+		category_flush (cat);
+
+	return TRUE;
+}
+
+static gboolean
+push_idle (gpointer data)
+{
+	Request *req = (Request *)data;
+	Category *cat;
+
+	if (!g_categories)
+		return FALSE;
+
+	cat = category_get (req->category);
+
+	if (cat->flush_id == 0) {
+		cat->flush_id = g_timeout_add (BURST_WINDOW_MS, category_flush_cb, cat);
+		if (!cat->in_flight) {
+			category_send (cat, req->summary, req->message, req->icon);
+			return FALSE;
+		}
+		cat->held = TRUE;
+	}
+
+	cat->pending++;
+
+	g_free (cat->summary);
+	g_free (cat->message);
+	g_free (cat->icon);
+	cat->summary = g_strdup (req->summary);
+	cat->message = g_strdup (req->message);
+	cat->icon = g_strdup (req->icon);
+
+	return FALSE;
+}
+
+void
+notification_queue_init (const gchar *app_name)
+{
+	GError *error = NULL;
+
+	g_return_if_fail (g_categories == NULL);
+
+	g_app_name = g_strdup (app_name);
+
+	g_categories = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, category_free);
+
+	g_bus = g_bus_get_sync (G_BUS_TYPE_SESSION, NULL, &error);
+	if (!g_bus) {
+		g_warning ("Notifications disabled: %s", error->message);
+		g_error_free (error);
+	}
+}
+
+void
+notification_queue_shutdown (void)
+{
+	if (!g_categories)
+		return;
+
+	g_clear_pointer (&g_categories, g_hash_table_destroy);
+
+	/* sends still in flight find no category when they complete */
+	if (g_bus)
+		g_dbus_connection_flush_sync (g_bus, NULL, NULL);
+	g_clear_object (&g_bus);
+
+	g_clear_pointer (&g_app_name, g_free);
+}
+
+/* Must be called from the default main context */
+void
+notification_queue_add_category (const gchar           *category,
+                                 NotificationBurstFunc  burst_func)
+{
+	g_return_if_fail (g_categories != NULL);
+
+	category_get (category)->burst_func = burst_func;
+}
+
+/* Can be called from any thread */
+void
+notification_queue_push (const gchar *category,
+                         const gchar *summary,
+                         const gchar *message,
+                         const gchar *icon)
+{
+	g_return_if_fail (category != NULL);
+
+	g_main_context_invoke_full (NULL, G_PRIORITY_DEFAULT, push_idle,
+                                request_new (category, summary, message, icon),
+                                request_free);
+}
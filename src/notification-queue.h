@@ -0,0 +1,44 @@
+/*
+ * notification-queue.h: coalescing, asynchronous desktop notifications
+ *
+ * Copyright (C) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef NOTIFICATION_QUEUE_H
+#define NOTIFICATION_QUEUE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Returns a newly allocated body for a burst of @count events */
+typedef gchar *(*NotificationBurstFunc) (guint count);
+
+void notification_queue_init         (const gchar *app_name);
+void notification_queue_shutdown     (void);
+
+void notification_queue_add_category (const gchar           *category,
+                                      NotificationBurstFunc  burst_func);
+
+void notification_queue_push         (const gchar *category,
+                                      const gchar *summary,
+                                      const gchar *message,
+                                      const gchar *icon);
+
+G_END_DECLS
+
+#endif /* NOTIFICATION_QUEUE_H */
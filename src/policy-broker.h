@@ -0,0 +1,32 @@
+/*
+ * policy-broker.h: names of the host policy broker service
+ *
+ * Copyright (C) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef POLICY_BROKER_H
+#define POLICY_BROKER_H
+
+/* gooroom-policy-broker runs once per host on the system bus. Session
+ * managers ask it for their agent policy and hand host-wide enforcement
+ * to it, so that many sessions on one host cost one agent request per
+ * user and task, and one blacklist helper run per distinct blacklist. */
+#define POLICY_BROKER_NAME          "kr.gooroom.PolicyBroker"
+#define POLICY_BROKER_PATH          "/kr/gooroom/PolicyBroker"
+#define POLICY_BROKER_INTERFACE     "kr.gooroom.PolicyBroker"
+
+#endif /* POLICY_BROKER_H */
@@ -0,0 +1,66 @@
+/*
+ * probes.h: USDT probes for bpftrace and perf
+ *
+ * Copyright (C) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef PROBES_H
+#define PROBES_H
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+
+/* With --enable-usdt every PROBE is a nop instruction and a note in the
+ * binary, under the "gooroom" provider, that bpftrace or perf can attach
+ * to in a running process, e.g.
+ *
+ *   bpftrace -e 'usdt:/usr/lib/gooroom-session-manager/gooroom-session-manager:gooroom:signal_return
+ *                { @[str(arg0)] = hist(arg1); }' -p PID
+ *
+ * Otherwise the probes and their arguments compile to nothing, so they
+ * must have no side effects.
+ *
+ *   signal_entry      (signal, payload bytes)
+ *   signal_return     (signal, duration us, handled)
+ *   agent_call_start  (task)
+ *   agent_call_done   (task, duration us, failed)
+ *   spawn_start       (name)
+ *   spawn_done        (name, pid or -1)
+ *   process_exit      (name, wait status, duration us)
+ *   settings_write    (key)
+ *   blacklist_match   (item, desktop file or NULL, binary or NULL)
+ *   binary_chmod      (binary, executable)
+ */
+
+#ifdef ENABLE_USDT
+#include <sys/sdt.h>
+
+#define PROBE(name)                 DTRACE_PROBE (gooroom, name)
+#define PROBE1(name, a)             DTRACE_PROBE1 (gooroom, name, a)
+#define PROBE2(name, a, b)          DTRACE_PROBE2 (gooroom, name, a, b)
+#define PROBE3(name, a, b, c)       DTRACE_PROBE3 (gooroom, name, a, b, c)
+#else
+#define PROBE(name)                 G_STMT_START { } G_STMT_END
+#define PROBE1(name, a)             G_STMT_START { } G_STMT_END
+#define PROBE2(name, a, b)          G_STMT_START { } G_STMT_END
+#define PROBE3(name, a, b, c)       G_STMT_START { } G_STMT_END
+#endif
+
+#endif /* PROBES_H */
@@ -0,0 +1,856 @@
+/*
+ * process-registry.c: bookkeeping for the processes we spawn
+ *
+ * Copyright (C) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <glib-unix.h>
+
+#include "process-registry.h"
+#include "metrics.h"
+#include "trace.h"
+#include "flight-recorder.h"
+#include "probes.h"
+
+/* relative to the default of 100 for both */
+#define BACKGROUND_CPU_WEIGHT   20
+#define BACKGROUND_IO_WEIGHT    20
+
+/* how long a child may wait for its scope before it runs without one */
+#define SCOPE_TIMEOUT_MS        1000
+
+#define SYSTEMD_NAME            "org.freedesktop.systemd1"
+#define SYSTEMD_PATH            "/org/freedesktop/systemd1"
+#define SYSTEMD_MANAGER         "org.freedesktop.systemd1.Manager"
+
+/* how often a group whose leader has exited is checked for members */
+#define GROUP_POLL_MS           1000
+
+typedef struct {
+	gchar           *name;
+	GPid             pid;
+	gint             pidfd;
+	gboolean         group;
+	gboolean         leader_exited; /* only the group is left */
+	gint64           start_us;
+	ProcessExitFunc  exit_func;
+	gpointer         user_data;
+} Process;
+
+static GMutex        g_lock;
+static GMainContext *g_context = NULL;
+static GHashTable   *g_by_pid = NULL;   /* GPid -> Process */
+static GHashTable   *g_by_name = NULL;  /* name -> GPtrArray of Process */
+static GBusType      g_scope_bus_type = G_BUS_TYPE_NONE;
+
+/* owned by the registry's context */
+static GDBusConnection *g_scope_bus = NULL;     /* subscribed to systemd */
+static GList           *g_scopes = NULL;        /* ScopeStart being started */
+
+typedef struct {
+	gboolean new_group;
+	gint     wait_fd;               /* the scope pipe, or -1 */
+	gint     release_fd;
+} ChildSetup;
+
+/* A scope being started for a child that waits for it. Everything runs
+ * on the registry's context; the callbacks still pending hold a
+ * reference each. */
+typedef struct {
+	guint            ref_count;
+	gchar           *name;
+	gchar           *unit;
+	GPid             pid;
+	gint             release_fd;    /* closed once the child may run */
+	GDBusConnection *bus;
+	guint            job_removed_id;
+	guint            timeout_id;
+} ScopeStart;
+
+
+
+static gint
+pidfd_open_compat (GPid pid)
+{
+#ifdef SYS_pidfd_open
+	return (gint) syscall (SYS_pidfd_open, pid, 0);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/* A process group id is not given to a new process while the group
+ * has members, so it stays valid after the leader has been reaped */
+static gboolean
+process_group_alive (GPid pgid)
+{
+	return (kill (-pgid, 0) == 0 || errno == EPERM);
+}
+
+static gboolean
+process_alive (Process *proc)
+{
+	struct pollfd pfd;
+
+	if (proc->leader_exited)
+		return process_group_alive (proc->pid);
+
+	/* without a pidfd, an unreaped child still owns its pid */
+	if (proc->pidfd < 0)
+		return TRUE;
+
+	pfd.fd = proc->pidfd;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+
+	/* a pidfd becomes readable once the process has exited */
+	return (poll (&pfd, 1, 0) == 0);
+}
+
+static gint
+process_signal (Process *proc, gint signum)
+{
+	if (!process_alive (proc)) {
+		errno = ESRCH;
+		return -1;
+	}
+
+	if (proc->group)
+		return kill (-proc->pid, signum);
+
+#ifdef SYS_pidfd_send_signal
+	if (proc->pidfd >= 0)
+		return (gint) syscall (SYS_pidfd_send_signal, proc->pidfd, signum, NULL, 0);
+#endif
+
+	return kill (proc->pid, signum);
+}
+
+static void
+process_free (gpointer data)
+{
+	Process *proc = (Process *)data;
+
+	if (proc->pidfd >= 0)
+		close (proc->pidfd);
+
+	if (!proc->leader_exited)
+		g_spawn_close_pid (proc->pid);
+
+	g_free (proc->name);
+	g_free (proc);
+}
+
+/* Runs in the child between fork and exec */
+static void
+child_setup (gpointer data)
+{
+	ChildSetup *setup = (ChildSetup *)data;
+	gchar c;
+
+	if (setup->new_group)
+		setpgid (0, 0);
+
+	/* the parent closes its end once the scope holds us */
+	if (setup->wait_fd >= 0) {
+		close (setup->release_fd);
+		while (read (setup->wait_fd, &c, 1) < 0 && errno == EINTR);
+	}
+}
+
+static ScopeStart *
+scope_start_ref (ScopeStart *scope)
+{
+	scope->ref_count++;
+	return scope;
+}
+
+static void
+scope_start_unref (gpointer data)
+{
+	ScopeStart *scope = (ScopeStart *)data;
+
+	if (--scope->ref_count > 0)
+		return;
+
+	if (scope->bus)
+		g_object_unref (scope->bus);
+	g_free (scope->unit);
+	g_free (scope->name);
+	g_free (scope);
+}
+
+/* Lets the child run, in its scope or, on @error, without one */
+static void
+scope_start_finish (ScopeStart *scope, const GError *error)
+{
+	if (scope->release_fd < 0)
+		return;
+
+	close (scope->release_fd);
+	scope->release_fd = -1;
+
+	g_scopes = g_list_remove (g_scopes, scope);
+
+	if (scope->timeout_id) {
+		GSource *source = g_main_context_find_source_by_id (g_context, scope->timeout_id);
+		if (source)
+			g_source_destroy (source);
+		scope->timeout_id = 0;
+	}
+
+	if (scope->job_removed_id) {
+		g_dbus_connection_signal_unsubscribe (scope->bus, scope->job_removed_id);
+		scope->job_removed_id = 0;
+	}
+
+	if (error) {
+		/* runs anyway, only without the weights */
+		metrics_count ("process_scope_failures", scope->name, 1);
+		flight_record_error (FLIGHT_EVENT_ERROR, scope->name, error);
+		g_debug ("No scope for %s: %s", scope->name, error->message);
+	}
+}
+
+static gboolean
+scope_start_timeout_cb (gpointer data)
+{
+	ScopeStart *scope = (ScopeStart *)data;
+	GError *error;
+
+	scope->timeout_id = 0;
+
+	error = g_error_new (G_IO_ERROR, G_IO_ERROR_TIMED_OUT, "%s was not started in time", scope->unit);
+	scope_start_finish (scope, error);
+	g_error_free (error);
+
+	return G_SOURCE_REMOVE;
+}
+
+/* The pid is in the scope once its start job is done */
+static void
+scope_job_removed_cb (GDBusConnection *connection,
+                      const gchar     *sender_name,
+                      const gchar     *object_path,
+                      const gchar     *interface_name,
+                      const gchar     *signal_name,
+                      GVariant        *parameters,
+                      gpointer         user_data)
+{
+	ScopeStart *scope = (ScopeStart *)user_data;
+	const gchar *unit, *result;
+	GError *error = NULL;
+
+	if (!g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(uoss)")))
+		return;
+
+	g_variant_get (parameters, "(u&o&s&s)", NULL, NULL, &unit, &result);
+	if (!g_str_equal (unit, scope->unit))
+		return;
+
+	if (!g_str_equal (result, "done"))
+		error = g_error_new (G_IO_ERROR, G_IO_ERROR_FAILED, "%s: start job %s", unit, result);
+
+	scope_start_finish (scope, error);
+	g_clear_error (&error);
+}
+
+static void
+scope_started_cb (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+	ScopeStart *scope = (ScopeStart *)user_data;
+	GVariant *ret;
+	GError *error = NULL;
+
+	ret = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source), res, &error);
+	if (ret)
+		g_variant_unref (ret);
+	else
+		scope_start_finish (scope, error);
+
+	g_clear_error (&error);
+	scope_start_unref (scope);
+}
+
+static void
+scope_bus_cb (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+	ScopeStart *scope = (ScopeStart *)user_data;
+	GVariantBuilder props, pids;
+	GError *error = NULL;
+
+	scope->bus = g_bus_get_finish (res, &error);
+	if (!scope->bus) {
+		scope_start_finish (scope, error);
+		g_error_free (error);
+		scope_start_unref (scope);
+		return;
+	}
+
+	/* the child has given up waiting already */
+	if (scope->release_fd < 0) {
+		scope_start_unref (scope);
+		return;
+	}
+
+	scope->job_removed_id =
+		g_dbus_connection_signal_subscribe (scope->bus, SYSTEMD_NAME, SYSTEMD_MANAGER,
+                                            "JobRemoved", SYSTEMD_PATH, NULL,
+                                            G_DBUS_SIGNAL_FLAGS_NONE,
+                                            scope_job_removed_cb,
+                                            scope_start_ref (scope), scope_start_unref);
+
+	/* job signals are only sent to subscribed clients; undone by
+	 * process_registry_shutdown() */
+	if (!g_scope_bus) {
+		g_scope_bus = g_object_ref (scope->bus);
+		g_dbus_connection_call (g_scope_bus, SYSTEMD_NAME, SYSTEMD_PATH, SYSTEMD_MANAGER,
+                                "Subscribe", NULL, NULL, G_DBUS_CALL_FLAGS_NO_AUTO_START,
+                                SCOPE_TIMEOUT_MS, NULL, NULL, NULL);
+	}
+
+	g_variant_builder_init (&pids, G_VARIANT_TYPE ("au"));
+	g_variant_builder_add (&pids, "u", (guint32) scope->pid);
+
+	g_variant_builder_init (&props, G_VARIANT_TYPE ("a(sv)"));
+	g_variant_builder_add (&props, "(sv)", "Description", g_variant_new_string (scope->name));
+	g_variant_builder_add (&props, "(sv)", "PIDs", g_variant_builder_end (&pids));
+	g_variant_builder_add (&props, "(sv)", "CPUWeight", g_variant_new_uint64 (BACKGROUND_CPU_WEIGHT));
+	g_variant_builder_add (&props, "(sv)", "IOWeight", g_variant_new_uint64 (BACKGROUND_IO_WEIGHT));
+	g_variant_builder_add (&props, "(sv)", "CPUAccounting", g_variant_new_boolean (TRUE));
+	g_variant_builder_add (&props, "(sv)", "IOAccounting", g_variant_new_boolean (TRUE));
+
+	/* passes our reference on */
+	g_dbus_connection_call (scope->bus, SYSTEMD_NAME, SYSTEMD_PATH, SYSTEMD_MANAGER,
+                            "StartTransientUnit",
+                            g_variant_new ("(ssa(sv)a(sa(sv)))", scope->unit, "fail", &props, NULL),
+                            G_VARIANT_TYPE ("(o)"),
+                            G_DBUS_CALL_FLAGS_NO_AUTO_START,
+                            SCOPE_TIMEOUT_MS, NULL, scope_started_cb, scope);
+}
+
+static gboolean
+scope_start_idle (gpointer data)
+{
+	ScopeStart *scope = (ScopeStart *)data;
+	GSource *source;
+
+	g_scopes = g_list_prepend (g_scopes, scope);
+
+	source = g_timeout_source_new (SCOPE_TIMEOUT_MS);
+	g_source_set_callback (source, scope_start_timeout_cb, scope_start_ref (scope), scope_start_unref);
+	scope->timeout_id = g_source_attach (source, g_context);
+	g_source_unref (source);
+
+	/* passes our reference on */
+	g_bus_get (g_scope_bus_type, NULL, scope_bus_cb, scope);
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Moves @pid into a new transient scope with a low CPU and IO weight,
+ * then closes @release_fd, which the child waits for. Nothing here
+ * blocks: the scope is started on the registry's context, and the child
+ * is released once systemd reports the start job done, or without a
+ * scope on a failure or after SCOPE_TIMEOUT_MS. The scope keeps CPU and
+ * IO accounting, which systemd logs when the scope stops. */
+static void
+process_scope_start (const gchar *name, GPid pid, gint release_fd)
+{
+	ScopeStart *scope = g_new0 (ScopeStart, 1);
+
+	scope->ref_count = 1;
+	scope->name = g_strdup (name);
+	scope->unit = g_strdup_printf ("%s-%d.scope", name, pid);
+	scope->pid = pid;
+	scope->release_fd = release_fd;
+
+	g_main_context_invoke (g_context, scope_start_idle, scope);
+}
+
+static Process *
+process_register (const gchar     *name,
+                  GPid             pid,
+                  ProcessFlags     flags,
+                  ProcessExitFunc  exit_func,
+                  gpointer         user_data)
+{
+	Process *proc;
+	GPtrArray *procs;
+
+	proc = g_new0 (Process, 1);
+	proc->name = g_strdup (name);
+	proc->pid = pid;
+	proc->pidfd = pidfd_open_compat (pid);
+	proc->group = (flags & PROCESS_FLAGS_NEW_GROUP) ? TRUE : FALSE;
+	proc->start_us = g_get_monotonic_time ();
+	proc->exit_func = exit_func;
+	proc->user_data = user_data;
+
+	g_mutex_lock (&g_lock);
+
+	g_hash_table_insert (g_by_pid, GINT_TO_POINTER (pid), proc);
+
+	procs = g_hash_table_lookup (g_by_name, name);
+	if (!procs) {
+		procs = g_ptr_array_new ();
+		g_hash_table_insert (g_by_name, g_strdup (name), procs);
+	}
+	g_ptr_array_add (procs, proc);
+
+	g_mutex_unlock (&g_lock);
+
+	return proc;
+}
+
+static void
+process_unregister (Process *proc)
+{
+	GPtrArray *procs;
+
+	g_mutex_lock (&g_lock);
+
+	procs = g_hash_table_lookup (g_by_name, proc->name);
+	if (procs) {
+		g_ptr_array_remove_fast (procs, proc);
+		if (procs->len == 0)
+			g_hash_table_remove (g_by_name, proc->name);
+	}
+
+	/* frees proc */
+	g_hash_table_remove (g_by_pid, GINT_TO_POINTER (proc->pid));
+
+	g_mutex_unlock (&g_lock);
+}
+
+static gboolean
+process_spawn (const gchar   *name,
+               gchar        **argv,
+               ProcessFlags   flags,
+               GPid          *pid,
+               GError       **error)
+{
+	gint fds[2] = { -1, -1 };
+	ChildSetup setup;
+	GError *spawn_error = NULL;
+	gboolean background;
+
+	PROBE1 (spawn_start, name);
+
+	background = ((flags & PROCESS_FLAGS_BACKGROUND) && g_scope_bus_type != G_BUS_TYPE_NONE &&
+                  g_unix_open_pipe (fds, FD_CLOEXEC, NULL));
+
+	setup.new_group = (flags & PROCESS_FLAGS_NEW_GROUP) ? TRUE : FALSE;
+	setup.wait_fd = fds[0];
+	setup.release_fd = fds[1];
+
+	if (!g_spawn_async (NULL, argv, NULL,
+                        G_SPAWN_DO_NOT_REAP_CHILD | G_SPAWN_SEARCH_PATH,
+                        (setup.new_group || background) ? child_setup : NULL,
+                        &setup, pid, &spawn_error)) {
+		if (background) {
+			close (fds[0]);
+			close (fds[1]);
+		}
+		metrics_count ("process_spawn_failures", name, 1);
+		flight_record_error (FLIGHT_EVENT_SPAWN_FAILED, name, spawn_error);
+		PROBE2 (spawn_done, name, -1);
+		g_propagate_error (error, spawn_error);
+		return FALSE;
+	}
+
+	if (background) {
+		close (fds[0]);
+		process_scope_start (name, *pid, fds[1]);
+	}
+
+	flight_record (FLIGHT_EVENT_SPAWN, name, *pid, 0);
+	PROBE2 (spawn_done, name, *pid);
+
+	return TRUE;
+}
+
+/* How long every child ran, what it used and how it ended, by name;
+ * children run through pkexec are counted under the name of what pkexec
+ * runs, which it execs. @usage is NULL if the child was reaped by GLib. */
+static void
+process_record_exit (const gchar *name, gint64 start_us, gint64 end_us, gint status,
+                     const struct rusage *usage)
+{
+	metrics_observe ("process_runs", name, end_us - start_us);
+	if (usage) {
+		metrics_observe ("process_cpu", name,
+                         (usage->ru_utime.tv_sec + usage->ru_stime.tv_sec) * G_GINT64_CONSTANT (1000000) +
+                         usage->ru_utime.tv_usec + usage->ru_stime.tv_usec);
+		metrics_count ("process_read_blocks", name, usage->ru_inblock);
+		metrics_count ("process_write_blocks", name, usage->ru_oublock);
+	}
+	trace_complete ("process", name, start_us, end_us);
+	flight_record (FLIGHT_EVENT_EXIT, name, status, end_us - start_us);
+	PROBE3 (process_exit, name, status, end_us - start_us);
+	if (!g_spawn_check_exit_status (status, NULL))
+		metrics_count ("process_failures", name, 1);
+}
+
+static gboolean
+process_group_poll_cb (gpointer data)
+{
+	Process *proc = (Process *)data;
+
+	if (process_group_alive (proc->pid))
+		return G_SOURCE_CONTINUE;
+
+	process_unregister (proc);
+
+	return G_SOURCE_REMOVE;
+}
+
+/* The leader of a group has been reaped; what it started keeps the
+ * entry, so that it can still be looked up and stopped, until the group
+ * is empty */
+static gboolean
+process_keep_group (Process *proc)
+{
+	GSource *source;
+
+	if (!proc->group || !process_group_alive (proc->pid))
+		return FALSE;
+
+	g_mutex_lock (&g_lock);
+	if (proc->pidfd >= 0) {
+		close (proc->pidfd);
+		proc->pidfd = -1;
+	}
+	proc->leader_exited = TRUE;
+	g_mutex_unlock (&g_lock);
+
+	source = g_timeout_source_new (GROUP_POLL_MS);
+	g_source_set_callback (source, process_group_poll_cb, proc, NULL);
+	g_source_attach (source, g_context);
+	g_source_unref (source);
+
+	return TRUE;
+}
+
+static void
+process_exited (Process *proc, gint status, const struct rusage *usage)
+{
+	GPid pid = proc->pid;
+	ProcessExitFunc exit_func = proc->exit_func;
+	gpointer user_data = proc->user_data;
+	gchar *name = g_strdup (proc->name);
+	gint64 start_us = proc->start_us;
+	gint64 end_us = g_get_monotonic_time ();
+
+	if (!process_keep_group (proc))
+		process_unregister (proc);
+	process_record_exit (name, start_us, end_us, status, usage);
+
+	if (exit_func)
+		exit_func (name, pid, status, user_data);
+
+	g_free (name);
+}
+
+static void
+process_exited_cb (GPid pid, gint status, gpointer data)
+{
+	process_exited ((Process *)data, status, NULL);
+}
+
+/* Reaping the child ourselves gives its resource usage */
+static gboolean
+process_pidfd_cb (gint fd, GIOCondition condition, gpointer data)
+{
+	Process *proc = (Process *)data;
+	struct rusage usage;
+	gint status = 0;
+	pid_t ret;
+
+	while ((ret = wait4 (proc->pid, &status, WNOHANG, &usage)) < 0 && errno == EINTR);
+	if (ret == 0)
+		return G_SOURCE_CONTINUE;
+
+	/* the source stops polling @fd before process_exited() closes it,
+	 * so it never watches a reused descriptor */
+	g_source_destroy (g_main_current_source ());
+	process_exited (proc, status, ret > 0 ? &usage : NULL);
+
+	return G_SOURCE_REMOVE;
+}
+
+void
+process_registry_init (GMainContext *context)
+{
+	g_return_if_fail (g_by_pid == NULL);
+
+	g_context = context ? g_main_context_ref (context) : NULL;
+
+	g_by_pid = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, process_free);
+	g_by_name = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                       g_free, (GDestroyNotify) g_ptr_array_unref);
+}
+
+void
+process_registry_set_scope_bus (GBusType bus_type)
+{
+	g_scope_bus_type = bus_type;
+}
+
+void
+process_registry_shutdown (void)
+{
+	/* children waiting for their scope run without one */
+	while (g_scopes)
+		scope_start_finish (g_scopes->data, NULL);
+
+	if (g_scope_bus) {
+		GVariant *ret;
+
+		ret = g_dbus_connection_call_sync (g_scope_bus, SYSTEMD_NAME, SYSTEMD_PATH, SYSTEMD_MANAGER,
+                                           "Unsubscribe", NULL, NULL, G_DBUS_CALL_FLAGS_NO_AUTO_START,
+                                           SCOPE_TIMEOUT_MS, NULL, NULL);
+		if (ret)
+			g_variant_unref (ret);
+		g_clear_object (&g_scope_bus);
+	}
+
+	/* children are left running, we only forget about them */
+	g_mutex_lock (&g_lock);
+	g_clear_pointer (&g_by_name, g_hash_table_destroy);
+	g_clear_pointer (&g_by_pid, g_hash_table_destroy);
+	g_mutex_unlock (&g_lock);
+
+	g_clear_pointer (&g_context, g_main_context_unref);
+}
+
+/* @exit_func is called on the registry's main context once the child has
+ * been reaped. With PROCESS_FLAGS_NEW_GROUP the child stays registered
+ * until its whole group has exited. */
+gboolean
+process_registry_spawn (const gchar      *name,
+                        gchar           **argv,
+                        ProcessFlags      flags,
+                        ProcessExitFunc   exit_func,
+                        gpointer          user_data,
+                        GError          **error)
+{
+	GPid pid;
+	GSource *source;
+	Process *proc;
+
+	g_return_val_if_fail (g_by_pid != NULL, FALSE);
+
+	if (!process_spawn (name, argv, flags, &pid, error))
+		return FALSE;
+
+	proc = process_register (name, pid, flags, exit_func, user_data);
+
+	if (proc->pidfd >= 0) {
+		source = g_unix_fd_source_new (proc->pidfd, G_IO_IN);
+		g_source_set_callback (source, (GSourceFunc) process_pidfd_cb, proc, NULL);
+	} else {
+		source = g_child_watch_source_new (pid);
+		g_source_set_callback (source, (GSourceFunc) process_exited_cb, proc, NULL);
+	}
+	g_source_attach (source, g_context);
+	g_source_unref (source);
+
+	return TRUE;
+}
+
+/* Blocks the calling thread until the child exits, the child stays
+ * visible to process_registry_stop() meanwhile. */
+gboolean
+process_registry_spawn_sync (const gchar      *name,
+                             gchar           **argv,
+                             ProcessFlags      flags,
+                             gint             *exit_status,
+                             GError          **error)
+{
+	GPid pid;
+	gint status = 0;
+	gint64 start_us, end_us;
+	siginfo_t info;
+	struct rusage usage;
+	Process *proc;
+
+	g_return_val_if_fail (g_by_pid != NULL, FALSE);
+
+	/* the scope is started on the registry's context, which would be
+	 * blocked here */
+	if (g_main_context_is_owner (g_context ? g_context : g_main_context_default ()))
+		flags &= ~PROCESS_FLAGS_BACKGROUND;
+
+	if (!process_spawn (name, argv, flags, &pid, error))
+		return FALSE;
+
+	proc = process_register (name, pid, flags, NULL, NULL);
+
+	/* leave the zombie in place until it is unregistered, so that its pid
+	 * can not be reused while it is still in the registry */
+	while (waitid (P_PID, pid, &info, WEXITED | WNOWAIT) < 0 && errno == EINTR);
+
+	start_us = proc->start_us;
+	end_us = g_get_monotonic_time ();
+	process_unregister (proc);
+
+	while (wait4 (pid, &status, 0, &usage) < 0 && errno == EINTR);
+
+	process_record_exit (name, start_us, end_us, status, &usage);
+
+	if (exit_status)
+		*exit_status = status;
+
+	return TRUE;
+}
+
+gboolean
+process_registry_is_running (const gchar *name)
+{
+	guint i;
+	gboolean ret = FALSE;
+	GPtrArray *procs;
+
+	g_return_val_if_fail (g_by_name != NULL, FALSE);
+
+	g_mutex_lock (&g_lock);
+
+	procs = g_hash_table_lookup (g_by_name, name);
+	for (i = 0; procs && i < procs->len; i++) {
+		if (process_alive (g_ptr_array_index (procs, i))) {
+			ret = TRUE;
+			break;
+		}
+	}
+
+	g_mutex_unlock (&g_lock);
+
+	return ret;
+}
+
+/* Returns TRUE if at least one process registered as @name was signalled */
+gboolean
+process_registry_stop (const gchar *name, gint signum)
+{
+	guint i;
+	gboolean ret = FALSE;
+	GPtrArray *procs;
+
+	g_return_val_if_fail (g_by_name != NULL, FALSE);
+
+	g_mutex_lock (&g_lock);
+
+	procs = g_hash_table_lookup (g_by_name, name);
+	for (i = 0; procs && i < procs->len; i++) {
+		if (process_signal (g_ptr_array_index (procs, i), signum) == 0)
+			ret = TRUE;
+	}
+
+	g_mutex_unlock (&g_lock);
+
+	return ret;
+}
+
+static gboolean
+cmdline_has_arg (GPid pid, const gchar *arg)
+{
+	gchar path[32];
+	gchar *contents = NULL, *p;
+	gsize len = 0;
+	gboolean ret = FALSE;
+
+	g_snprintf (path, sizeof (path), "/proc/%d/cmdline", pid);
+	if (!g_file_get_contents (path, &contents, &len, NULL))
+		return FALSE;
+
+	/* the arguments are separated by NULs */
+	for (p = contents; p < contents + len; p += strlen (p) + 1) {
+		if (g_str_equal (p, arg)) {
+			ret = TRUE;
+			break;
+		}
+	}
+
+	g_free (contents);
+
+	return ret;
+}
+
+/* For processes the registry did not start, e.g. autostarted ones: sends
+ * @signum, or only looks with 0, to every process with @arg on its
+ * command line. The command line is read again through a pidfd, so a
+ * pid reused in between is not signalled. Returns TRUE if one was
+ * found. */
+gboolean
+process_registry_signal_unregistered (const gchar *arg, gint signum)
+{
+	GDir *dir;
+	const gchar *entry;
+	gboolean ret = FALSE;
+	GPid self = getpid ();
+
+	g_return_val_if_fail (arg != NULL, FALSE);
+
+	dir = g_dir_open ("/proc", 0, NULL);
+	if (!dir)
+		return FALSE;
+
+	while ((entry = g_dir_read_name (dir))) {
+		gchar *end;
+		gint pidfd;
+		GPid pid = (GPid) g_ascii_strtoll (entry, &end, 10);
+
+		if (*end != '\0' || pid <= 0 || pid == self || !cmdline_has_arg (pid, arg))
+			continue;
+
+		pidfd = pidfd_open_compat (pid);
+		if (pidfd < 0 && errno != ENOSYS)
+			continue;
+
+		if (cmdline_has_arg (pid, arg)) {
+			ret = TRUE;
+			if (signum != 0) {
+#ifdef SYS_pidfd_send_signal
+				if (pidfd >= 0)
+					syscall (SYS_pidfd_send_signal, pidfd, signum, NULL, 0);
+				else
+#endif
+				kill (pid, signum);
+			}
+		}
+
+		if (pidfd >= 0)
+			close (pidfd);
+	}
+
+	g_dir_close (dir);
+
+	return ret;
+}
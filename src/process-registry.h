@@ -0,0 +1,74 @@
+/*
+ * process-registry.h: bookkeeping for the processes we spawn
+ *
+ * Copyright (C) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef PROCESS_REGISTRY_H
+#define PROCESS_REGISTRY_H
+
+#include <glib.h>
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+	PROCESS_FLAGS_NONE      = 0,
+	/* run the child in its own process group, so that stopping it also
+	 * stops whatever it has started; the name stays registered while
+	 * the group has members, also after the child itself has exited */
+	PROCESS_FLAGS_NEW_GROUP = 1 << 0,
+	/* run the child in a transient systemd scope with a low CPU and IO
+	 * weight, so that it yields to the desktop; needs a scope bus */
+	PROCESS_FLAGS_BACKGROUND = 1 << 1
+} ProcessFlags;
+
+typedef void (*ProcessExitFunc) (const gchar *name,
+                                 GPid         pid,
+                                 gint         status,
+                                 gpointer     user_data);
+
+void     process_registry_init       (GMainContext     *context);
+void     process_registry_shutdown   (void);
+
+/* The bus of the systemd instance that runs background children, the
+ * user instance for a session, the system one for a system service */
+void     process_registry_set_scope_bus (GBusType        bus_type);
+
+gboolean process_registry_spawn      (const gchar      *name,
+                                      gchar           **argv,
+                                      ProcessFlags      flags,
+                                      ProcessExitFunc   exit_func,
+                                      gpointer          user_data,
+                                      GError          **error);
+
+gboolean process_registry_spawn_sync (const gchar      *name,
+                                      gchar           **argv,
+                                      ProcessFlags      flags,
+                                      gint             *exit_status,
+                                      GError          **error);
+
+gboolean process_registry_is_running (const gchar      *name);
+gboolean process_registry_stop       (const gchar      *name,
+                                      gint              signum);
+
+gboolean process_registry_signal_unregistered (const gchar *arg,
+                                               gint         signum);
+
+G_END_DECLS
+
+#endif /* PROCESS_REGISTRY_H */
@@ -0,0 +1,47 @@
+/*
+ * root-paths.c: files below $GOOROOM_SESSION_MANAGER_ROOT
+ *
+ * Copyright (C) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "root-paths.h"
+
+
+/* The programs run against a scratch tree, unprivileged, when
+ * $GOOROOM_SESSION_MANAGER_ROOT is set; every absolute path they read,
+ * write or run is then taken below it. */
+void
+root_paths_init (const RootPath *paths, guint n_paths)
+{
+	guint i;
+	const gchar *root = g_getenv ("GOOROOM_SESSION_MANAGER_ROOT");
+
+	if (root && (root[0] == '\0' || g_str_equal (root, "/")))
+		root = NULL;
+
+	for (i = 0; i < n_paths; i++)
+		*paths[i].dest = root ? g_strconcat (root, paths[i].path, NULL) : g_strdup (paths[i].path);
+}
+
+void
+root_paths_free (const RootPath *paths, guint n_paths)
+{
+	guint i;
+
+	for (i = 0; i < n_paths; i++)
+		g_clear_pointer (paths[i].dest, g_free);
+}
@@ -0,0 +1,41 @@
+/*
+ * root-paths.h: files below $GOOROOM_SESSION_MANAGER_ROOT
+ *
+ * Copyright (C) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef ROOT_PATHS_H
+#define ROOT_PATHS_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Where to store the rooted copy of @path */
+typedef struct {
+	gchar       **dest;
+	const gchar  *path;
+} RootPath;
+
+void root_paths_init (const RootPath *paths,
+                      guint           n_paths);
+void root_paths_free (const RootPath *paths,
+                      guint           n_paths);
+
+G_END_DECLS
+
+#endif /* ROOT_PATHS_H */
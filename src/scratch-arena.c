@@ -0,0 +1,185 @@
+/*
+ * scratch-arena.c: bump allocator for per-dispatch temporaries
+ *
+ * Copyright (C) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include "scratch-arena.h"
+
+#define ARENA_ALIGN(n)          (((n) + sizeof (gpointer) - 1) & ~(sizeof (gpointer) - 1))
+
+/* What a reset keeps at most; one oversized message does not pin its
+ * memory for the rest of the session */
+#define ARENA_MAX_RETAINED      (64 * 1024)
+
+
+typedef struct {
+	gchar *data;
+	gsize  size;
+	gsize  used;
+} ArenaBlock;
+
+/* Allocations that do not fit go to overflow blocks. On reset those are
+ * folded into one block of the combined size, up to ARENA_MAX_RETAINED,
+ * so a steady workload ends up with a single block and no allocations
+ * at all. */
+struct _ScratchArena {
+	ArenaBlock  block;
+	GPtrArray  *overflow;    /* ArenaBlock */
+	gsize       overflow_size;
+	gsize       max_size;
+};
+
+
+
+static void
+arena_block_free (gpointer data)
+{
+	ArenaBlock *block = (ArenaBlock *)data;
+
+	g_free (block->data);
+	g_free (block);
+}
+
+ScratchArena *
+scratch_arena_new (gsize initial_size)
+{
+	ScratchArena *arena = g_new0 (ScratchArena, 1);
+
+	arena->block.size = MAX (ARENA_ALIGN (initial_size), 256);
+	arena->block.data = g_malloc (arena->block.size);
+	arena->max_size = MAX (arena->block.size, ARENA_MAX_RETAINED);
+	arena->overflow = g_ptr_array_new_with_free_func (arena_block_free);
+
+	return arena;
+}
+
+void
+scratch_arena_free (ScratchArena *arena)
+{
+	if (!arena)
+		return;
+
+	g_ptr_array_unref (arena->overflow);
+	g_free (arena->block.data);
+	g_free (arena);
+}
+
+void
+scratch_arena_reset (ScratchArena *arena)
+{
+	if (arena->overflow->len > 0) {
+		gsize size = MIN (arena->block.size + arena->overflow_size, arena->max_size);
+
+		g_ptr_array_set_size (arena->overflow, 0);
+		arena->overflow_size = 0;
+
+		if (size != arena->block.size) {
+			g_free (arena->block.data);
+			arena->block.data = g_malloc (size);
+			arena->block.size = size;
+		}
+	}
+
+	arena->block.used = 0;
+}
+
+gpointer
+scratch_arena_alloc (ScratchArena *arena, gsize size)
+{
+	gpointer ret;
+	ArenaBlock *block;
+
+	size = ARENA_ALIGN (MAX (size, 1));
+
+	if (arena->block.size - arena->block.used >= size) {
+		ret = arena->block.data + arena->block.used;
+		arena->block.used += size;
+		return ret;
+	}
+
+	block = NULL;
+	if (arena->overflow->len > 0) {
+		block = g_ptr_array_index (arena->overflow, arena->overflow->len - 1);
+		if (block->size - block->used < size)
+			block = NULL;
+	}
+
+	if (!block) {
+		block = g_new0 (ArenaBlock, 1);
+		block->size = MAX (size, arena->block.size);
+		block->data = g_malloc (block->size);
+		g_ptr_array_add (arena->overflow, block);
+		arena->overflow_size += block->size;
+	}
+
+	ret = block->data + block->used;
+	block->used += size;
+
+	return ret;
+}
+
+gchar *
+scratch_arena_strndup (ScratchArena *arena, const gchar *str, gsize len)
+{
+	gchar *ret = scratch_arena_alloc (arena, len + 1);
+
+	memcpy (ret, str, len);
+	ret[len] = '\0';
+
+	return ret;
+}
+
+/* Like g_strsplit(), but the vector and the strings live in @arena: an
+ * empty string gives an empty vector, a trailing delimiter an empty
+ * last string */
+gchar **
+scratch_arena_split (ScratchArena *arena,
+                     const gchar  *str,
+                     gsize         len,
+                     gchar         delimiter)
+{
+	gsize i, n = 1;
+	gchar *copy, **ret;
+
+	if (len == 0) {
+		ret = scratch_arena_alloc (arena, sizeof (gchar *));
+		ret[0] = NULL;
+		return ret;
+	}
+
+	for (i = 0; i < len; i++) {
+		if (str[i] == delimiter)
+			n++;
+	}
+
+	ret = scratch_arena_alloc (arena, (n + 1) * sizeof (gchar *));
+	copy = scratch_arena_strndup (arena, str, len);
+
+	ret[0] = copy;
+	for (i = 0, n = 1; i < len; i++) {
+		if (copy[i] == delimiter) {
+			copy[i] = '\0';
+			ret[n++] = copy + i + 1;
+		}
+	}
+	ret[n] = NULL;
+
+	return ret;
+}
@@ -0,0 +1,46 @@
+/*
+ * scratch-arena.h: bump allocator for per-dispatch temporaries
+ *
+ * Copyright (C) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef SCRATCH_ARENA_H
+#define SCRATCH_ARENA_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _ScratchArena ScratchArena;
+
+ScratchArena *scratch_arena_new     (gsize         initial_size);
+void          scratch_arena_free    (ScratchArena *arena);
+void          scratch_arena_reset   (ScratchArena *arena);
+
+gpointer      scratch_arena_alloc   (ScratchArena *arena,
+                                     gsize         size);
+gchar        *scratch_arena_strndup (ScratchArena *arena,
+                                     const gchar  *str,
+                                     gsize         len);
+gchar       **scratch_arena_split   (ScratchArena *arena,
+                                     const gchar  *str,
+                                     gsize         len,
+                                     gchar         delimiter);
+
+G_END_DECLS
+
+#endif /* SCRATCH_ARENA_H */
@@ -0,0 +1,179 @@
+/*
+ * session-identity.c: cached user identity and client registration
+ *
+ * Copyright (C) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <pwd.h>
+
+#include "session-identity.h"
+
+
+/* The passwd lookup may go through NSS to sssd/LDAP, so it is resolved
+ * once per session. gcsr.conf is re-read only after it has changed. */
+static GMutex        g_lock;
+static gboolean      g_gpms_user = FALSE;
+static gboolean      g_registered = FALSE;
+static gboolean      g_registered_dirty = TRUE;
+static gchar        *g_gcsr_conf = NULL;
+static GFileMonitor *g_gcsr_monitor = NULL;
+
+
+
+static gboolean
+is_gpms_user (const gchar *username)
+{
+	gboolean ret = FALSE;
+
+	struct passwd *entry = getpwnam (username);
+	if (entry) {
+		gchar **tokens = g_strsplit (entry->pw_gecos, ",", -1);
+		if (g_strv_length (tokens) > 4 ) {
+			if (tokens[4] && (g_strcmp0 (tokens[4], "gooroom-account") == 0)) {
+				ret = TRUE;
+			}
+		}
+		g_strfreev (tokens);
+	}
+
+	return ret;
+}
+
+static gboolean
+registered_gpms (const gchar *gcsr_conf)
+{
+	gchar *glm = NULL;
+	gboolean ret = FALSE;
+	GKeyFile *keyfile = NULL;
+
+	keyfile = g_key_file_new ();
+	if (g_key_file_load_from_file (keyfile, gcsr_conf, G_KEY_FILE_KEEP_COMMENTS, NULL)) {
+		glm  = g_key_file_get_string (keyfile, "domain", "glm", NULL);
+	}
+
+	ret = (glm != NULL) ? TRUE : FALSE;
+
+	g_free (glm);
+	g_key_file_free (keyfile);
+
+	return ret;
+}
+
+static void
+gcsr_conf_changed_cb (GFileMonitor      *monitor,
+                      GFile             *file,
+                      GFile             *other_file,
+                      GFileMonitorEvent  event_type,
+                      gpointer           user_data)
+{
+	g_mutex_lock (&g_lock);
+	g_registered_dirty = TRUE;
+	g_mutex_unlock (&g_lock);
+}
+
+static void
+resolve_thread (GTask        *task,
+                gpointer      source_object,
+                gpointer      task_data,
+                GCancellable *cancellable)
+{
+	gboolean gpms_user = is_gpms_user (g_get_user_name ());
+
+	g_mutex_lock (&g_lock);
+	g_gpms_user = gpms_user;
+	g_mutex_unlock (&g_lock);
+
+	session_identity_is_registered ();
+
+	g_task_return_boolean (task, TRUE);
+}
+
+/* @callback is invoked on the thread-default main context, which also
+ * receives the gcsr.conf change notifications. */
+void
+session_identity_init_async (const gchar         *gcsr_conf,
+                             GAsyncReadyCallback  callback,
+                             gpointer             user_data)
+{
+	GFile *file;
+	GTask *task;
+
+	g_return_if_fail (g_gcsr_conf == NULL);
+
+	g_gcsr_conf = g_strdup (gcsr_conf);
+
+	file = g_file_new_for_path (gcsr_conf);
+	g_gcsr_monitor = g_file_monitor_file (file, G_FILE_MONITOR_NONE, NULL, NULL);
+	if (g_gcsr_monitor) {
+		g_signal_connect (g_gcsr_monitor, "changed",
+                          G_CALLBACK (gcsr_conf_changed_cb), NULL);
+	}
+	g_object_unref (file);
+
+	task = g_task_new (NULL, NULL, callback, user_data);
+	g_task_run_in_thread (task, resolve_thread);
+	g_object_unref (task);
+}
+
+gboolean
+session_identity_init_finish (GAsyncResult  *result,
+                              GError       **error)
+{
+	return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+void
+session_identity_shutdown (void)
+{
+	if (g_gcsr_monitor) {
+		g_signal_handlers_disconnect_by_func (g_gcsr_monitor, gcsr_conf_changed_cb, NULL);
+		g_file_monitor_cancel (g_gcsr_monitor);
+		g_clear_object (&g_gcsr_monitor);
+	}
+
+	g_clear_pointer (&g_gcsr_conf, g_free);
+}
+
+gboolean
+session_identity_is_gpms_user (void)
+{
+	gboolean ret;
+
+	g_mutex_lock (&g_lock);
+	ret = g_gpms_user;
+	g_mutex_unlock (&g_lock);
+
+	return ret;
+}
+
+gboolean
+session_identity_is_registered (void)
+{
+	gboolean ret;
+
+	g_mutex_lock (&g_lock);
+
+	if (g_registered_dirty && g_gcsr_conf) {
+		g_registered = registered_gpms (g_gcsr_conf);
+		g_registered_dirty = FALSE;
+	}
+	ret = g_registered;
+
+	g_mutex_unlock (&g_lock);
+
+	return ret;
+}
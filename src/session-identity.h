@@ -0,0 +1,40 @@
+/*
+ * session-identity.h: cached user identity and client registration
+ *
+ * Copyright (C) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef SESSION_IDENTITY_H
+#define SESSION_IDENTITY_H
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+void     session_identity_init_async   (const gchar          *gcsr_conf,
+                                        GAsyncReadyCallback   callback,
+                                        gpointer              user_data);
+gboolean session_identity_init_finish  (GAsyncResult         *result,
+                                        GError              **error);
+void     session_identity_shutdown     (void);
+
+gboolean session_identity_is_gpms_user (void);
+gboolean session_identity_is_registered (void);
+
+G_END_DECLS
+
+#endif /* SESSION_IDENTITY_H */
@@ -0,0 +1,346 @@
+/*
+ * task-graph.c: run dependent jobs concurrently on a bounded pool
+ *
+ * Copyright (C) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdarg.h>
+
+#include "task-graph.h"
+#include "loop-monitor.h"
+
+
+typedef struct _TaskNode TaskNode;
+
+struct _TaskNode {
+	gchar              *id;
+	TaskGraphNodeFlags  flags;
+	gint                priority;
+	TaskGraphFunc       func;
+	gpointer            user_data;
+	GPtrArray          *dependents;
+	guint               waiting;    /* unfinished dependencies */
+	gint64              start_us;
+	gint64              end_us;
+	TaskGraph          *graph;
+};
+
+struct _TaskGraph {
+	gchar             *name;
+	guint              max_threads;
+	GHashTable        *nodes;       /* id -> TaskNode */
+	GPtrArray         *order;       /* TaskNode, in insertion order */
+	GMutex             lock;
+	GThreadPool       *pool;
+	GMainContext      *context;
+	guint              outstanding;
+	gint64             start_us;
+	gint64             end_us;
+	TaskGraphDoneFunc  done_func;
+	gpointer           done_data;
+};
+
+static void task_node_schedule (TaskNode *node);
+
+
+
+static void
+task_node_free (gpointer data)
+{
+	TaskNode *node = (TaskNode *)data;
+
+	g_ptr_array_unref (node->dependents);
+	g_free (node->id);
+	g_free (node);
+}
+
+static gint
+task_node_compare (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+	const TaskNode *na = a;
+	const TaskNode *nb = b;
+
+	return (na->priority > nb->priority) - (na->priority < nb->priority);
+}
+
+static gint
+task_node_compare_ptr (gconstpointer a, gconstpointer b)
+{
+	return task_node_compare (*(TaskNode * const *) a, *(TaskNode * const *) b, NULL);
+}
+
+static gboolean
+task_graph_done_idle (gpointer data)
+{
+	TaskGraph *graph = (TaskGraph *)data;
+
+	if (graph->done_func)
+		graph->done_func (graph, graph->done_data);
+
+	return FALSE;
+}
+
+static void
+task_node_finish (TaskNode *node)
+{
+	guint i;
+	gboolean done;
+	GPtrArray *ready;
+	TaskGraph *graph = node->graph;
+
+	ready = g_ptr_array_new ();
+
+	g_mutex_lock (&graph->lock);
+
+	node->end_us = g_get_monotonic_time ();
+
+	for (i = 0; i < node->dependents->len; i++) {
+		TaskNode *dep = g_ptr_array_index (node->dependents, i);
+		if (--dep->waiting == 0)
+			g_ptr_array_add (ready, dep);
+	}
+
+	done = (--graph->outstanding == 0);
+	if (done)
+		graph->end_us = node->end_us;
+
+	g_mutex_unlock (&graph->lock);
+
+	/* scheduled outside the lock, the pool may run them right away */
+	for (i = 0; i < ready->len; i++)
+		task_node_schedule (g_ptr_array_index (ready, i));
+	g_ptr_array_free (ready, TRUE);
+
+	if (done) {
+		GSource *source = g_idle_source_new ();
+		g_source_set_callback (source, task_graph_done_idle, graph, NULL);
+		g_source_attach (source, graph->context);
+		g_source_unref (source);
+	}
+}
+
+static void
+task_node_run (TaskNode *node)
+{
+	node->start_us = g_get_monotonic_time ();
+
+	if (node->func)
+		node->func (node->user_data);
+
+	task_node_finish (node);
+}
+
+static void
+task_node_pool_func (gpointer data, gpointer user_data)
+{
+	task_node_run ((TaskNode *)data);
+}
+
+static gboolean
+task_node_idle (gpointer data)
+{
+	TaskNode *node = (TaskNode *)data;
+
+	loop_monitor_enter (node->id);
+	task_node_run (node);
+	loop_monitor_leave ();
+
+	return FALSE;
+}
+
+static void
+task_node_schedule (TaskNode *node)
+{
+	TaskGraph *graph = node->graph;
+
+	if (node->flags & TASK_GRAPH_NODE_IN_CONTEXT) {
+		/* never inline, even when called on the graph's context */
+		GSource *source = g_idle_source_new ();
+		g_source_set_priority (source, node->priority);
+		g_source_set_callback (source, task_node_idle, node, NULL);
+		g_source_attach (source, graph->context);
+		g_source_unref (source);
+	} else {
+		g_thread_pool_push (graph->pool, node, NULL);
+	}
+}
+
+TaskGraph *
+task_graph_new (const gchar *name, guint max_threads)
+{
+	TaskGraph *graph = g_new0 (TaskGraph, 1);
+
+	graph->name = g_strdup (name);
+	graph->max_threads = MAX (max_threads, 1);
+	graph->nodes = g_hash_table_new (g_str_hash, g_str_equal);
+	graph->order = g_ptr_array_new_with_free_func (task_node_free);
+	g_mutex_init (&graph->lock);
+
+	return graph;
+}
+
+/* Must not be called from one of the graph's own nodes */
+void
+task_graph_free (TaskGraph *graph)
+{
+	if (!graph)
+		return;
+
+	if (graph->pool)
+		g_thread_pool_free (graph->pool, FALSE, TRUE);
+
+	if (graph->context)
+		g_main_context_unref (graph->context);
+
+	g_hash_table_destroy (graph->nodes);
+	g_ptr_array_unref (graph->order);
+	g_mutex_clear (&graph->lock);
+	g_free (graph->name);
+	g_free (graph);
+}
+
+void
+task_graph_add (TaskGraph          *graph,
+                const gchar        *id,
+                TaskGraphNodeFlags  flags,
+                gint                priority,
+                TaskGraphFunc       func,
+                gpointer            user_data,
+                ...)
+{
+	va_list args;
+	const gchar *dep_id;
+	TaskNode *node;
+
+	g_return_if_fail (graph != NULL && id != NULL);
+	g_return_if_fail (graph->pool == NULL);
+	g_return_if_fail (g_hash_table_lookup (graph->nodes, id) == NULL);
+
+	node = g_new0 (TaskNode, 1);
+	node->id = g_strdup (id);
+	node->flags = flags;
+	node->priority = priority;
+	node->func = func;
+	node->user_data = user_data;
+	node->dependents = g_ptr_array_new ();
+	node->graph = graph;
+
+	/* dependencies must already exist, so the graph is always acyclic */
+	va_start (args, user_data);
+	while ((dep_id = va_arg (args, const gchar *)) != NULL) {
+		TaskNode *dep = g_hash_table_lookup (graph->nodes, dep_id);
+		if (!dep) {
+			g_warning ("%s: unknown dependency '%s' of '%s'", graph->name, dep_id, id);
+			continue;
+		}
+		g_ptr_array_add (dep->dependents, node);
+		node->waiting++;
+	}
+	va_end (args);
+
+	g_hash_table_insert (graph->nodes, node->id, node);
+	g_ptr_array_add (graph->order, node);
+}
+
+/* @done_func is called on @context (or the thread-default context) once
+ * every node has finished. */
+void
+task_graph_run (TaskGraph         *graph,
+                GMainContext      *context,
+                TaskGraphDoneFunc  done_func,
+                gpointer           user_data)
+{
+	guint i;
+	GPtrArray *ready;
+
+	g_return_if_fail (graph != NULL);
+	g_return_if_fail (graph->pool == NULL);
+
+	graph->context = context ? g_main_context_ref (context)
+                             : g_main_context_ref_thread_default ();
+	graph->done_func = done_func;
+	graph->done_data = user_data;
+	graph->outstanding = graph->order->len;
+	graph->start_us = g_get_monotonic_time ();
+
+	graph->pool = g_thread_pool_new (task_node_pool_func, graph,
+                                     graph->max_threads, FALSE, NULL);
+	g_thread_pool_set_sort_function (graph->pool, task_node_compare, NULL);
+
+	if (graph->outstanding == 0) {
+		graph->end_us = graph->start_us;
+		task_graph_done_idle (graph);
+		return;
+	}
+
+	ready = g_ptr_array_new ();
+	for (i = 0; i < graph->order->len; i++) {
+		TaskNode *node = g_ptr_array_index (graph->order, i);
+		if (node->waiting == 0)
+			g_ptr_array_add (ready, node);
+	}
+
+	g_ptr_array_sort (ready, task_node_compare_ptr);
+	for (i = 0; i < ready->len; i++)
+		task_node_schedule (g_ptr_array_index (ready, i));
+
+	g_ptr_array_free (ready, TRUE);
+}
+
+const gchar *
+task_graph_get_name (TaskGraph *graph)
+{
+	return graph->name;
+}
+
+/* Reports the graph itself first, then every node that has started */
+void
+task_graph_foreach_timing (TaskGraph           *graph,
+                           TaskGraphTimingFunc  func,
+                           gpointer             user_data)
+{
+	guint i;
+
+	g_mutex_lock (&graph->lock);
+
+	func (graph->name, graph->start_us, graph->end_us, user_data);
+
+	for (i = 0; i < graph->order->len; i++) {
+		TaskNode *node = g_ptr_array_index (graph->order, i);
+		if (node->start_us)
+			func (node->id, node->start_us, node->end_us, user_data);
+	}
+
+	g_mutex_unlock (&graph->lock);
+}
+
+static void
+log_timing (const gchar *id, gint64 start_us, gint64 end_us, gpointer user_data)
+{
+	TaskGraph *graph = (TaskGraph *)user_data;
+
+	g_debug ("%s: %-24s %8.1f ms .. %8.1f ms (%.1f ms)", graph->name, id,
+             (start_us - graph->start_us) / 1000.0,
+             (end_us - graph->start_us) / 1000.0,
+             (end_us - start_us) / 1000.0);
+}
+
+void
+task_graph_log_timings (TaskGraph *graph)
+{
+	task_graph_foreach_timing (graph, log_timing, graph);
+}
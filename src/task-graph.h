@@ -0,0 +1,71 @@
+/*
+ * task-graph.h: run dependent jobs concurrently on a bounded pool
+ *
+ * Copyright (C) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef TASK_GRAPH_H
+#define TASK_GRAPH_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _TaskGraph TaskGraph;
+
+typedef enum {
+	TASK_GRAPH_NODE_NONE       = 0,
+	/* run on the graph's main context instead of the thread pool */
+	TASK_GRAPH_NODE_IN_CONTEXT = 1 << 0
+} TaskGraphNodeFlags;
+
+typedef void (*TaskGraphFunc)       (gpointer     user_data);
+typedef void (*TaskGraphDoneFunc)   (TaskGraph   *graph,
+                                     gpointer     user_data);
+typedef void (*TaskGraphTimingFunc) (const gchar *id,
+                                     gint64       start_us,
+                                     gint64       end_us,
+                                     gpointer     user_data);
+
+TaskGraph   *task_graph_new            (const gchar         *name,
+                                        guint                max_threads);
+void         task_graph_free           (TaskGraph           *graph);
+
+/* Dependencies are given as a NULL-terminated list of ids of nodes added
+ * before. Nodes with a lower @priority are started first. */
+void         task_graph_add            (TaskGraph           *graph,
+                                        const gchar         *id,
+                                        TaskGraphNodeFlags   flags,
+                                        gint                 priority,
+                                        TaskGraphFunc        func,
+                                        gpointer             user_data,
+                                        ...) G_GNUC_NULL_TERMINATED;
+
+void         task_graph_run            (TaskGraph           *graph,
+                                        GMainContext        *context,
+                                        TaskGraphDoneFunc    done_func,
+                                        gpointer             user_data);
+
+const gchar *task_graph_get_name       (TaskGraph           *graph);
+void         task_graph_foreach_timing (TaskGraph           *graph,
+                                        TaskGraphTimingFunc  func,
+                                        gpointer             user_data);
+void         task_graph_log_timings    (TaskGraph           *graph);
+
+G_END_DECLS
+
+#endif /* TASK_GRAPH_H */
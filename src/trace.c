@@ -0,0 +1,233 @@
+/*
+ * trace.c: timeline of what a process does, in Chrome trace format
+ *
+ * Copyright (C) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+
+#include "trace.h"
+
+/* a login has a few hundred, this only bounds a long session */
+#define TRACE_MAX_EVENTS        65536
+
+
+typedef struct {
+	const gchar *category;
+	const gchar *name;
+	gint64       start_us;
+	gint64       end_us;
+	gint         tid;
+	gboolean     instant;
+} TraceEvent;
+
+/* set before any thread is started and never changed afterwards */
+static gboolean    g_enabled = FALSE;
+static gchar      *g_path = NULL;
+
+static GMutex      g_lock;
+static GArray     *g_events = NULL;
+static GHashTable *g_thread_names = NULL;  /* tid -> name */
+static guint       g_dropped = 0;
+
+
+
+static gint
+current_tid (void)
+{
+	return (gint) syscall (SYS_gettid);
+}
+
+/* Called with the lock held */
+static void
+trace_add (const gchar *category, const gchar *name,
+           gint64 start_us, gint64 end_us, gboolean instant)
+{
+	TraceEvent event;
+
+	if (g_events->len >= TRACE_MAX_EVENTS) {
+		g_dropped++;
+		return;
+	}
+
+	event.category = category;
+	event.name = g_intern_string (name);
+	event.start_us = start_us;
+	event.end_us = end_us;
+	event.tid = current_tid ();
+	event.instant = instant;
+
+	/* threads started with g_thread_new() are named after their purpose */
+	if (!g_hash_table_contains (g_thread_names, GINT_TO_POINTER (event.tid))) {
+		gchar thread_name[17] = { 0, };
+		prctl (PR_GET_NAME, thread_name, 0, 0, 0);
+		g_hash_table_insert (g_thread_names, GINT_TO_POINTER (event.tid), g_strdup (thread_name));
+	}
+
+	g_array_append_val (g_events, event);
+}
+
+void
+trace_init (const gchar *path)
+{
+	g_return_if_fail (g_events == NULL);
+
+	if (!path || !*path)
+		return;
+
+	g_path = g_strdup (path);
+	g_events = g_array_sized_new (FALSE, FALSE, sizeof (TraceEvent), 256);
+	g_thread_names = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+	g_enabled = TRUE;
+}
+
+void
+trace_shutdown (void)
+{
+	if (!g_enabled)
+		return;
+
+	g_mutex_lock (&g_lock);
+	g_clear_pointer (&g_events, g_array_unref);
+	g_clear_pointer (&g_thread_names, g_hash_table_destroy);
+	g_clear_pointer (&g_path, g_free);
+	g_enabled = FALSE;
+	g_mutex_unlock (&g_lock);
+}
+
+gboolean
+trace_is_enabled (void)
+{
+	return g_enabled;
+}
+
+gint64
+trace_now (void)
+{
+	return g_enabled ? g_get_monotonic_time () : 0;
+}
+
+void
+trace_complete (const gchar *category, const gchar *name, gint64 start_us, gint64 end_us)
+{
+	if (!g_enabled || !name)
+		return;
+
+	g_mutex_lock (&g_lock);
+	if (g_events)
+		trace_add (category, name, start_us, end_us, FALSE);
+	g_mutex_unlock (&g_lock);
+}
+
+void
+trace_instant (const gchar *category, const gchar *name)
+{
+	gint64 now;
+
+	if (!g_enabled || !name)
+		return;
+
+	now = g_get_monotonic_time ();
+
+	g_mutex_lock (&g_lock);
+	if (g_events)
+		trace_add (category, name, now, now, TRUE);
+	g_mutex_unlock (&g_lock);
+}
+
+static void
+append_json_string (GString *out, const gchar *str)
+{
+	const gchar *p;
+
+	g_string_append_c (out, '"');
+	for (p = str; *p; p++) {
+		if (*p == '"' || *p == '\\')
+			g_string_append_printf (out, "\\%c", *p);
+		else if ((guchar) *p < 0x20)
+			g_string_append_printf (out, "\\u%04x", (guchar) *p);
+		else
+			g_string_append_c (out, *p);
+	}
+	g_string_append_c (out, '"');
+}
+
+/* Writes every event so far, replacing what an earlier call wrote */
+gboolean
+trace_write (GError **error)
+{
+	guint i;
+	gint pid;
+	GString *out;
+	gboolean ret;
+	GHashTableIter iter;
+	gpointer key, value;
+
+	if (!g_enabled)
+		return TRUE;
+
+	pid = (gint) getpid ();
+	out = g_string_new ("{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+
+	g_mutex_lock (&g_lock);
+
+	g_string_append_printf (out, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, "
+                            "\"args\": {\"name\": ", pid);
+	append_json_string (out, g_get_prgname () ? g_get_prgname () : "");
+	g_string_append (out, "}}");
+
+	g_hash_table_iter_init (&iter, g_thread_names);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		g_string_append_printf (out, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, "
+                                "\"tid\": %d, \"args\": {\"name\": ", pid, GPOINTER_TO_INT (key));
+		append_json_string (out, value);
+		g_string_append (out, "}}");
+	}
+
+	for (i = 0; i < g_events->len; i++) {
+		TraceEvent *event = &g_array_index (g_events, TraceEvent, i);
+
+		g_string_append (out, ",\n{\"name\": ");
+		append_json_string (out, event->name);
+		g_string_append (out, ", \"cat\": ");
+		append_json_string (out, event->category);
+		if (event->instant)
+			g_string_append_printf (out, ", \"ph\": \"i\", \"s\": \"t\", \"ts\": %" G_GINT64_FORMAT,
+                                    event->start_us);
+		else
+			g_string_append_printf (out, ", \"ph\": \"X\", \"ts\": %" G_GINT64_FORMAT
+                                    ", \"dur\": %" G_GINT64_FORMAT,
+                                    event->start_us, event->end_us - event->start_us);
+		g_string_append_printf (out, ", \"pid\": %d, \"tid\": %d}", pid, event->tid);
+	}
+
+	if (g_dropped)
+		g_string_append_printf (out, ",\n{\"name\": \"%u events dropped\", \"ph\": \"i\", \"s\": \"g\", "
+                                "\"ts\": %" G_GINT64_FORMAT ", \"pid\": %d, \"tid\": 0}",
+                                g_dropped, g_get_monotonic_time (), pid);
+
+	g_mutex_unlock (&g_lock);
+
+	g_string_append (out, "\n]}\n");
+
+	ret = g_file_set_contents (g_path, out->str, out->len, error);
+	g_string_free (out, TRUE);
+
+	return ret;
+}
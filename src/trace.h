@@ -0,0 +1,53 @@
+/*
+ * trace.h: timeline of what a process does, in Chrome trace format
+ *
+ * Copyright (C) 2015-2019 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Tracing is off unless trace_init() was given a file to write to; then
+ * events are kept in memory until trace_write(), which can be loaded in
+ * chrome://tracing or Perfetto. Times are g_get_monotonic_time(). When
+ * off, every call returns right away. */
+
+void     trace_init       (const gchar *path);
+void     trace_shutdown   (void);
+
+gboolean trace_is_enabled (void);
+
+/* The current time if tracing is on, 0 otherwise */
+gint64   trace_now        (void);
+
+/* @category must be a static string; @name is interned */
+void     trace_complete   (const gchar *category,
+                           const gchar *name,
+                           gint64       start_us,
+                           gint64       end_us);
+void     trace_instant    (const gchar *category,
+                           const gchar *name);
+
+gboolean trace_write      (GError     **error);
+
+G_END_DECLS
+
+#endif /* TRACE_H */